@@ -0,0 +1,601 @@
+/** @file share_bench.cpp
+ *      This file contains microbenchmarks of the queue and share classes used
+ *      to pass data between the Scroomba tasks.
+ *
+ *  @details Every operation is timed one call at a time with the cycle counter
+ *           in @c cycle_count.h, and the time to read the counter itself is
+ *           taken off. Each case prints one line of comma separated numbers so
+ *           results from before and after a change to @c taskqueue.h or
+ *           @c taskshare.h can be compared with a script. The variants are:
+ *           - @c uncontended: nothing else is using the queue or share.
+ *           - @c contended: for queues, a higher priority task is blocked
+ *             waiting on the queue, so each @c put() wakes it and switches to
+ *             it and back; for shares, a task of equal priority is writing the
+ *             same share as fast as it can.
+ *           - @c isr: the @c ISR_ methods, called with interrupts masked as
+ *             they would be inside an interrupt service routine.
+ *
+ *           On the Nucleo there is also an @c isr_latency case: a timer
+ *           interrupt notes how many cycles late it started while a low
+ *           priority task does nothing (@c idle), hammers a one word share
+ *           (@c lock-free) or hammers a 64 byte share (@c critical). Shares
+ *           of one word never mask interrupts, so the worst latency with
+ *           them should match the idle case; a large share's critical
+ *           sections hold the interrupt off for the whole copy.
+ *
+ *           On the Nucleo, build the @c bench_l476rg environment and watch the
+ *           serial port. On a PC, the @c bench_native environment runs the
+ *           same code on the simulator's kernel; those numbers are the cost
+ *           of the wrapper classes plus the stand-in kernel, not FreeRTOS.
+ */
+
+#include <Arduino.h>
+#include <PrintStream.h>
+#if (defined STM32L4xx || defined STM32F4xx)
+    #include <STM32FreeRTOS.h>
+#endif
+#include "taskqueue.h"
+#include "taskshare.h"
+#include "seqshare.h"
+#include "cycle_count.h"
+
+const uint16_t BENCH_RUNS = 1000;       ///< Times each operation is timed
+
+/// A 16 byte item, about the size of a small sensor report
+struct Bench16
+{
+    uint8_t bytes[16];
+};
+
+/// A 64 byte item, about the size of a robot state snapshot
+struct Bench64
+{
+    uint8_t bytes[64];
+};
+
+static uint32_t overhead = 0;           ///< Cycles to read the counter twice
+static volatile bool bench_over = false; ///< All cases have been run
+static Queue<uint8_t>* p_wake_queue = NULL; ///< Queue the waiting reader uses
+static Share<uint8_t>* p_fight_share = NULL; ///< Share the rival task writes
+static volatile bool rival_on = true;   ///< The rival task keeps writing
+
+
+/** @brief   Gathers the fastest, slowest and average time of an operation.
+ */
+class BenchStat
+{
+    protected:
+        uint32_t least;                 ///< Fastest run, cycles
+        uint32_t most;                  ///< Slowest run, cycles
+        uint64_t total;                 ///< Sum of all runs, cycles
+        uint32_t runs;                  ///< Number of runs
+
+    public:
+        BenchStat (void) : least (UINT32_MAX), most (0), total (0), runs (0)
+        {
+        }
+
+        /** @brief   Add one run, given the counter before and after it.
+         */
+        void add (uint32_t start, uint32_t stop)
+        {
+            uint32_t cycles = stop - start;
+            add_cycles ((cycles > overhead) ? cycles - overhead : 0);
+        }
+
+        /** @brief   Add one run which is already a number of cycles.
+         */
+        void add_cycles (uint32_t cycles)
+        {
+            least = min (least, cycles);
+            most = max (most, cycles);
+            total += cycles;
+            runs++;
+        }
+
+        /** @brief   Print one line of the report.
+         */
+        void print (const char* op, const char* type, uint16_t bytes,
+                    uint16_t depth, const char* variant)
+        {
+            Serial.printf ("%s,%s,%u,%u,%s,%lu,%lu,%lu,%lu\n", op, type, bytes,
+                           depth, variant, (unsigned long)runs,
+                           (unsigned long)least,
+                           (unsigned long)(total / (runs ? runs : 1)),
+                           (unsigned long)most);
+        }
+};
+
+
+/** @brief   Task which waits on a queue so that each put wakes it up.
+ *  @param   p_params A pointer to function parameters which we don't use.
+ */
+void task_bench_reader (void* p_params)
+{
+    (void)p_params;            // Does nothing but shut up a compiler warning
+
+    uint8_t item;
+    for (;;)
+    {
+        p_wake_queue->get (item);
+    }
+}
+
+
+/** @brief   Task which keeps writing a share that is being timed.
+ *  @param   p_params A pointer to function parameters which we don't use.
+ */
+void task_bench_rival (void* p_params)
+{
+    (void)p_params;            // Does nothing but shut up a compiler warning
+
+    uint8_t value = 0;
+    for (;;)
+    {
+        if (rival_on)
+        {
+            p_fight_share->put (value++);
+        }
+        else
+        {
+            vTaskDelay (100);
+        }
+    }
+}
+
+
+/** @brief   Time the queue operations for one item type and queue depth.
+ *  @param   type Name of the item type for the report
+ *  @param   depth Number of items the queue can hold
+ */
+template <class T>
+void bench_queue (const char* type, uint16_t depth)
+{
+    // Queues stay in the list of shares, so they must never be deleted
+    Queue<T>* p_queue = new Queue<T> (depth, "Bench queue");
+    T item;
+    memset (&item, 0, sizeof (item));
+    BenchStat put, get, any, isr_put, isr_get;
+
+    for (uint16_t run = 0; run < BENCH_RUNS; run++)
+    {
+        uint32_t start = cycle_count ();
+        p_queue->put (item);
+        put.add (start, cycle_count ());
+
+        start = cycle_count ();
+        bool got = p_queue->any ();
+        any.add (start, cycle_count ());
+        (void)got;
+
+        // Drain when full so the next put never has to wait
+        if (p_queue->available () == depth)
+        {
+            while (p_queue->any ())
+            {
+                start = cycle_count ();
+                p_queue->get (item);
+                get.add (start, cycle_count ());
+            }
+        }
+
+        portENTER_CRITICAL ();
+        start = cycle_count ();
+        bool put_ok = p_queue->ISR_put (item);
+        uint32_t middle = cycle_count ();
+        if (put_ok)
+        {
+            p_queue->ISR_get (item);
+        }
+        uint32_t stop = cycle_count ();
+        portEXIT_CRITICAL ();
+        if (put_ok)
+        {
+            isr_put.add (start, middle);
+            isr_get.add (middle, stop);
+        }
+    }
+    while (p_queue->any ())
+    {
+        p_queue->get (item);
+    }
+
+    put.print ("queue_put", type, sizeof (T), depth, "uncontended");
+    get.print ("queue_get", type, sizeof (T), depth, "uncontended");
+    any.print ("queue_any", type, sizeof (T), depth, "uncontended");
+    isr_put.print ("queue_put", type, sizeof (T), depth, "isr");
+    isr_get.print ("queue_get", type, sizeof (T), depth, "isr");
+}
+
+
+/** @brief   Time a put which wakes up a higher priority task.
+ */
+void bench_queue_wake (void)
+{
+    BenchStat put;
+    uint8_t item = 0;
+
+    for (uint16_t run = 0; run < BENCH_RUNS; run++)
+    {
+        uint32_t start = cycle_count ();
+        p_wake_queue->put (item);
+        put.add (start, cycle_count ());
+    }
+    put.print ("queue_put", "uint8_t", 1, 1, "contended");
+}
+
+
+/** @brief   Time the share operations for one item type.
+ *  @param   type Name of the item type for the report
+ */
+template <class T>
+void bench_share (const char* type)
+{
+    Share<T>* p_share = new Share<T> ("Bench share");
+    T item;
+    memset (&item, 0, sizeof (item));
+    BenchStat put, get, isr_put, isr_get;
+
+    for (uint16_t run = 0; run < BENCH_RUNS; run++)
+    {
+        uint32_t start = cycle_count ();
+        p_share->put (item);
+        put.add (start, cycle_count ());
+
+        start = cycle_count ();
+        p_share->get (item);
+        get.add (start, cycle_count ());
+
+        portENTER_CRITICAL ();
+        start = cycle_count ();
+        p_share->ISR_put (item);
+        uint32_t middle = cycle_count ();
+        p_share->ISR_get (item);
+        uint32_t stop = cycle_count ();
+        portEXIT_CRITICAL ();
+        isr_put.add (start, middle);
+        isr_get.add (middle, stop);
+    }
+
+    put.print ("share_put", type, sizeof (T), 1, "uncontended");
+    get.print ("share_get", type, sizeof (T), 1, "uncontended");
+    isr_put.print ("share_put", type, sizeof (T), 1, "isr");
+    isr_get.print ("share_get", type, sizeof (T), 1, "isr");
+}
+
+
+/** @brief   Time the sequence counted share operations for one item type.
+ *  @param   type Name of the item type for the report
+ */
+template <class T>
+void bench_seqshare (const char* type)
+{
+    SeqShare<T>* p_share = new SeqShare<T> ("Bench seqshare");
+    T item;
+    memset (&item, 0, sizeof (item));
+    BenchStat put, get, isr_get;
+
+    for (uint16_t run = 0; run < BENCH_RUNS; run++)
+    {
+        uint32_t start = cycle_count ();
+        p_share->put (item);
+        put.add (start, cycle_count ());
+
+        start = cycle_count ();
+        p_share->get (item);
+        get.add (start, cycle_count ());
+
+        portENTER_CRITICAL ();
+        start = cycle_count ();
+        p_share->ISR_get (item);
+        uint32_t stop = cycle_count ();
+        portEXIT_CRITICAL ();
+        isr_get.add (start, stop);
+    }
+
+    put.print ("seqshare_put", type, sizeof (T), 1, "uncontended");
+    get.print ("seqshare_get", type, sizeof (T), 1, "uncontended");
+    isr_get.print ("seqshare_get", type, sizeof (T), 1, "isr");
+}
+
+
+/** @brief   Time share operations while another task writes the same share.
+ */
+void bench_share_fight (void)
+{
+    BenchStat put, get, inc;
+    uint8_t item = 0;
+
+    for (uint16_t run = 0; run < BENCH_RUNS; run++)
+    {
+        uint32_t start = cycle_count ();
+        p_fight_share->put (item);
+        put.add (start, cycle_count ());
+
+        start = cycle_count ();
+        p_fight_share->get (item);
+        get.add (start, cycle_count ());
+
+        start = cycle_count ();
+        (*p_fight_share)++;
+        inc.add (start, cycle_count ());
+    }
+    put.print ("share_put", "uint8_t", 1, 1, "contended");
+    get.print ("share_get", "uint8_t", 1, 1, "contended");
+    inc.print ("share_inc", "uint8_t", 1, 1, "contended");
+}
+
+
+#if (defined STM32L4xx || defined STM32F4xx)
+
+/// What the hammer task is doing during the interrupt latency case
+enum BenchHammer
+{
+    HAMMER_NONE,                        ///< Nothing; only waiting
+    HAMMER_LOCK_FREE,                   ///< Writing a one word share
+    HAMMER_CRITICAL                     ///< Writing a 64 byte share
+};
+
+const uint32_t LATENCY_HZ = 10000;      ///< Rate of the timer interrupt
+const uint16_t LATENCY_MS = 1000;       ///< Time each latency case runs
+
+static volatile uint8_t hammer = HAMMER_NONE; ///< What the hammer task does
+static Share<uint32_t>* p_word_share = NULL;  ///< Lock-free share hammered
+static Share<Bench64>* p_big_share = NULL;    ///< Locked share hammered
+static BenchStat* volatile p_latency = NULL;  ///< Latencies being gathered
+static uint32_t cycles_per_tick = 1;    ///< CPU cycles per timer count
+
+
+/** @brief   Timer interrupt which notes how late it started.
+ *  @details The counter starts again from zero at the update event which
+ *           raises this interrupt, so its value now is the time since the
+ *           interrupt was asked for. This includes a fixed cost for the timer
+ *           library to call this function; what matters is how much the
+ *           latency varies.
+ */
+void bench_latency_isr (void)
+{
+    uint32_t late = TIM7->CNT * cycles_per_tick;
+    BenchStat* p_stat = p_latency;
+    if (p_stat)
+    {
+        p_stat->add_cycles (late);
+    }
+}
+
+
+/** @brief   Task which hammers one share while the latency is measured.
+ *  @details This runs below the benchmark task's priority, so it only runs
+ *           while the benchmark task waits for the interrupts to gather.
+ *  @param   p_params A pointer to function parameters which we don't use.
+ */
+void task_bench_hammer (void* p_params)
+{
+    (void)p_params;            // Does nothing but shut up a compiler warning
+
+    uint32_t word = 0;
+    Bench64 big;
+    memset (&big, 0, sizeof (big));
+    for (;;)
+    {
+        if (hammer == HAMMER_LOCK_FREE)
+        {
+            p_word_share->put (word++);
+            (*p_word_share)++;
+        }
+        else if (hammer == HAMMER_CRITICAL)
+        {
+            big.bytes[0]++;
+            p_big_share->put (big);
+            p_big_share->get (big);
+        }
+        else
+        {
+            vTaskDelay (1);
+        }
+    }
+}
+
+
+/** @brief   Measure the timer interrupt's latency with the hammer doing one
+ *           thing.
+ *  @param   what What the hammer task does, from @c BenchHammer
+ *  @param   type Name of the share's item type for the report
+ *  @param   bytes Size of the share's item
+ *  @param   variant Name of the case for the report
+ */
+void bench_latency_case (uint8_t what, const char* type, uint16_t bytes,
+                         const char* variant)
+{
+    BenchStat latency;
+    hammer = what;
+    p_latency = &latency;
+    vTaskDelay (LATENCY_MS);
+    p_latency = NULL;
+    hammer = HAMMER_NONE;
+    latency.print ("isr_latency", type, bytes, 0, variant);
+}
+
+
+/** @brief   Measure how shares delay a timer interrupt.
+ *  @details The timer library gives its interrupts a priority which
+ *           FreeRTOS critical sections mask, like most interrupts on the
+ *           robot.
+ */
+void bench_latency (void)
+{
+    p_word_share = new Share<uint32_t> ("Bench word");
+    p_big_share = new Share<Bench64> ("Bench big");
+    xTaskCreate (task_bench_hammer, "Hammer", 256, NULL, 1, NULL);
+
+    HardwareTimer* p_timer = new HardwareTimer (TIM7);
+    p_timer->setPrescaleFactor (1);
+    cycles_per_tick = SystemCoreClock / p_timer->getTimerClkFreq ();
+    p_timer->setOverflow (LATENCY_HZ, HERTZ_FORMAT);
+    p_timer->attachInterrupt (bench_latency_isr);
+    p_timer->resume ();
+
+    bench_latency_case (HAMMER_NONE, "none", 0, "idle");
+    bench_latency_case (HAMMER_LOCK_FREE, "uint32_t", sizeof (uint32_t),
+                        "lock-free");
+    bench_latency_case (HAMMER_CRITICAL, "Bench64", sizeof (Bench64),
+                        "critical");
+
+    p_timer->pause ();
+}
+
+#endif // STM32L4xx || STM32F4xx
+
+
+/// A printer which throws everything away, for timing the share list walk
+class BenchNullPrint : public Print
+{
+    public:
+        size_t write (uint8_t c)
+        {
+            (void)c;
+            return (1);
+        }
+};
+
+
+/** @brief   Time a walk of the whole list of shares and queues.
+ */
+void bench_share_list (void)
+{
+    BenchNullPrint nowhere;
+    BenchStat walk;
+
+    for (uint16_t run = 0; run < BENCH_RUNS / 10; run++)
+    {
+        uint32_t start = cycle_count ();
+        print_all_shares (nowhere);
+        walk.add (start, cycle_count ());
+    }
+    walk.print ("print_all_shares", "BaseShare", 0, 0, "uncontended");
+}
+
+
+/** @brief   Time a walk of the whole list of shares which only fills in stats.
+ */
+void bench_share_stats (void)
+{
+    BenchStat walk;
+    ShareStats stats;
+
+    for (uint16_t run = 0; run < BENCH_RUNS / 10; run++)
+    {
+        uint32_t start = cycle_count ();
+        ShareIterator items;
+        while (items.next (stats))
+        {
+        }
+        walk.add (start, cycle_count ());
+    }
+    walk.print ("share_stats", "BaseShare", 0, 0, "uncontended");
+}
+
+
+/** @brief   Task which runs every benchmark once and prints the report.
+ *  @param   p_params A pointer to function parameters which we don't use.
+ */
+void task_bench (void* p_params)
+{
+    (void)p_params;            // Does nothing but shut up a compiler warning
+
+    // Find the cost of reading the counter so it can be taken off every run
+    cycle_count_begin ();
+    overhead = UINT32_MAX;
+    for (uint8_t run = 0; run < 100; run++)
+    {
+        uint32_t start = cycle_count ();
+        overhead = min (overhead, cycle_count () - start);
+    }
+
+    Serial.printf ("op,type,item_bytes,depth,variant,runs,min_cycles,"
+                   "mean_cycles,max_cycles\n");
+
+    bench_queue<uint8_t> ("uint8_t", 1);
+    bench_queue<uint8_t> ("uint8_t", 16);
+    bench_queue<uint8_t> ("uint8_t", 640);
+    bench_queue<float> ("float", 1);
+    bench_queue<float> ("float", 16);
+    bench_queue<float> ("float", 640);
+    bench_queue<Bench16> ("Bench16", 1);
+    bench_queue<Bench16> ("Bench16", 16);
+    bench_queue<Bench64> ("Bench64", 1);
+    bench_queue<Bench64> ("Bench64", 16);
+    bench_queue_wake ();
+
+    bench_share<uint8_t> ("uint8_t");
+    bench_share<float> ("float");
+    bench_share<Bench16> ("Bench16");
+    bench_share<Bench64> ("Bench64");
+    bench_seqshare<Bench16> ("Bench16");
+    bench_seqshare<Bench64> ("Bench64");
+
+    // The rival only starts now so it doesn't disturb the other cases
+    xTaskCreate (task_bench_rival, "Rival", 256, NULL, 2, NULL);
+    bench_share_fight ();
+    rival_on = false;
+
+    bench_share_list ();
+    bench_share_stats ();
+
+    #if (defined STM32L4xx || defined STM32F4xx)
+        bench_latency ();
+    #endif
+
+    Serial.println ("done");
+    bench_over = true;
+    for (;;)
+    {
+        vTaskDelay (1000);
+    }
+}
+
+
+void setup ()
+{
+    Serial.begin (115200);
+    delay (100);
+
+    p_wake_queue = new Queue<uint8_t> (1, "Bench wake");
+    p_fight_share = new Share<uint8_t> ("Bench rival");
+
+    xTaskCreate (task_bench, "Bench", 1024, NULL, 2, NULL);
+    xTaskCreate (task_bench_reader, "Reader", 256, NULL, 3, NULL);
+
+    #if (defined STM32L4xx || defined STM32F4xx)
+        vTaskStartScheduler ();
+    #endif
+}
+
+
+void loop ()
+{
+}
+
+
+#if !(defined STM32L4xx || defined STM32F4xx)
+
+#include "host.h"
+
+/** @brief   Tell the simulated kernel when the benchmarks are done.
+ */
+static bool bench_done (void)
+{
+    return (bench_over);
+}
+
+/** @brief   Run the benchmarks on the simulator's kernel.
+ */
+int main (void)
+{
+    Serial.enabled = true;
+    setup ();
+    host_run (bench_done);
+    return (0);
+}
+
+#endif
@@ -0,0 +1,21 @@
+/** @file Adafruit_AMG88xx.h
+ *      This file is a host stand-in for the Adafruit AMG88xx thermal camera
+ *      library. Frames are rendered from the simulated scene.
+ */
+
+#ifndef _HOST_AMG88XX_H_
+#define _HOST_AMG88XX_H_
+
+#include "Arduino.h"
+
+#define AMG88xx_PIXEL_ARRAY_SIZE 64
+
+class Adafruit_AMG88xx
+{
+    public:
+        bool begin (uint8_t addr = 0x69);
+        void readPixels (float* p_buf, uint8_t size = AMG88xx_PIXEL_ARRAY_SIZE);
+        float readThermistor (void);
+};
+
+#endif // _HOST_AMG88XX_H_
@@ -0,0 +1,37 @@
+/** @file Adafruit_VL53L0X.h
+ *      This file is a host stand-in for the Adafruit VL53L0X time of flight
+ *      sensor library. Ranges are measured in the simulated scene.
+ */
+
+#ifndef _HOST_VL53L0X_H_
+#define _HOST_VL53L0X_H_
+
+#include "Arduino.h"
+#include "Wire.h"
+
+#define VL53L0X_I2C_ADDR 0x29
+
+class Adafruit_VL53L0X
+{
+    protected:
+        uint8_t range_status = 0;
+
+    public:
+        typedef enum
+        {
+            VL53L0X_SENSE_DEFAULT = 0,
+            VL53L0X_SENSE_LONG_RANGE,
+            VL53L0X_SENSE_HIGH_SPEED,
+            VL53L0X_SENSE_HIGH_ACCURACY
+        } VL53L0X_Sense_config_t;
+
+        bool begin (uint8_t i2c_addr = VL53L0X_I2C_ADDR, bool debug = false,
+                    TwoWire* i2c = &Wire,
+                    VL53L0X_Sense_config_t vl_config = VL53L0X_SENSE_DEFAULT);
+        bool startRangeContinuous (uint16_t period_ms = 50);
+        bool isRangeComplete (void);
+        uint16_t readRangeResult (void);
+        uint8_t readRangeStatus (void) { return range_status; }
+};
+
+#endif // _HOST_VL53L0X_H_
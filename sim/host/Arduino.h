@@ -0,0 +1,118 @@
+/** @file Arduino.h
+ *      This file is a host stand-in for the parts of the Arduino core which the
+ *      Scroomba tasks use, so they can be compiled and run in the simulator.
+ *
+ *  @details Pins, PWM and time are routed to the simulated world and the
+ *           simulated kernel rather than to hardware. Only what the firmware
+ *           actually calls is provided.
+ */
+
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define RISING 0x1
+#define FALLING 0x2
+#define CHANGE 0x3
+
+#define DEC 10
+#define HEX 16
+
+/// Nucleo-64 Arduino header pin numbers, in the same order as the STM32 core
+enum HostPin
+{
+    D0, D1, D2, D3, D4, D5, D6, D7, D8, D9, D10, D11, D12, D13, D14, D15,
+    A0, A1, A2, A3, A4, A5,
+    HOST_NUM_PINS
+};
+
+/** @brief   Minimal version of the Arduino @c Print class.
+ *  @details Descendents override @c write(); everything else is built on it.
+ */
+class Print
+{
+    public:
+        virtual ~Print (void) { }
+        virtual size_t write (uint8_t c) = 0;
+        size_t write (const uint8_t* p_buf, size_t size);
+        size_t write (const char* p_str);
+
+        size_t print (const char* p_str);
+        size_t print (char c);
+        size_t print (int value, int base = DEC);
+        size_t print (unsigned int value, int base = DEC);
+        size_t print (long value, int base = DEC);
+        size_t print (unsigned long value, int base = DEC);
+        size_t print (double value, int digits = 2);
+
+        size_t println (void);
+        template <class T> size_t println (T value)
+        {
+            size_t n = print (value);
+            return (n + println ());
+        }
+
+        size_t printf (const char* format, ...)
+            __attribute__ ((format (printf, 2, 3)));
+};
+
+/** @brief   Host serial port which writes to standard output.
+ *  @details Output can be turned off so benchmark runs aren't cluttered by
+ *           the firmware's debugging messages.
+ */
+class HardwareSerial : public Print
+{
+    public:
+        bool enabled = false;                   ///< Copy output to stdout
+
+        void begin (unsigned long) { }
+        void flush (void) { }
+        int available (void) { return 0; }
+        int read (void) { return -1; }
+        int availableForWrite (void) { return 64; }
+        operator bool (void) { return true; }
+        size_t write (uint8_t c);
+        using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+void pinMode (uint32_t pin, uint32_t mode);
+void digitalWrite (uint32_t pin, uint32_t value);
+int digitalRead (uint32_t pin);
+void analogWrite (uint32_t pin, uint32_t value);
+uint32_t millis (void);
+uint32_t micros (void);
+void delay (uint32_t ms);
+void delayMicroseconds (uint32_t us);
+void attachInterrupt (uint32_t pin, void (*p_isr) (void), uint32_t mode);
+
+/// Interrupts are attached by pin number, as on the STM32 core
+#define digitalPinToInterrupt(pin) (pin)
+
+/** @brief   Limit a value to a range, as the Arduino macro does.
+ */
+template <class T> T constrain (T x, T low, T high)
+{
+    return (x < low ? low : (x > high ? high : x));
+}
+
+#endif // _HOST_ARDUINO_H_
@@ -0,0 +1,98 @@
+/** @file FreeRTOS.h
+ *      This file is a host stand-in for the parts of FreeRTOS which the
+ *      Scroomba tasks use, so they can run in the simulator.
+ *
+ *  @details The simulated kernel runs every task on one host thread, switching
+ *           between them the way a single-core FreeRTOS does: a task runs until
+ *           it delays, blocks on a queue or event group, or uses up its time
+ *           slice. Time is
+ *           virtual; each kernel and Arduino call uses a little of it, so a
+ *           task which polls in a loop still lets the clock move on.
+ */
+
+#ifndef _HOST_FREERTOS_H_
+#define _HOST_FREERTOS_H_
+
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define portBASE_TYPE long
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+#define portTICK_PERIOD_MS ((TickType_t)1)
+#define configTICK_RATE_HZ ((TickType_t)1000)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+struct HostQueue;
+struct HostTask;
+typedef HostQueue* QueueHandle_t;
+typedef HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t) (void*);
+
+// An event group is simulated as a one-item queue which holds its bits
+typedef HostQueue* EventGroupHandle_t;
+typedef TickType_t EventBits_t;
+
+// A mutex is simulated as a one-item queue which holds the token while free
+typedef HostQueue* SemaphoreHandle_t;
+
+QueueHandle_t xQueueCreate (UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSendToBack (QueueHandle_t queue, const void* p_item,
+                             TickType_t wait);
+BaseType_t xQueueSendToFront (QueueHandle_t queue, const void* p_item,
+                              TickType_t wait);
+BaseType_t xQueueSendToBackFromISR (QueueHandle_t queue, const void* p_item,
+                                    BaseType_t* p_woken);
+BaseType_t xQueueSendToFrontFromISR (QueueHandle_t queue, const void* p_item,
+                                     BaseType_t* p_woken);
+BaseType_t xQueueOverwrite (QueueHandle_t queue, const void* p_item);
+BaseType_t xQueueReceive (QueueHandle_t queue, void* p_item, TickType_t wait);
+BaseType_t xQueueReceiveFromISR (QueueHandle_t queue, void* p_item,
+                                 BaseType_t* p_woken);
+BaseType_t xQueuePeek (QueueHandle_t queue, void* p_item, TickType_t wait);
+BaseType_t xQueuePeekFromISR (QueueHandle_t queue, void* p_item);
+UBaseType_t uxQueueMessagesWaiting (QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaitingFromISR (QueueHandle_t queue);
+UBaseType_t uxQueueSpacesAvailable (QueueHandle_t queue);
+
+SemaphoreHandle_t xSemaphoreCreateMutex (void);
+BaseType_t xSemaphoreTake (SemaphoreHandle_t mutex, TickType_t wait);
+BaseType_t xSemaphoreGive (SemaphoreHandle_t mutex);
+
+EventGroupHandle_t xEventGroupCreate (void);
+EventBits_t xEventGroupSetBits (EventGroupHandle_t group, EventBits_t bits);
+BaseType_t xEventGroupSetBitsFromISR (EventGroupHandle_t group, EventBits_t bits,
+                                      BaseType_t* p_woken);
+EventBits_t xEventGroupClearBits (EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits (EventGroupHandle_t group);
+EventBits_t xEventGroupGetBitsFromISR (EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits (EventGroupHandle_t group, EventBits_t bits,
+                                 BaseType_t clear, BaseType_t all,
+                                 TickType_t wait);
+
+BaseType_t xTaskCreate (TaskFunction_t function, const char* p_name,
+                        uint16_t stack_words, void* p_params,
+                        UBaseType_t priority, TaskHandle_t* p_handle);
+void vTaskDelay (TickType_t ticks);
+TickType_t xTaskGetTickCount (void);
+TickType_t xTaskGetTickCountFromISR (void);
+TaskHandle_t xTaskGetCurrentTaskHandle (void);
+const char* pcTaskGetName (TaskHandle_t task);
+void taskYIELD (void);
+
+void portENTER_CRITICAL (void);
+void portEXIT_CRITICAL (void);
+// The simulated kernel has no interrupts to mask
+#define portSET_INTERRUPT_MASK_FROM_ISR() ((UBaseType_t)0)
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(mask) ((void)(mask))
+
+#define portYIELD_FROM_ISR(woken) (void)(woken)
+
+#endif // _HOST_FREERTOS_H_
@@ -0,0 +1,26 @@
+/** @file PrintStream.h
+ *      This file is a host stand-in for the Arduino PrintStream library, which
+ *      lets the tasks write to a @c Print device with @c << as in C++.
+ */
+
+#ifndef _HOST_PRINTSTREAM_H_
+#define _HOST_PRINTSTREAM_H_
+
+#include "Arduino.h"
+
+/// Stand-in for the library's end-of-line manipulator
+enum HostEndl { endl };
+
+inline Print& operator << (Print& printer, HostEndl)
+{
+    printer.println ();
+    return (printer);
+}
+
+template <class T> Print& operator << (Print& printer, const T& value)
+{
+    printer.print (value);
+    return (printer);
+}
+
+#endif // _HOST_PRINTSTREAM_H_
@@ -0,0 +1,6 @@
+/** @file STM32FreeRTOS.h
+ *      This file is a host stand-in for the STM32 FreeRTOS library header,
+ *      which just brings in the simulated kernel.
+ */
+
+#include "FreeRTOS.h"
@@ -0,0 +1,20 @@
+/** @file Wire.h
+ *      This file is a host stand-in for the Arduino I2C library. The simulated
+ *      sensors don't need a bus, so it does nothing.
+ */
+
+#ifndef _HOST_WIRE_H_
+#define _HOST_WIRE_H_
+
+#include <stdint.h>
+
+class TwoWire
+{
+    public:
+        void begin (void) { }
+        void setClock (uint32_t) { }
+};
+
+extern TwoWire Wire;
+
+#endif // _HOST_WIRE_H_
@@ -0,0 +1,73 @@
+/** @file host.h
+ *      This file contains the interface between the simulated kernel, the
+ *      simulated Arduino core, and the simulated world which drives them.
+ *
+ *  @brief Control of the simulator's virtual clock and scheduler, and the hooks the world provides.
+ */
+
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <stdint.h>
+#include "FreeRTOS.h"
+
+/// Virtual CPU time, in microseconds, used by each kernel or Arduino call
+const uint32_t HOST_CALL_US = 1;
+
+// Get the virtual time in microseconds since the simulated power-up
+uint64_t host_now_us (void);
+
+// Use up some virtual CPU time in the running task, which may be preempted
+void host_spend_us (uint32_t us);
+
+// Choose between skipping idle time and simulating every tick
+void host_event_mode (bool on);
+
+// Run the simulated tasks until the given function returns true
+void host_run (bool (*p_done) (void));
+
+// Count of task switches made by the simulated scheduler
+uint32_t host_switches (void);
+
+// Start a timer which runs an interrupt every so many microseconds
+void host_timer_start (uint32_t period_us, void (*p_isr) (void));
+
+// Run an interrupt service routine as an interrupt, outside any task's time
+void host_interrupt (void (*p_isr) (void));
+
+// Run the interrupt attached to a pin if it is attached for this edge
+void host_pin_edge (uint32_t pin, uint32_t edge);
+
+// Find a queue which a task has waited this long to put an item into
+QueueHandle_t host_stuck_sender (uint64_t for_us);
+
+// --- Hooks which the simulated world must provide ---
+
+// Set a pin's output level or PWM duty, 0 to 255
+void world_pin_write (uint32_t pin, uint32_t duty);
+
+// Read a pin's input level
+int world_pin_read (uint32_t pin);
+
+// Render a thermal camera frame of 64 temperatures in degrees C
+void world_thermal_frame (float* p_pixels);
+
+// Get the thermal camera board temperature in degrees C
+float world_thermistor (void);
+
+// Start the ToF sensor ranging back to back, one range every period
+void world_tof_start (uint32_t period_ms);
+
+// Check whether the ToF sensor has a new range ready
+bool world_tof_ready (void);
+
+// Take the ToF sensor's newest range in mm and its status, 0 if valid
+uint16_t world_tof_read (uint8_t* p_status);
+
+// Get a track's encoder count, 0 left or 1 right, wrapping at 16 bits
+uint16_t world_encoder_count (uint8_t track);
+
+// Take bytes sent out of the telemetry port
+void world_telemetry (const uint8_t* p_data, size_t length);
+
+#endif // _HOST_H_
@@ -0,0 +1,325 @@
+/** @file host_arduino.cpp
+ *      This file contains the host versions of the Arduino core functions and
+ *      the thermal camera and time of flight sensor libraries used by the
+ *      Scroomba tasks.
+ *
+ *  @details Pin writes and reads go to the simulated world, time comes from
+ *           the simulated kernel's virtual clock, and serial output goes to
+ *           standard output when it's turned on. Each call uses a little
+ *           virtual time so that polling loops behave as they do on the
+ *           real processor.
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include "Arduino.h"
+#include "Adafruit_AMG88xx.h"
+#include "Adafruit_VL53L0X.h"
+#include "host.h"
+
+/// Virtual time taken to read a frame over I2C at 400 kHz
+const uint32_t HOST_AMG_FRAME_US = 3000;
+
+/// Virtual time taken to read the AMG88xx thermistor over I2C
+const uint32_t HOST_AMG_THERM_US = 100;
+
+/// Virtual time taken by one short I2C transfer with the VL53L0X
+const uint32_t HOST_TOF_I2C_US = 100;
+
+HardwareSerial Serial;                  ///< The simulated serial port
+TwoWire Wire;                           ///< The simulated I2C bus
+
+/// Interrupt attached to each pin, if any, and the edges which run it
+static void (*pin_isrs[HOST_NUM_PINS]) (void);
+static uint32_t pin_isr_modes[HOST_NUM_PINS];
+
+
+size_t Print::write (const uint8_t* p_buf, size_t size)
+{
+    for (size_t n = 0; n < size; n++)
+    {
+        write (p_buf[n]);
+    }
+    return (size);
+}
+
+
+size_t Print::write (const char* p_str)
+{
+    return (write ((const uint8_t*)p_str, strlen (p_str)));
+}
+
+
+size_t Print::print (const char* p_str)
+{
+    return (write (p_str));
+}
+
+
+size_t Print::print (char c)
+{
+    return (write ((uint8_t)c));
+}
+
+
+size_t Print::print (int value, int base)
+{
+    return (print ((long)value, base));
+}
+
+
+size_t Print::print (unsigned int value, int base)
+{
+    return (print ((unsigned long)value, base));
+}
+
+
+size_t Print::print (long value, int base)
+{
+    return (base == DEC ? printf ("%ld", value) : printf ("%lx", value));
+}
+
+
+size_t Print::print (unsigned long value, int base)
+{
+    return (base == DEC ? printf ("%lu", value) : printf ("%lx", value));
+}
+
+
+size_t Print::print (double value, int digits)
+{
+    return (printf ("%.*f", digits, value));
+}
+
+
+size_t Print::println (void)
+{
+    return (write ("\r\n"));
+}
+
+
+size_t Print::printf (const char* format, ...)
+{
+    char buffer[256];
+    va_list args;
+
+    va_start (args, format);
+    vsnprintf (buffer, sizeof (buffer), format, args);
+    va_end (args);
+
+    return (write (buffer));
+}
+
+
+size_t HardwareSerial::write (uint8_t c)
+{
+    if (enabled)
+    {
+        putchar (c);
+    }
+    return (1);
+}
+
+
+void pinMode (uint32_t pin, uint32_t mode)
+{
+    (void)pin;
+    (void)mode;
+    host_spend_us (HOST_CALL_US);
+}
+
+
+void digitalWrite (uint32_t pin, uint32_t value)
+{
+    host_spend_us (HOST_CALL_US);
+    world_pin_write (pin, value ? 255 : 0);
+}
+
+
+int digitalRead (uint32_t pin)
+{
+    host_spend_us (HOST_CALL_US);
+    return (world_pin_read (pin));
+}
+
+
+void attachInterrupt (uint32_t pin, void (*p_isr) (void), uint32_t mode)
+{
+    host_spend_us (HOST_CALL_US);
+    pin_isrs[pin] = p_isr;
+    pin_isr_modes[pin] = mode;
+}
+
+
+/** @brief   Run the interrupt attached to a pin if it is attached for this
+ *           edge.
+ *  @details The simulated world calls this when a sensor changes the level
+ *           of its interrupt pin. The interrupt runs at once, in the middle of
+ *           whichever task touched the world, as it would on the processor.
+ *  @param   pin The pin whose level changed
+ *  @param   edge @c RISING or @c FALLING
+ */
+void host_pin_edge (uint32_t pin, uint32_t edge)
+{
+    if (pin_isrs[pin] != NULL
+        && (pin_isr_modes[pin] == edge || pin_isr_modes[pin] == CHANGE))
+    {
+        host_interrupt (pin_isrs[pin]);
+    }
+}
+
+
+void analogWrite (uint32_t pin, uint32_t value)
+{
+    host_spend_us (HOST_CALL_US);
+    world_pin_write (pin, value);
+}
+
+
+uint32_t millis (void)
+{
+    host_spend_us (HOST_CALL_US);
+    return ((uint32_t)(host_now_us () / 1000));
+}
+
+
+uint32_t micros (void)
+{
+    host_spend_us (HOST_CALL_US);
+    return ((uint32_t)host_now_us ());
+}
+
+
+void delay (uint32_t ms)
+{
+    host_spend_us (ms * 1000);
+}
+
+
+void delayMicroseconds (uint32_t us)
+{
+    host_spend_us (us);
+}
+
+
+bool Adafruit_AMG88xx::begin (uint8_t addr)
+{
+    (void)addr;
+    host_spend_us (HOST_AMG_THERM_US);
+    return (true);
+}
+
+
+void Adafruit_AMG88xx::readPixels (float* p_buf, uint8_t size)
+{
+    float frame[AMG88xx_PIXEL_ARRAY_SIZE];
+
+    host_spend_us (HOST_AMG_FRAME_US);
+    world_thermal_frame (frame);
+    memcpy (p_buf, frame, min (size, (uint8_t)AMG88xx_PIXEL_ARRAY_SIZE) * sizeof (float));
+}
+
+
+float Adafruit_AMG88xx::readThermistor (void)
+{
+    host_spend_us (HOST_AMG_THERM_US);
+    return (world_thermistor ());
+}
+
+
+bool Adafruit_VL53L0X::begin (uint8_t i2c_addr, bool debug, TwoWire* i2c,
+                              VL53L0X_Sense_config_t vl_config)
+{
+    (void)i2c_addr;
+    (void)debug;
+    (void)i2c;
+    (void)vl_config;
+    host_spend_us (HOST_TOF_I2C_US);
+    return (true);
+}
+
+
+bool Adafruit_VL53L0X::startRangeContinuous (uint16_t period_ms)
+{
+    host_spend_us (HOST_TOF_I2C_US);
+    world_tof_start (period_ms);
+    return (true);
+}
+
+
+bool Adafruit_VL53L0X::isRangeComplete (void)
+{
+    host_spend_us (HOST_TOF_I2C_US);
+    return (world_tof_ready ());
+}
+
+
+uint16_t Adafruit_VL53L0X::readRangeResult (void)
+{
+    host_spend_us (HOST_TOF_I2C_US);
+    uint16_t range = world_tof_read (&range_status);
+    return (range_status == 4 ? 0xFFFF : range);
+}
+
+
+// Programs with no simulated world, such as the benchmarks, get these empty
+// hooks; the simulator's world replaces them
+
+__attribute__ ((weak)) void world_pin_write (uint32_t pin, uint32_t duty)
+{
+    (void)pin;
+    (void)duty;
+}
+
+
+__attribute__ ((weak)) int world_pin_read (uint32_t pin)
+{
+    (void)pin;
+    return (LOW);
+}
+
+
+__attribute__ ((weak)) void world_thermal_frame (float* p_pixels)
+{
+    memset (p_pixels, 0, AMG88xx_PIXEL_ARRAY_SIZE * sizeof (float));
+}
+
+
+__attribute__ ((weak)) float world_thermistor (void)
+{
+    return (0);
+}
+
+
+__attribute__ ((weak)) void world_telemetry (const uint8_t* p_data,
+                                              size_t length)
+{
+    (void)p_data;
+    (void)length;
+}
+
+
+__attribute__ ((weak)) void world_tof_start (uint32_t period_ms)
+{
+    (void)period_ms;
+}
+
+
+__attribute__ ((weak)) bool world_tof_ready (void)
+{
+    return (false);
+}
+
+
+__attribute__ ((weak)) uint16_t world_tof_read (uint8_t* p_status)
+{
+    *p_status = 4;
+    return (0xFFFF);
+}
+
+
+__attribute__ ((weak)) uint16_t world_encoder_count (uint8_t track)
+{
+    (void)track;
+    return (0);
+}
@@ -0,0 +1,893 @@
+/** @file host_rtos.cpp
+ *      This file contains a small simulated FreeRTOS kernel which runs the
+ *      Scroomba tasks on a virtual clock on the host computer.
+ *
+ *  @details Each task gets its own stack and runs as a coroutine on the one
+ *           host thread, so only one task is ever running and the results are
+ *           the same on every run. Tasks are switched the way FreeRTOS does it
+ *           on a single core: the highest priority ready task runs, tasks of
+ *           equal priority take turns at each 1 ms tick, and a task gives up
+ *           the processor when it delays or blocks on a queue. Every kernel or
+ *           Arduino call uses up @c HOST_CALL_US of virtual time, which is how
+ *           a task that polls a queue in a loop eventually reaches the end of
+ *           its time slice.
+ *
+ *           In event mode, which is the default, the clock never ticks through
+ *           time in which nothing can happen. A task which keeps polling
+ *           queues which nobody has changed is parked until some task changes
+ *           a queue, since on the real processor it would just be burning its
+ *           time slices. When no task is ready, the clock jumps straight to
+ *           the next delay or timeout to end. A whole encounter then takes a
+ *           few milliseconds of wall time. In tick mode every tick is
+ *           simulated and polling tasks really do use up their time slices,
+ *           which is slower but closer to the real timing.
+ *
+ *           Timer interrupts run at their exact times as the clock passes
+ *           them, in whichever task is running or while the kernel is idle,
+ *           and use no virtual time. One due while a task is in a critical
+ *           section runs as soon as the clock moves on afterward.
+ */
+
+#include <ucontext.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "FreeRTOS.h"
+#include "host.h"
+
+/// Bytes of host stack for each task; host calls need far more than the target
+const size_t HOST_STACK_BYTES = 256 * 1024;
+
+/// Never wake up because of a timeout
+const uint64_t HOST_FOREVER = UINT64_MAX;
+
+/// Polls in a row which find nothing changed before a task is parked
+const uint16_t HOST_SPIN_POLLS = 8;
+
+
+/** @brief   A simulated FreeRTOS queue, kept as a ring buffer of bytes.
+ */
+struct HostQueue
+{
+    UBaseType_t length;                 ///< Number of items it can hold
+    UBaseType_t item_size;              ///< Bytes in each item
+    UBaseType_t head;                   ///< Index of the oldest item
+    UBaseType_t count;                  ///< Number of items held
+    uint32_t changes;                   ///< Bumped whenever items move
+    std::vector<uint8_t> storage;       ///< Room for all the items
+};
+
+
+/** @brief   A simulated hardware timer which runs an interrupt periodically.
+ */
+struct HostTimer
+{
+    uint64_t period_us;                 ///< Time between interrupts
+    uint64_t next_us;                   ///< Time of the next interrupt
+    void (*p_isr) (void);               ///< The interrupt service routine
+};
+
+
+/** @brief   A simulated FreeRTOS task.
+ */
+struct HostTask
+{
+    ucontext_t context;                 ///< Saved registers when not running
+    std::vector<uint8_t> stack;         ///< The task's own stack
+    TaskFunction_t function;            ///< The task function
+    void* p_params;                     ///< Parameter for the task function
+    const char* p_name;                 ///< Name given when created
+    UBaseType_t priority;               ///< Higher numbers run first
+    uint64_t wake_us;                   ///< Time a delay or timeout ends
+    HostQueue* p_waiting;               ///< Queue being waited on, if any
+    uint32_t seen_changes;              ///< Queue's changes count when blocked
+    bool spinning;                      ///< Parked until anything changes
+    uint32_t seen_all;                  ///< All changes count at last poll
+    uint32_t poll_call;                 ///< Call count at last poll
+    uint16_t idle_polls;                ///< Polls in a row finding no change
+    uint64_t send_since_us;             ///< Time it began waiting for room in a queue
+    bool finished;                      ///< The task function returned
+};
+
+
+static std::vector<HostTask*> tasks;    ///< All tasks in order of creation
+static HostTask* p_current = NULL;      ///< Task now running, if any
+static size_t last_run = 0;             ///< Index of the task which ran last
+static ucontext_t scheduler_context;    ///< Where tasks switch back to
+static uint64_t now_us = 0;             ///< The virtual clock
+static uint64_t slice_end_us = 0;       ///< When the running task's turn ends
+static uint32_t critical_nesting = 0;   ///< Depth of critical sections
+static uint32_t switches = 0;           ///< Count of task switches
+static uint32_t all_changes = 0;        ///< Bumped when anything may change
+static uint32_t calls = 0;              ///< Count of kernel and Arduino calls
+static bool event_mode = true;          ///< Skip time in which nothing happens
+static std::vector<HostTimer> timers;   ///< All timer interrupts
+static bool in_isr = false;             ///< A timer interrupt is running
+
+
+/** @brief   Choose between event mode and tick mode.
+ *  @details This must be called before @c host_run().
+ *  @param   on @c true for event mode, @c false to simulate every tick
+ */
+void host_event_mode (bool on)
+{
+    event_mode = on;
+}
+
+
+/** @brief   Get the virtual time since the simulated power-up.
+ *  @return  The time in microseconds
+ */
+uint64_t host_now_us (void)
+{
+    return (now_us);
+}
+
+
+/** @brief   Get the number of times the scheduler has switched tasks.
+ *  @return  The number of task switches so far
+ */
+uint32_t host_switches (void)
+{
+    return (switches);
+}
+
+
+/** @brief   Start a timer which runs an interrupt periodically.
+ *  @param   period_us Time between interrupts, in microseconds
+ *  @param   p_isr The interrupt service routine
+ */
+void host_timer_start (uint32_t period_us, void (*p_isr) (void))
+{
+    timers.push_back ({period_us, now_us + period_us, p_isr});
+}
+
+
+/** @brief   Run an interrupt service routine as an interrupt.
+ *  @details While it runs, kernel and Arduino calls use no virtual time and
+ *           never switch tasks, as for the timer interrupts.
+ *  @param   p_isr The interrupt service routine
+ */
+void host_interrupt (void (*p_isr) (void))
+{
+    bool was_in_isr = in_isr;
+    in_isr = true;
+    p_isr ();
+    in_isr = was_in_isr;
+}
+
+
+/** @brief   Find a queue which a task has been waiting a long time to put
+ *           an item into.
+ *  @details A task which waits forever for room in a queue that nothing is
+ *           going to empty never runs again, but nothing else in the kernel
+ *           notices; this lets a test find it.
+ *  @param   for_us How long the task must have been waiting, in microseconds
+ *  @return  The full queue, or @c NULL if no task has waited that long
+ */
+QueueHandle_t host_stuck_sender (uint64_t for_us)
+{
+    for (HostTask* p_task : tasks)
+    {
+        if (p_task->send_since_us != HOST_FOREVER
+            && now_us - p_task->send_since_us >= for_us)
+        {
+            return (p_task->p_waiting);
+        }
+    }
+    return (NULL);
+}
+
+
+/** @brief   Move the clock forward, running each timer interrupt which comes
+ *           due on the way at its own time.
+ *  @param   time_us The time to move the clock to
+ */
+static void host_clock_to (uint64_t time_us)
+{
+    while (critical_nesting == 0 && !in_isr)
+    {
+        HostTimer* p_due = NULL;
+        for (HostTimer& timer : timers)
+        {
+            if (timer.next_us <= time_us
+                && (p_due == NULL || timer.next_us < p_due->next_us))
+            {
+                p_due = &timer;
+            }
+        }
+        if (p_due == NULL)
+        {
+            break;
+        }
+
+        // One held off by a critical section runs late, but never earlier
+        // than the clock already is
+        now_us = std::max (now_us, p_due->next_us);
+        p_due->next_us += p_due->period_us;
+        in_isr = true;
+        p_due->p_isr ();
+        in_isr = false;
+    }
+    now_us = std::max (now_us, time_us);
+}
+
+
+/** @brief   Give the processor back to the scheduler.
+ */
+static void host_switch_out (void)
+{
+    HostTask* p_task = p_current;
+    swapcontext (&p_task->context, &scheduler_context);
+    p_current = p_task;
+}
+
+
+/** @brief   Use up virtual CPU time in the running task.
+ *  @details If the task's time slice runs out part way through, the task is
+ *           preempted and the rest of the time is used when it runs again.
+ *           Time used outside a task, such as in @c setup(), just moves the
+ *           clock on.
+ *  @param   us The number of microseconds to use
+ */
+void host_spend_us (uint32_t us)
+{
+    calls++;
+    if (in_isr)
+    {
+        return;
+    }
+    if (p_current == NULL)
+    {
+        host_clock_to (now_us + us);
+        return;
+    }
+
+    for (;;)
+    {
+        uint64_t step = slice_end_us > now_us ? slice_end_us - now_us : 0;
+        if (step > us || critical_nesting > 0)
+        {
+            step = us;
+        }
+        host_clock_to (now_us + step);
+        us -= step;
+
+        if (now_us >= slice_end_us && critical_nesting == 0)
+        {
+            host_switch_out ();
+        }
+        if (us == 0)
+        {
+            return;
+        }
+    }
+}
+
+
+/** @brief   Check whether a task is able to run.
+ *  @param   p_task Pointer to the task to check
+ *  @return  @c true if the task may run now
+ */
+static bool host_ready (HostTask* p_task)
+{
+    if (p_task->finished)
+    {
+        return (false);
+    }
+    if (p_task->p_waiting != NULL
+        && p_task->p_waiting->changes != p_task->seen_changes)
+    {
+        return (true);
+    }
+    if (p_task->spinning)
+    {
+        return (all_changes != p_task->seen_all);
+    }
+    return (now_us >= p_task->wake_us);
+}
+
+
+/** @brief   Choose the next task to run.
+ *  @details The ready task with the highest priority runs; ties go to the
+ *           first one after the task which ran last, so equal tasks take
+ *           turns.
+ *  @return  Pointer to the task to run, or @c NULL if none are ready
+ */
+static HostTask* host_pick (void)
+{
+    HostTask* p_best = NULL;
+    size_t best_index = 0;
+
+    for (size_t n = 1; n <= tasks.size (); n++)
+    {
+        size_t index = (last_run + n) % tasks.size ();
+        HostTask* p_task = tasks[index];
+        if (host_ready (p_task)
+            && (p_best == NULL || p_task->priority > p_best->priority))
+        {
+            p_best = p_task;
+            best_index = index;
+        }
+    }
+    last_run = best_index;
+    return (p_best);
+}
+
+
+/** @brief   Run the simulated tasks until told to stop.
+ *  @param   p_done Function which returns @c true when the run is over; it
+ *           is checked every time a task gives up the processor
+ */
+void host_run (bool (*p_done) (void))
+{
+    while (!p_done ())
+    {
+        HostTask* p_next = host_pick ();
+        if (p_next == NULL)
+        {
+            // Nothing to do, so idle until the next tick or, in event mode,
+            // until the next delay or timeout runs out
+            uint64_t next_us = (now_us / 1000 + 1) * 1000;
+            if (event_mode)
+            {
+                uint64_t soonest = HOST_FOREVER;
+                for (HostTask* p_task : tasks)
+                {
+                    if (!p_task->finished && !p_task->spinning)
+                    {
+                        soonest = std::min (soonest, p_task->wake_us);
+                    }
+                }
+                next_us = (soonest == HOST_FOREVER) ? next_us : soonest;
+            }
+            host_clock_to (next_us);
+            continue;
+        }
+
+        p_current = p_next;
+        slice_end_us = (now_us / 1000 + 1) * 1000;
+        switches++;
+        swapcontext (&scheduler_context, &p_next->context);
+        p_current = NULL;
+    }
+}
+
+
+/** @brief   Note that the running task has looked at a queue without
+ *           changing anything.
+ *  @details In event mode, a task which does nothing but look at queues which
+ *           aren't changing is parked until anything changes. Any other call
+ *           in between, such as reading the time or a pin, means the task
+ *           might be waiting for something the kernel can't see, so it isn't
+ *           parked.
+ */
+static void host_poll (void)
+{
+    if (!event_mode || p_current == NULL || in_isr)
+    {
+        return;
+    }
+
+    if (calls == p_current->poll_call + 1
+        && all_changes == p_current->seen_all)
+    {
+        p_current->idle_polls++;
+    }
+    else
+    {
+        p_current->idle_polls = 0;
+        p_current->seen_all = all_changes;
+    }
+    p_current->poll_call = calls;
+
+    if (p_current->idle_polls >= HOST_SPIN_POLLS && critical_nesting == 0)
+    {
+        p_current->spinning = true;
+        host_switch_out ();
+        p_current->spinning = false;
+        p_current->idle_polls = 0;
+        p_current->seen_all = all_changes;
+    }
+}
+
+
+/** @brief   Wait until a queue changes or a time limit passes.
+ *  @param   p_queue The queue to wait on
+ *  @param   deadline_us The time at which to give up
+ *  @return  @c true if it's worth checking the queue again, @c false if the
+ *           time limit has passed or the caller isn't a task
+ */
+static bool host_block (HostQueue* p_queue, uint64_t deadline_us)
+{
+    if (p_current == NULL || now_us >= deadline_us)
+    {
+        return (false);
+    }
+
+    p_current->p_waiting = p_queue;
+    p_current->seen_changes = p_queue->changes;
+    p_current->wake_us = deadline_us;
+    host_switch_out ();
+    p_current->p_waiting = NULL;
+    p_current->wake_us = 0;
+
+    return (true);
+}
+
+
+/** @brief   Turn a number of ticks to wait into a virtual time to give up.
+ *  @details Like FreeRTOS, and like @c vTaskDelay(), the wait ends on a tick,
+ *           counted from the current one.
+ *  @param   wait Ticks to wait, or @c portMAX_DELAY to wait forever
+ *  @return  The time at which to stop waiting
+ */
+static uint64_t host_deadline (TickType_t wait)
+{
+    return (wait == portMAX_DELAY ? HOST_FOREVER : (now_us / 1000 + wait) * 1000ULL);
+}
+
+
+/** @brief   Task functions start here, on their own stacks.
+ */
+static void host_task_entry (void)
+{
+    p_current->function (p_current->p_params);
+    p_current->finished = true;
+    host_switch_out ();
+}
+
+
+QueueHandle_t xQueueCreate (UBaseType_t length, UBaseType_t item_size)
+{
+    HostQueue* p_queue = new HostQueue;
+    p_queue->length = length;
+    p_queue->item_size = item_size;
+    p_queue->head = 0;
+    p_queue->count = 0;
+    p_queue->changes = 0;
+    p_queue->storage.resize (length * item_size);
+    return (p_queue);
+}
+
+
+/** @brief   Put an item in a queue if there's room, without waiting.
+ *  @param   p_queue The queue
+ *  @param   p_item Pointer to the item to copy in
+ *  @param   front @c true to put the item at the front instead of the back
+ *  @return  @c true if the item was put in
+ */
+static bool host_try_send (HostQueue* p_queue, const void* p_item, bool front)
+{
+    if (p_queue->count >= p_queue->length)
+    {
+        return (false);
+    }
+
+    UBaseType_t slot;
+    if (front)
+    {
+        p_queue->head = (p_queue->head + p_queue->length - 1) % p_queue->length;
+        slot = p_queue->head;
+    }
+    else
+    {
+        slot = (p_queue->head + p_queue->count) % p_queue->length;
+    }
+    memcpy (&p_queue->storage[slot * p_queue->item_size], p_item,
+            p_queue->item_size);
+    p_queue->count++;
+    p_queue->changes++;
+    all_changes++;
+    return (true);
+}
+
+
+/** @brief   Copy the front item out of a queue, if there is one.
+ *  @param   p_queue The queue
+ *  @param   p_item Pointer to where the item is copied
+ *  @param   remove @c true to take the item out, @c false just to look
+ *  @return  @c true if there was an item
+ */
+static bool host_try_receive (HostQueue* p_queue, void* p_item, bool remove)
+{
+    if (p_queue->count == 0)
+    {
+        return (false);
+    }
+
+    memcpy (p_item, &p_queue->storage[p_queue->head * p_queue->item_size],
+            p_queue->item_size);
+    if (remove)
+    {
+        p_queue->head = (p_queue->head + 1) % p_queue->length;
+        p_queue->count--;
+        p_queue->changes++;
+        all_changes++;
+    }
+    return (true);
+}
+
+
+/** @brief   Put an item in a queue, waiting for room if need be.
+ */
+static BaseType_t host_send (QueueHandle_t queue, const void* p_item,
+                             TickType_t wait, bool front)
+{
+    uint64_t deadline = host_deadline (wait);
+
+    host_spend_us (HOST_CALL_US);
+    bool sent = host_try_send (queue, p_item, front);
+    if (!sent && p_current != NULL)
+    {
+        p_current->send_since_us = now_us;
+    }
+    while (!sent && host_block (queue, deadline))
+    {
+        sent = host_try_send (queue, p_item, front);
+    }
+    if (p_current != NULL)
+    {
+        p_current->send_since_us = HOST_FOREVER;
+    }
+    return (sent ? pdTRUE : pdFALSE);
+}
+
+
+/** @brief   Get an item from a queue, waiting for one if need be.
+ */
+static BaseType_t host_receive (QueueHandle_t queue, void* p_item,
+                                TickType_t wait, bool remove)
+{
+    uint64_t deadline = host_deadline (wait);
+
+    host_spend_us (HOST_CALL_US);
+    while (!host_try_receive (queue, p_item, remove))
+    {
+        if (wait == 0)
+        {
+            host_poll ();
+            return (pdFALSE);
+        }
+        if (!host_block (queue, deadline))
+        {
+            return (pdFALSE);
+        }
+    }
+    return (pdTRUE);
+}
+
+
+BaseType_t xQueueSendToBack (QueueHandle_t queue, const void* p_item,
+                             TickType_t wait)
+{
+    return (host_send (queue, p_item, wait, false));
+}
+
+
+BaseType_t xQueueSendToFront (QueueHandle_t queue, const void* p_item,
+                              TickType_t wait)
+{
+    return (host_send (queue, p_item, wait, true));
+}
+
+
+BaseType_t xQueueSendToBackFromISR (QueueHandle_t queue, const void* p_item,
+                                    BaseType_t* p_woken)
+{
+    if (p_woken != NULL)
+    {
+        *p_woken = pdFALSE;
+    }
+    return (host_try_send (queue, p_item, false));
+}
+
+
+BaseType_t xQueueSendToFrontFromISR (QueueHandle_t queue, const void* p_item,
+                                     BaseType_t* p_woken)
+{
+    if (p_woken != NULL)
+    {
+        *p_woken = pdFALSE;
+    }
+    return (host_try_send (queue, p_item, true));
+}
+
+
+BaseType_t xQueueOverwrite (QueueHandle_t queue, const void* p_item)
+{
+    host_spend_us (HOST_CALL_US);
+    queue->count = 0;
+    return (host_try_send (queue, p_item, false));
+}
+
+
+BaseType_t xQueueReceive (QueueHandle_t queue, void* p_item, TickType_t wait)
+{
+    return (host_receive (queue, p_item, wait, true));
+}
+
+
+BaseType_t xQueueReceiveFromISR (QueueHandle_t queue, void* p_item,
+                                 BaseType_t* p_woken)
+{
+    if (p_woken != NULL)
+    {
+        *p_woken = pdFALSE;
+    }
+    return (host_try_receive (queue, p_item, true));
+}
+
+
+BaseType_t xQueuePeek (QueueHandle_t queue, void* p_item, TickType_t wait)
+{
+    return (host_receive (queue, p_item, wait, false));
+}
+
+
+BaseType_t xQueuePeekFromISR (QueueHandle_t queue, void* p_item)
+{
+    return (host_try_receive (queue, p_item, false));
+}
+
+
+UBaseType_t uxQueueMessagesWaiting (QueueHandle_t queue)
+{
+    host_spend_us (HOST_CALL_US);
+    host_poll ();
+    return (queue->count);
+}
+
+
+UBaseType_t uxQueueMessagesWaitingFromISR (QueueHandle_t queue)
+{
+    return (queue->count);
+}
+
+
+UBaseType_t uxQueueSpacesAvailable (QueueHandle_t queue)
+{
+    host_spend_us (HOST_CALL_US);
+    host_poll ();
+    return (queue->length - queue->count);
+}
+
+
+/** @brief   Read the bits of a simulated event group.
+ *  @param   p_group The event group
+ *  @return  Its bits
+ */
+static EventBits_t host_bits (HostQueue* p_group)
+{
+    EventBits_t bits;
+    memcpy (&bits, p_group->storage.data (), sizeof (bits));
+    return (bits);
+}
+
+
+/** @brief   Change the bits of a simulated event group, waking the tasks
+ *           waiting on it if they changed.
+ *  @param   p_group The event group
+ *  @param   bits Its new bits
+ */
+static void host_bits_to (HostQueue* p_group, EventBits_t bits)
+{
+    if (bits != host_bits (p_group))
+    {
+        memcpy (p_group->storage.data (), &bits, sizeof (bits));
+        p_group->changes++;
+        all_changes++;
+    }
+}
+
+
+/** @brief   Create a mutex, free to begin with.
+ *  @details The simulated mutex doesn't raise the priority of the task which
+ *           holds it; the tasks which share one all run at the same priority.
+ */
+SemaphoreHandle_t xSemaphoreCreateMutex (void)
+{
+    uint8_t token = 0;
+    QueueHandle_t mutex = xQueueCreate (1, sizeof (token));
+    host_try_send (mutex, &token, false);
+    return (mutex);
+}
+
+
+BaseType_t xSemaphoreTake (SemaphoreHandle_t mutex, TickType_t wait)
+{
+    uint8_t token;
+    return (host_receive (mutex, &token, wait, true));
+}
+
+
+BaseType_t xSemaphoreGive (SemaphoreHandle_t mutex)
+{
+    uint8_t token = 0;
+    return (host_send (mutex, &token, 0, false));
+}
+
+
+EventGroupHandle_t xEventGroupCreate (void)
+{
+    return (xQueueCreate (1, sizeof (EventBits_t)));
+}
+
+
+EventBits_t xEventGroupSetBits (EventGroupHandle_t group, EventBits_t bits)
+{
+    host_spend_us (HOST_CALL_US);
+    host_bits_to (group, host_bits (group) | bits);
+    return (host_bits (group));
+}
+
+
+/** @brief   Set event group bits from an interrupt.
+ *  @details FreeRTOS has its timer service task set them after the interrupt
+ *           returns; the simulated kernel sets them at once.
+ */
+BaseType_t xEventGroupSetBitsFromISR (EventGroupHandle_t group, EventBits_t bits,
+                                      BaseType_t* p_woken)
+{
+    if (p_woken != NULL)
+    {
+        *p_woken = pdFALSE;
+    }
+    host_bits_to (group, host_bits (group) | bits);
+    return (pdPASS);
+}
+
+
+EventBits_t xEventGroupClearBits (EventGroupHandle_t group, EventBits_t bits)
+{
+    host_spend_us (HOST_CALL_US);
+    EventBits_t were = host_bits (group);
+    host_bits_to (group, were & ~bits);
+    return (were);
+}
+
+
+EventBits_t xEventGroupGetBits (EventGroupHandle_t group)
+{
+    host_spend_us (HOST_CALL_US);
+    host_poll ();
+    return (host_bits (group));
+}
+
+
+EventBits_t xEventGroupGetBitsFromISR (EventGroupHandle_t group)
+{
+    return (host_bits (group));
+}
+
+
+EventBits_t xEventGroupWaitBits (EventGroupHandle_t group, EventBits_t bits,
+                                 BaseType_t clear, BaseType_t all,
+                                 TickType_t wait)
+{
+    uint64_t deadline = host_deadline (wait);
+
+    host_spend_us (HOST_CALL_US);
+    for (;;)
+    {
+        EventBits_t now = host_bits (group);
+        if (all ? (now & bits) == bits : (now & bits) != 0)
+        {
+            if (clear)
+            {
+                host_bits_to (group, now & ~bits);
+            }
+            return (now);
+        }
+        if (wait == 0)
+        {
+            host_poll ();
+            return (now);
+        }
+        if (!host_block (group, deadline))
+        {
+            return (host_bits (group));
+        }
+    }
+}
+
+
+BaseType_t xTaskCreate (TaskFunction_t function, const char* p_name,
+                        uint16_t stack_words, void* p_params,
+                        UBaseType_t priority, TaskHandle_t* p_handle)
+{
+    (void)stack_words;                  // host stacks are all the same size
+
+    HostTask* p_task = new HostTask;
+    p_task->stack.resize (HOST_STACK_BYTES);
+    p_task->function = function;
+    p_task->p_params = p_params;
+    p_task->p_name = p_name;
+    p_task->priority = priority;
+    p_task->wake_us = 0;
+    p_task->p_waiting = NULL;
+    p_task->seen_changes = 0;
+    p_task->spinning = false;
+    p_task->seen_all = 0;
+    p_task->poll_call = 0;
+    p_task->idle_polls = 0;
+    p_task->send_since_us = HOST_FOREVER;
+    p_task->finished = false;
+
+    getcontext (&p_task->context);
+    p_task->context.uc_stack.ss_sp = p_task->stack.data ();
+    p_task->context.uc_stack.ss_size = p_task->stack.size ();
+    p_task->context.uc_link = &scheduler_context;
+    makecontext (&p_task->context, host_task_entry, 0);
+
+    tasks.push_back (p_task);
+    if (p_handle != NULL)
+    {
+        *p_handle = p_task;
+    }
+    return (pdPASS);
+}
+
+
+void vTaskDelay (TickType_t ticks)
+{
+    host_spend_us (HOST_CALL_US);
+    if (p_current == NULL)
+    {
+        host_clock_to (now_us + ticks * 1000ULL);
+        return;
+    }
+
+    // Like FreeRTOS, the delay ends on a tick, counted from the current one
+    p_current->wake_us = (now_us / 1000 + ticks) * 1000;
+    host_switch_out ();
+}
+
+
+TickType_t xTaskGetTickCount (void)
+{
+    host_spend_us (HOST_CALL_US);
+    return ((TickType_t)(now_us / 1000));
+}
+
+
+TickType_t xTaskGetTickCountFromISR (void)
+{
+    return ((TickType_t)(now_us / 1000));
+}
+
+
+TaskHandle_t xTaskGetCurrentTaskHandle (void)
+{
+    return (p_current);
+}
+
+
+const char* pcTaskGetName (TaskHandle_t task)
+{
+    task = (task == NULL) ? p_current : task;
+    return (task == NULL ? "" : task->p_name);
+}
+
+
+void taskYIELD (void)
+{
+    if (p_current != NULL && critical_nesting == 0)
+    {
+        host_switch_out ();
+    }
+}
+
+
+void portENTER_CRITICAL (void)
+{
+    // A critical section may be changing a share the kernel can't see
+    all_changes++;
+    critical_nesting++;
+}
+
+
+void portEXIT_CRITICAL (void)
+{
+    critical_nesting--;
+}
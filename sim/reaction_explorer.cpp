@@ -0,0 +1,723 @@
+/** @file reaction_explorer.cpp
+ *      This file contains the reaction explorer, which plays every ordering
+ *      and spacing of bumps and targets, up to a few events long, against the
+ *      unmodified tasks and reports the slowest reactions of mastermind and
+ *      any queue a task waits on for good.
+ *
+ *  @details Mastermind reacts to flags from the limit switch tasks and
+ *           target reports from the thermal decoder. Each of those tasks polls on
+ *           its own period, and mastermind passes through its states every
+ *           10 ms, so how soon the motors react depends on just when an event
+ *           lands against all of those loops. A physical simulation only tries
+ *           the timings its scenarios happen to produce; this program tries
+ *           them all, within a grid.
+ *
+ *           Instead of the simulated room, a script sets what the switches
+ *           and the thermal camera see. The front switch closes for a moment
+ *           as on a bump and the back switch for longer as against a wall.
+ *           The person appears ahead, to the left or to the right, or goes
+ *           away, as a block of warm pixels in the matching columns. Every
+ *           script of up to @c -n events, each one of those kinds and each
+ *           a time from @c EXPLORE_GAPS_MS after the last one, is played with
+ *           the first event at each time in @c EXPLORE_PHASES_MS after the
+ *           robot has calibrated.
+ *
+ *           The firmware is started and calibrated only once. Then, for every
+ *           script, the process is forked and the child plays the script from
+ *           that same moment, so every script starts from exactly the same
+ *           state. Scripts are handed out to one worker per core.
+ *
+ *           Each run measures three reactions. The first is from the front
+ *           switch closing while the tracks drive forward until every motor
+ *           pin is low; the switch's interrupt fires on the scripted
+ *           millisecond. The second is from the person appearing or moving to
+ *           another side until the motor task applies the matching command.
+ *           The third is from the person going away until the motor task
+ *           applies a stop. The motor pins are watched directly, and the
+ *           mastermind states and applied commands come from the telemetry
+ *           stream. A target reaction is only counted if mastermind was
+ *           hunting when the event happened and stayed in that state, and
+ *           there was no newer target event, until the motors reacted. A
+ *           target which mastermind never answers in that time is reported
+ *           on its own. So is a task which has waited @c EXPLORE_STUCK_MS
+ *           for room in the motor command queue by the end of a run, which would wait there for good.
+ *
+ *           Usage: @c reaction_explorer [-j workers] [-n events] [-v]. Option
+ *           @c -v prints every run's reactions as well as the summary.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <new>
+#include <vector>
+#include "Arduino.h"
+#include "PrintStream.h"
+#include "Adafruit_AMG88xx.h"
+#include "taskqueue.h"
+#include "motor.h"
+#include "telemetry.h"
+#include "host.h"
+
+void setup (void);                      // the firmware's setup function
+
+extern Queue<MotorCommand> motorcommand;
+
+const uint8_t EXPLORE_MAX_EVENTS = 4;   ///< Most events in one script
+const uint32_t EXPLORE_BASE_MS = 6500;  ///< Time the scripts start, well after calibration
+const uint32_t EXPLORE_SETTLE_MS = 4000; ///< Time played after a script's last event
+const uint32_t EXPLORE_STUCK_MS = 2000; ///< Time waiting for room in a queue which counts as for good
+const uint32_t EXPLORE_FRONT_MS = 120;  ///< Time the front switch stays closed on a bump
+const uint32_t EXPLORE_BACK_MS = 400;   ///< Time the back switch stays closed against a wall
+const float EXPLORE_AMBIENT = 22.0;     ///< Room temperature, deg C
+const float EXPLORE_PERSON = 31.0;      ///< Temperature of the pixels the person fills, deg C
+
+/// Times between one event and the next which the scripts use, ms
+const uint16_t EXPLORE_GAPS_MS[] = {0, 7, 40, 130, 600, 1300};
+
+/// Times after @c EXPLORE_BASE_MS at which scripts start, ms
+const uint16_t EXPLORE_PHASES_MS[] = {0, 27, 61};
+
+const uint8_t NUM_GAPS = sizeof (EXPLORE_GAPS_MS) / sizeof (EXPLORE_GAPS_MS[0]);
+const uint8_t NUM_PHASES = sizeof (EXPLORE_PHASES_MS) / sizeof (EXPLORE_PHASES_MS[0]);
+
+const uint32_t EXPLORE_IN1 = D5;        ///< Right track reverse
+const uint32_t EXPLORE_IN2 = D4;        ///< Right track forward
+const uint32_t EXPLORE_IN3 = A0;        ///< Left track forward
+const uint32_t EXPLORE_IN4 = A1;        ///< Left track reverse
+const uint32_t EXPLORE_FRONT = D8;      ///< Front limit switch
+const uint32_t EXPLORE_BACK = D12;      ///< Back limit switch
+
+/// What can happen at one point of a script
+enum ExploreKind : uint8_t
+{
+    EXPLORE_BUMP,                       ///< The front switch closes for a moment
+    EXPLORE_WALL,                       ///< The back switch closes for a while
+    EXPLORE_AHEAD,                      ///< The person is straight ahead
+    EXPLORE_LEFT,                       ///< The person is to the left
+    EXPLORE_RIGHT,                      ///< The person is to the right
+    EXPLORE_GONE,                       ///< Nobody is in view
+    EXPLORE_NUM_KINDS                   ///< Number of kinds of event
+};
+
+/// Names of the kinds of event, for the report
+static const char* const kind_names[EXPLORE_NUM_KINDS] =
+{
+    "bump", "wall", "ahead", "left", "right", "gone"
+};
+
+/// Motor command direction which answers each kind of target event
+static const uint8_t kind_directions[EXPLORE_NUM_KINDS] = {0, 0, 1, 3, 4, 1};
+
+/** @brief   One ordering and spacing of events to play.
+ */
+struct ExploreScript
+{
+    uint8_t count;                      ///< Number of events
+    ExploreKind kinds[EXPLORE_MAX_EVENTS]; ///< What happens
+    uint32_t at_ms[EXPLORE_MAX_EVENTS]; ///< When it happens, from power-up
+};
+
+/** @brief   The slowest reactions seen in one run, in memory shared with the
+ *           explorer.
+ */
+struct ExploreResult
+{
+    float bump_ms;                      ///< Longest bump to all motor pins low, or -1
+    float target_ms;                    ///< Longest target to matching command, or -1
+    float lost_ms;                      ///< Longest target gone to stop command, or -1
+    uint8_t unanswered;                 ///< Targets mastermind never answered while hunting
+    int8_t stuck;                       ///< Index of a queue waited on for good, or -1
+    bool done;                          ///< The run finished
+};
+
+/** @brief   A mastermind state change or applied motor command from the
+ *           telemetry stream.
+ */
+struct ExploreRecord
+{
+    uint32_t ms;                        ///< Time of the change or command
+    uint8_t type;                       ///< @c TELEM_STATE or @c TELEM_MOTOR
+    uint8_t value;                      ///< The new state, or the command's direction
+    uint16_t speed;                     ///< The command's speed, mm/s
+};
+
+/** @brief   A write to one of the motor pins.
+ */
+struct ExplorePin
+{
+    uint64_t us;                        ///< Time of the write
+    uint32_t pin;                       ///< The pin
+    uint32_t duty;                      ///< Its new duty, 0 to 255
+};
+
+static ExploreScript script = {0, {}, {}}; ///< The script being played
+static std::vector<uint8_t> stream;     ///< Telemetry bytes sent so far
+static std::vector<ExplorePin> pin_log; ///< Motor pin writes so far
+static uint8_t duties[4];               ///< Duty now on IN1 to IN4
+static uint64_t end_us;                 ///< Time the run is over
+
+
+/** @brief   Find which kind of target the script shows at a time.
+ *  @param   ms The time, from power-up
+ *  @return  @c EXPLORE_AHEAD, @c EXPLORE_LEFT, @c EXPLORE_RIGHT or
+ *           @c EXPLORE_GONE
+ */
+static ExploreKind target_at (uint32_t ms)
+{
+    ExploreKind shown = EXPLORE_GONE;
+    for (uint8_t n = 0; n < script.count && script.at_ms[n] <= ms; n++)
+    {
+        if (script.kinds[n] >= EXPLORE_AHEAD)
+        {
+            shown = script.kinds[n];
+        }
+    }
+    return (shown);
+}
+
+
+/** @brief   Check whether a switch is closed at a time.
+ *  @param   kind @c EXPLORE_BUMP for the front switch, @c EXPLORE_WALL for
+ *           the back one
+ *  @param   ms The time, from power-up
+ *  @return  @c true if the script has the switch closed
+ */
+static bool switch_at (ExploreKind kind, uint32_t ms)
+{
+    uint32_t hold = (kind == EXPLORE_BUMP) ? EXPLORE_FRONT_MS : EXPLORE_BACK_MS;
+    for (uint8_t n = 0; n < script.count; n++)
+    {
+        if (script.kinds[n] == kind && ms >= script.at_ms[n]
+            && ms < script.at_ms[n] + hold)
+        {
+            return (true);
+        }
+    }
+    return (false);
+}
+
+
+void world_pin_write (uint32_t pin, uint32_t duty)
+{
+    const uint32_t pins[] = {EXPLORE_IN1, EXPLORE_IN2, EXPLORE_IN3, EXPLORE_IN4};
+    for (uint8_t n = 0; n < 4; n++)
+    {
+        if (pin == pins[n])
+        {
+            duties[n] = duty;
+            pin_log.push_back ({host_now_us (), pin, duty});
+        }
+    }
+}
+
+
+int world_pin_read (uint32_t pin)
+{
+    uint32_t ms = host_now_us () / 1000;
+    if (pin == EXPLORE_FRONT)
+    {
+        return (switch_at (EXPLORE_BUMP, ms) ? HIGH : LOW);
+    }
+    if (pin == EXPLORE_BACK)
+    {
+        return (switch_at (EXPLORE_WALL, ms) ? HIGH : LOW);
+    }
+    return (LOW);
+}
+
+
+void world_thermal_frame (float* p_pixels)
+{
+    // Columns are sent starting on the robot's right
+    uint8_t first_col = 8;
+    ExploreKind shown = target_at (host_now_us () / 1000);
+    if (shown == EXPLORE_RIGHT)
+    {
+        first_col = 0;
+    }
+    else if (shown == EXPLORE_AHEAD)
+    {
+        first_col = 3;
+    }
+    else if (shown == EXPLORE_LEFT)
+    {
+        first_col = 6;
+    }
+
+    for (uint8_t i = 0; i < AMG88xx_PIXEL_ARRAY_SIZE; i++)
+    {
+        uint8_t col = i / 8;
+        uint8_t row = i % 8;
+        bool person = col >= first_col && col < first_col + 2 && row >= 2;
+        p_pixels[i] = person ? EXPLORE_PERSON : EXPLORE_AMBIENT;
+    }
+}
+
+
+float world_thermistor (void)
+{
+    return (EXPLORE_AMBIENT + 3.0);
+}
+
+
+void world_telemetry (const uint8_t* p_data, size_t length)
+{
+    stream.insert (stream.end (), p_data, p_data + length);
+}
+
+
+/** @brief   Pick out the state changes and motor commands from the
+ *           telemetry stream.
+ *  @return  The records in the order they were sent
+ */
+static std::vector<ExploreRecord> decode_stream (void)
+{
+    std::vector<ExploreRecord> records;
+    std::vector<uint8_t> raw;
+    size_t start = 0;
+
+    for (size_t end = 0; end < stream.size (); end++)
+    {
+        if (stream[end] != 0)
+        {
+            continue;
+        }
+
+        // Undo the COBS byte stuffing of the frame from start to end
+        raw.clear ();
+        size_t at = start;
+        while (at < end)
+        {
+            uint8_t code = stream[at];
+            for (size_t n = at + 1; n < at + code && n < end; n++)
+            {
+                raw.push_back (stream[n]);
+            }
+            at += code;
+            if (code < 0xFF && at < end)
+            {
+                raw.push_back (0);
+            }
+        }
+        start = end + 1;
+
+        uint8_t sum = 0;
+        for (uint8_t byte : raw)
+        {
+            sum += byte;
+        }
+        if (raw.size () < 3 || sum != 0)
+        {
+            continue;
+        }
+        const uint8_t* p_payload = &raw[2];
+        if (raw[0] == TELEM_STATE && raw.size () >= 3 + sizeof (TelemState))
+        {
+            TelemState state;
+            memcpy (&state, p_payload, sizeof (state));
+            records.push_back ({state.ms, TELEM_STATE, state.state, 0});
+        }
+        else if (raw[0] == TELEM_MOTOR && raw.size () >= 3 + sizeof (TelemMotor))
+        {
+            TelemMotor motor;
+            memcpy (&motor, p_payload, sizeof (motor));
+            records.push_back ({motor.ms, TELEM_MOTOR, motor.direction,
+                                motor.speed_mmps});
+        }
+    }
+    return (records);
+}
+
+
+/** @brief   Find mastermind's state at a time from the telemetry records.
+ *  @param   records The records
+ *  @param   ms The time, from power-up
+ *  @return  The state, or 0 before the first one was sent
+ */
+static uint8_t state_at (const std::vector<ExploreRecord>& records, uint32_t ms)
+{
+    uint8_t state = 0;
+    for (const ExploreRecord& record : records)
+    {
+        if (record.type == TELEM_STATE && record.ms <= ms)
+        {
+            state = record.value;
+        }
+    }
+    return (state);
+}
+
+
+/** @brief   Work out the slowest reactions of the run just played.
+ *  @param   p_result Where the reactions go
+ */
+static void explore_measure (ExploreResult* p_result)
+{
+    std::vector<ExploreRecord> records = decode_stream ();
+    p_result->bump_ms = -1;
+    p_result->target_ms = -1;
+    p_result->lost_ms = -1;
+    p_result->unanswered = 0;
+
+    ExploreKind shown = EXPLORE_GONE;
+    bool chasing = false;               // the motors answered the person shown
+    for (uint8_t n = 0; n < script.count; n++)
+    {
+        uint32_t at_ms = script.at_ms[n];
+        ExploreKind kind = script.kinds[n];
+
+        if (kind == EXPLORE_BUMP)
+        {
+            // Only a bump while driving forward needs the motors stopped
+            uint8_t now[4] = {0, 0, 0, 0};
+            uint64_t at_us = at_ms * 1000ULL;
+            size_t p = 0;
+            for (; p < pin_log.size () && pin_log[p].us < at_us; p++)
+            {
+                const uint32_t pins[] = {EXPLORE_IN1, EXPLORE_IN2, EXPLORE_IN3, EXPLORE_IN4};
+                for (uint8_t k = 0; k < 4; k++)
+                {
+                    now[k] = (pin_log[p].pin == pins[k]) ? pin_log[p].duty : now[k];
+                }
+            }
+            if (state_at (records, at_ms) != 1 || (now[1] == 0 && now[2] == 0))
+            {
+                continue;
+            }
+            for (; p < pin_log.size (); p++)
+            {
+                const uint32_t pins[] = {EXPLORE_IN1, EXPLORE_IN2, EXPLORE_IN3, EXPLORE_IN4};
+                for (uint8_t k = 0; k < 4; k++)
+                {
+                    now[k] = (pin_log[p].pin == pins[k]) ? pin_log[p].duty : now[k];
+                }
+                if (now[0] == 0 && now[1] == 0 && now[2] == 0 && now[3] == 0)
+                {
+                    p_result->bump_ms = max (p_result->bump_ms,
+                                             (pin_log[p].us - at_us) / 1000.0f);
+                    break;
+                }
+            }
+            continue;
+        }
+        if (kind == EXPLORE_WALL || kind == shown)
+        {
+            continue;                   // nothing new for the motors to do
+        }
+        shown = kind;
+        bool was_chasing = chasing;
+        chasing = false;
+        if (kind == EXPLORE_GONE && !was_chasing)
+        {
+            continue;                   // a person never seen can't be lost
+        }
+
+        // Targets only steer while hunting; the answer must come before the
+        // state changes or the next target event
+        if (state_at (records, at_ms) != 1)
+        {
+            continue;
+        }
+        uint32_t next_ms = UINT32_MAX;
+        for (uint8_t m = n + 1; m < script.count; m++)
+        {
+            if (script.kinds[m] >= EXPLORE_AHEAD && script.kinds[m] != kind)
+            {
+                next_ms = script.at_ms[m];
+                break;
+            }
+        }
+        bool answered = false;
+        bool cut_short = (next_ms != UINT32_MAX);
+        for (const ExploreRecord& record : records)
+        {
+            if (record.ms < at_ms)
+            {
+                continue;
+            }
+            if (record.ms >= next_ms || (record.type == TELEM_STATE && record.value != 1))
+            {
+                cut_short = true;
+                break;
+            }
+            bool stop = (kind == EXPLORE_GONE);
+            if (record.type == TELEM_MOTOR && record.value == kind_directions[kind]
+                && (record.speed == 0) == stop)
+            {
+                float& worst = stop ? p_result->lost_ms : p_result->target_ms;
+                worst = max (worst, (float)(record.ms - at_ms));
+                answered = true;
+                chasing = !stop;
+                break;
+            }
+        }
+        if (!answered && !cut_short)
+        {
+            p_result->unanswered++;
+        }
+    }
+
+    p_result->stuck = -1;
+    QueueHandle_t stuck = host_stuck_sender (EXPLORE_STUCK_MS * 1000ULL);
+    if (stuck == motorcommand.get_handle ())
+    {
+        p_result->stuck = 0;
+    }
+    p_result->done = true;
+}
+
+
+/** @brief   Timer interrupt which closes the front switch on the scripted
+ *           millisecond, interrupting the processor as the real one does.
+ */
+static void explore_edge_isr (void)
+{
+    uint32_t ms = host_now_us () / 1000;
+    if (switch_at (EXPLORE_BUMP, ms) && !switch_at (EXPLORE_BUMP, ms - 1))
+    {
+        host_pin_edge (EXPLORE_FRONT, RISING);
+    }
+}
+
+
+/** @brief   Tell the simulated kernel when the run, or the calibration before
+ *           every run, is over.
+ */
+static bool explore_done (void)
+{
+    return (host_now_us () >= end_us);
+}
+
+
+/** @brief   Make every script with a given number of events.
+ *  @param   count The number of events in each
+ *  @param   scripts Where the scripts are added
+ */
+static void explore_enumerate (uint8_t count, std::vector<ExploreScript>& scripts)
+{
+    uint32_t kinds = 1;
+    uint32_t gaps = 1;
+    for (uint8_t n = 0; n < count; n++)
+    {
+        kinds *= EXPLORE_NUM_KINDS;
+        gaps *= (n == 0) ? NUM_PHASES : NUM_GAPS;
+    }
+
+    for (uint32_t k = 0; k < kinds; k++)
+    {
+        for (uint32_t g = 0; g < gaps; g++)
+        {
+            ExploreScript made;
+            made.count = count;
+            uint32_t kind_code = k;
+            uint32_t gap_code = g;
+            uint32_t at = EXPLORE_BASE_MS;
+            for (uint8_t n = 0; n < count; n++)
+            {
+                made.kinds[n] = (ExploreKind)(kind_code % EXPLORE_NUM_KINDS);
+                kind_code /= EXPLORE_NUM_KINDS;
+                uint8_t radix = (n == 0) ? NUM_PHASES : NUM_GAPS;
+                at += (n == 0) ? EXPLORE_PHASES_MS[gap_code % radix]
+                               : EXPLORE_GAPS_MS[gap_code % radix];
+                gap_code /= radix;
+                made.at_ms[n] = at;
+            }
+            scripts.push_back (made);
+        }
+    }
+}
+
+
+/** @brief   Print a script as its events and the times between them.
+ *  @param   p_file Where to print
+ *  @param   played The script
+ */
+static void explore_print (FILE* p_file, const ExploreScript& played)
+{
+    uint32_t last = EXPLORE_BASE_MS;
+    for (uint8_t n = 0; n < played.count; n++)
+    {
+        fprintf (p_file, "%s+%u %s", n ? " " : "", played.at_ms[n] - last,
+                 kind_names[played.kinds[n]]);
+        last = played.at_ms[n];
+    }
+}
+
+
+int main (int argc, char** argv)
+{
+    uint16_t workers = sysconf (_SC_NPROCESSORS_ONLN);
+    uint8_t max_events = 3;
+    bool verbose = false;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (strcmp (argv[arg], "-j") == 0 && arg + 1 < argc)
+        {
+            workers = max (atoi (argv[++arg]), 1);
+        }
+        else if (strcmp (argv[arg], "-n") == 0 && arg + 1 < argc)
+        {
+            max_events = constrain (atoi (argv[++arg]), 1, (int)EXPLORE_MAX_EVENTS);
+        }
+        else if (strcmp (argv[arg], "-v") == 0)
+        {
+            verbose = true;
+        }
+        else
+        {
+            fprintf (stderr, "Usage: %s [-j workers] [-n events] [-v]\n", argv[0]);
+            return (1);
+        }
+    }
+
+    std::vector<ExploreScript> scripts;
+    for (uint8_t count = 1; count <= max_events; count++)
+    {
+        explore_enumerate (count, scripts);
+    }
+
+    // Every run's results, and the count of scripts handed out, are shared
+    // with the workers and their runs
+    size_t bytes = sizeof (std::atomic<uint32_t>) + scripts.size () * sizeof (ExploreResult);
+    void* p_shared = mmap (NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p_shared == MAP_FAILED)
+    {
+        perror ("mmap");
+        return (1);
+    }
+    std::atomic<uint32_t>* p_next = new (p_shared) std::atomic<uint32_t> (0);
+    ExploreResult* p_results = (ExploreResult*)(p_next + 1);
+
+    // Start the firmware and let it calibrate with nobody in view, once
+    Serial.enabled = false;
+    host_event_mode (true);
+    setup ();
+    host_timer_start (1000, explore_edge_isr);
+    end_us = EXPLORE_BASE_MS * 1000ULL;
+    host_run (explore_done);
+
+    for (uint16_t w = 0; w < workers; w++)
+    {
+        if (fork () != 0)
+        {
+            continue;
+        }
+        for (uint32_t run = (*p_next)++; run < scripts.size (); run = (*p_next)++)
+        {
+            pid_t child = fork ();
+            if (child == 0)
+            {
+                script = scripts[run];
+                end_us = (script.at_ms[script.count - 1] + EXPLORE_SETTLE_MS) * 1000ULL;
+                host_run (explore_done);
+                explore_measure (&p_results[run]);
+                _exit (0);
+            }
+            waitpid (child, NULL, 0);
+        }
+        _exit (0);
+    }
+    while (wait (NULL) > 0)
+    {
+    }
+
+    // Summarize, keeping the first script which showed each worst case
+    const char* const stuck_names[] =
+    {
+        "motorcommand"
+    };
+    const uint8_t NUM_STUCK = sizeof (stuck_names) / sizeof (stuck_names[0]);
+    float worst[3] = {-1, -1, -1};
+    int64_t worst_run[3] = {-1, -1, -1};
+    double sums[3] = {0, 0, 0};
+    uint32_t counts[3] = {0, 0, 0};
+    uint32_t unanswered = 0;
+    int64_t unanswered_run = -1;
+    uint32_t stuck[NUM_STUCK] = {0};
+    int64_t stuck_run[NUM_STUCK] = {0};
+    uint32_t failed = 0;
+
+    for (uint32_t run = 0; run < scripts.size (); run++)
+    {
+        const ExploreResult& result = p_results[run];
+        if (!result.done)
+        {
+            failed++;
+            continue;
+        }
+        const float reactions[3] = {result.bump_ms, result.target_ms, result.lost_ms};
+        for (uint8_t r = 0; r < 3; r++)
+        {
+            if (reactions[r] < 0)
+            {
+                continue;
+            }
+            sums[r] += reactions[r];
+            counts[r]++;
+            if (reactions[r] > worst[r])
+            {
+                worst[r] = reactions[r];
+                worst_run[r] = run;
+            }
+        }
+        if (result.unanswered > 0 && unanswered++ == 0)
+        {
+            unanswered_run = run;
+        }
+        if (result.stuck >= 0 && stuck[result.stuck]++ == 0)
+        {
+            stuck_run[result.stuck] = run;
+        }
+        if (verbose)
+        {
+            explore_print (stdout, scripts[run]);
+            printf (": bump %.1f target %.1f lost %.1f unanswered %u stuck %s\n",
+                    result.bump_ms, result.target_ms, result.lost_ms,
+                    result.unanswered, result.stuck >= 0 ? stuck_names[result.stuck] : "-");
+        }
+    }
+
+    printf ("%zu scripts of up to %u events, %u failed\n", scripts.size (),
+            max_events, failed);
+    const char* const reaction_names[3] =
+    {
+        "bump to motors stopped", "target to motor command", "target lost to stop command"
+    };
+    for (uint8_t r = 0; r < 3; r++)
+    {
+        printf ("%s: ", reaction_names[r]);
+        if (counts[r] == 0)
+        {
+            printf ("never seen\n");
+            continue;
+        }
+        printf ("worst %.1f ms, mean %.1f ms over %u, worst after: ", worst[r],
+                sums[r] / counts[r], counts[r]);
+        explore_print (stdout, scripts[worst_run[r]]);
+        printf ("\n");
+    }
+    printf ("targets never answered while hunting: %u", unanswered);
+    if (unanswered > 0)
+    {
+        printf (", first after: ");
+        explore_print (stdout, scripts[unanswered_run]);
+    }
+    printf ("\n");
+    for (uint8_t q = 0; q < NUM_STUCK; q++)
+    {
+        if (stuck[q] > 0)
+        {
+            printf ("blocked for good putting into %s: %u scripts, first after: ",
+                    stuck_names[q], stuck[q]);
+            explore_print (stdout, scripts[stuck_run[q]]);
+            printf ("\n");
+        }
+    }
+    return (0);
+}
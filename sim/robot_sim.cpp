@@ -0,0 +1,149 @@
+/** @file robot_sim.cpp
+ *      This file contains the scenario benchmarks for the host simulator,
+ *      which run the unmodified Scroomba tasks against a simulated robot.
+ *
+ *  @details Each scenario is run in its own child process, since the tasks
+ *           and the queues between them are global and can't be started over
+ *           inside one process. The child sets up the world, calls the
+ *           firmware's @c setup() to create the queues and tasks, and runs the
+ *           simulated kernel until the robot bumps the person and stops
+ *           pushing, or the time runs out. One line of comma separated numbers
+ *           is printed per scenario so that runs before and after a change to
+ *           the control or decoder code can be compared.
+ *
+ *           Usage: @c robot_sim [-v] [-t] [-T] [scenario ...] runs the named
+ *           scenarios, or all of them. Option @c -v shows the firmware's
+ *           serial output, @c -t simulates every tick instead of jumping
+ *           the virtual clock from one event to the next, and @c -T saves
+ *           each scenario's telemetry stream to @c <scenario>.tlm for
+ *           @c tools/telemetry_decode.py to read.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <chrono>
+#include "sim_world.h"
+#include "host.h"
+
+void setup (void);                      // the firmware's setup function
+
+static FILE* p_telemetry = NULL;        ///< Where telemetry is saved, if anywhere
+
+
+/** @brief   Save the firmware's telemetry frames as they are sent.
+ *  @param   p_data The framed bytes
+ *  @param   length The number of bytes
+ */
+void world_telemetry (const uint8_t* p_data, size_t length)
+{
+    if (p_telemetry)
+    {
+        fwrite (p_data, 1, length, p_telemetry);
+    }
+}
+
+
+/** @brief   Tell the simulated kernel when the encounter is over.
+ */
+static bool sim_done (void)
+{
+    world.advance_to (host_now_us ());
+    return (world.finished ());
+}
+
+
+/** @brief   Run one scenario and print its line of the report.
+ *  @details This runs in a child process and never returns.
+ *  @param   scenario The scenario to run
+ *  @param   verbose @c true to show the firmware's serial output
+ *  @param   ticks @c true to simulate every tick rather than skip idle time
+ *  @param   save @c true to save the telemetry stream to a file
+ */
+static void run_scenario (const SimScenario& scenario, bool verbose,
+                          bool ticks, bool save)
+{
+    auto start = std::chrono::steady_clock::now ();
+
+    if (save)
+    {
+        char file_name[64];
+        snprintf (file_name, sizeof (file_name), "%s.tlm", scenario.p_name);
+        p_telemetry = fopen (file_name, "wb");
+    }
+
+    world.begin (scenario);
+    Serial.enabled = verbose;
+    host_event_mode (!ticks);
+    setup ();
+    host_run (sim_done);
+
+    double wall_ms = std::chrono::duration<double, std::milli>
+                     (std::chrono::steady_clock::now () - start).count ();
+    const SimMetrics& m = world.metrics ();
+    printf ("%s,%s,%.2f,%.2f,%u,%.2f,%.0f,%u,%.1f,%.0f\n", scenario.p_name,
+            m.contact ? "contact" : "timeout", m.ttc_s, m.path_m, m.churn,
+            m.impact_mps, m.bump_stop_ms, m.false_starts,
+            host_now_us () / 1e6, wall_ms);
+    fflush (stdout);
+    if (p_telemetry)
+    {
+        fclose (p_telemetry);
+    }
+    _exit (0);
+}
+
+
+int main (int argc, char** argv)
+{
+    bool verbose = false;
+    bool ticks = false;
+    bool save = false;
+    bool any_named = false;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (strcmp (argv[arg], "-v") == 0)
+        {
+            verbose = true;
+        }
+        else if (strcmp (argv[arg], "-t") == 0)
+        {
+            ticks = true;
+        }
+        else if (strcmp (argv[arg], "-T") == 0)
+        {
+            save = true;
+        }
+        else
+        {
+            any_named = true;
+        }
+    }
+
+    printf ("scenario,result,ttc_s,path_m,churn,impact_mps,bump_stop_ms,"
+            "false_starts,sim_s,wall_ms\n");
+    fflush (stdout);
+
+    for (size_t n = 0; n < NUM_SCENARIOS; n++)
+    {
+        bool wanted = !any_named;
+        for (int arg = 1; arg < argc; arg++)
+        {
+            wanted = wanted || strcmp (argv[arg], scenarios[n].p_name) == 0;
+        }
+        if (!wanted)
+        {
+            continue;
+        }
+
+        pid_t child = fork ();
+        if (child == 0)
+        {
+            run_scenario (scenarios[n], verbose, ticks, save);
+        }
+        int status;
+        waitpid (child, &status, 0);
+    }
+    return (0);
+}
@@ -0,0 +1,473 @@
+/** @file scenario_farm.cpp
+ *      This file contains the scenario farm, which plays the simulator's
+ *      scenarios over a grid of firmware tuning values on every core of the
+ *      host and ranks the settings by how well the robot did.
+ *
+ *  @details Each run plays one scenario with one setting of the tuning
+ *           constants marked @c TUNABLE in the firmware, and one seed for the
+ *           sensor noise. As in @c robot_sim.cpp, every run gets a process of
+ *           its own, since the tasks and the queues between them are global:
+ *           a fresh child sets the constants, calls the firmware's @c setup()
+ *           and runs the simulated kernel on its own virtual clock until the
+ *           encounter is over, then writes its numbers into memory shared with
+ *           the farm and exits. A run which crashes is counted as a miss.
+ *
+ *           The runs are shared out among one worker process per core. Each
+ *           worker starts with an even block of the runs in a deque of its
+ *           own and takes runs from its front; once its deque is empty it
+ *           steals runs from the back of the others', so a worker which drew
+ *           many slow encounters doesn't hold up the rest. Each deque is a
+ *           single 64 bit word holding its front and back, changed only by
+ *           compare and swap, so the workers never wait for each other.
+ *
+ *           When every run is done, the runs are gathered by setting and one
+ *           line is printed for each, best first: the one which reached the
+ *           person most often, then the one with the fewest runs in which
+ *           the tracks started moving before anybody came in, then the one
+ *           which got there soonest on average.
+ *
+ *           Usage: @c scenario_farm [-j workers] [-r repeats] [-t]
+ *           [knob=value,value,...] [scenario ...] tries each listed value of
+ *           each named knob, with every other knob at the firmware's own
+ *           value, in every combination. The knobs are @c false_alarm,
+ *           @c calib_frames, @c side_deg, @c lead_ms, @c chase_mmps,
+ *           @c turn_mmps and @c mastermind_ms. Each scenario, or just the
+ *           named ones, is played @c repeats times with different noise
+ *           seeds. Option @c -j sets the number of workers, normally one per
+ *           core, and @c -t simulates every tick as in @c robot_sim.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <new>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "sim_world.h"
+#include "host.h"
+
+void setup (void);                      // the firmware's setup function
+
+// The firmware's tuning constants, which are variables on the host
+extern float DETECT_FALSE_ALARM_RATE;
+extern uint8_t CALIB_FRAMES;
+extern float SIDE_DEG;
+extern uint16_t LEAD_MS;
+extern uint16_t CHASE_SPEED;
+extern uint16_t TURN_SPEED;
+extern uint16_t MASTERMIND_PERIOD_MS;
+
+const uint8_t FARM_MAX_VALUES = 16;     ///< Most values tried for one knob
+const uint32_t FARM_SEED_STRIDE = 1000; ///< Seed step between repeats of a scenario
+
+/** @brief   A firmware tuning constant which the farm can change.
+ */
+struct FarmKnob
+{
+    const char* p_name;                 ///< Name given on the command line
+    float (*p_get) (void);              ///< Gets the firmware's own value
+    void (*p_set) (float value);        ///< Sets the value before the firmware starts
+    float values[FARM_MAX_VALUES];      ///< Values to try
+    uint8_t num_values;                 ///< Number of values to try
+};
+
+/// The constants which can be swept, each at the firmware's own value until
+/// the command line lists others
+static FarmKnob knobs[] =
+{
+    { "false_alarm",   [] () -> float { return DETECT_FALSE_ALARM_RATE; },
+                       [] (float v) { DETECT_FALSE_ALARM_RATE = v; }, {}, 0 },
+    { "calib_frames",  [] () -> float { return CALIB_FRAMES; },
+                       [] (float v) { CALIB_FRAMES = lround (v); }, {}, 0 },
+    { "side_deg",      [] () -> float { return SIDE_DEG; },
+                       [] (float v) { SIDE_DEG = v; }, {}, 0 },
+    { "lead_ms",       [] () -> float { return LEAD_MS; },
+                       [] (float v) { LEAD_MS = lround (v); }, {}, 0 },
+    { "chase_mmps",    [] () -> float { return CHASE_SPEED; },
+                       [] (float v) { CHASE_SPEED = lround (v); }, {}, 0 },
+    { "turn_mmps",     [] () -> float { return TURN_SPEED; },
+                       [] (float v) { TURN_SPEED = lround (v); }, {}, 0 },
+    { "mastermind_ms", [] () -> float { return MASTERMIND_PERIOD_MS; },
+                       [] (float v) { MASTERMIND_PERIOD_MS = lround (v); }, {}, 0 },
+};
+
+const uint8_t NUM_KNOBS = sizeof (knobs) / sizeof (knobs[0]);
+
+/// How a run ended
+enum FarmState : uint8_t
+{
+    FARM_WAITING,                       ///< Not run yet
+    FARM_DONE,                          ///< Ran to the end of the encounter
+    FARM_FAILED                         ///< The firmware or the simulator crashed
+};
+
+/** @brief   What one run left for the farm, in memory shared by all processes.
+ */
+struct FarmResult
+{
+    SimMetrics metrics;                 ///< The encounter's numbers
+    FarmState state;                    ///< How the run ended
+};
+
+/** @brief   One worker's runs still to do, from @c front up to but not
+ *           including @c back, packed into one word as front + back * 2^32.
+ */
+struct FarmDeque
+{
+    std::atomic<uint64_t> ends;         ///< Front in the low half, back in the high half
+};
+
+static_assert (std::atomic<uint64_t>::is_always_lock_free,
+               "the deques are shared between processes, so they can't use locks");
+
+/** @brief   Numbers gathered over every run of one setting.
+ */
+struct FarmScore
+{
+    uint32_t combo;                     ///< Which setting, counting through the grid
+    uint32_t runs;                      ///< Runs played
+    uint32_t contacts;                  ///< Runs which reached the person
+    uint32_t false_runs;                ///< Runs in which the tracks started with nobody there
+    float ttc_sum;                      ///< Sum of the times to contact, s
+    uint32_t detects;                   ///< Runs in which the tracks first started after the person came in
+    float detect_sum;                   ///< Sum of the times from entering to starting, s
+    float ttc_worst;                    ///< Longest time to contact, s
+    float impact_sum;                   ///< Sum of the impact speeds, m/s
+};
+
+
+/** @brief   Take the run at the front of a worker's own deque.
+ *  @param   deque The worker's deque
+ *  @return  The run's number, or -1 if the deque is empty
+ */
+static int64_t deque_take (FarmDeque& deque)
+{
+    uint64_t ends = deque.ends.load ();
+    while ((uint32_t)ends < (uint32_t)(ends >> 32))
+    {
+        if (deque.ends.compare_exchange_weak (ends, ends + 1))
+        {
+            return ((uint32_t)ends);
+        }
+    }
+    return (-1);
+}
+
+
+/** @brief   Steal the run at the back of another worker's deque.
+ *  @param   deque The other worker's deque
+ *  @return  The run's number, or -1 if the deque is empty
+ */
+static int64_t deque_steal (FarmDeque& deque)
+{
+    uint64_t ends = deque.ends.load ();
+    while ((uint32_t)ends < (uint32_t)(ends >> 32))
+    {
+        if (deque.ends.compare_exchange_weak (ends, ends - (1ULL << 32)))
+        {
+            return ((uint32_t)(ends >> 32) - 1);
+        }
+    }
+    return (-1);
+}
+
+
+/** @brief   Tell the simulated kernel when the encounter is over.
+ */
+static bool sim_done (void)
+{
+    world.advance_to (host_now_us ());
+    return (world.finished ());
+}
+
+
+/** @brief   Play one run and leave its numbers for the farm.
+ *  @details This runs in a child process of its own and never returns.
+ *  @param   run The run's number, counting through settings, then
+ *           scenarios, then repeats
+ *  @param   chosen The scenarios being played
+ *  @param   repeats How many times each scenario is played per setting
+ *  @param   ticks @c true to simulate every tick rather than skip idle time
+ *  @param   p_result Where the run's numbers go
+ */
+static void farm_run (uint32_t run, const std::vector<size_t>& chosen,
+                      uint32_t repeats, bool ticks, FarmResult* p_result)
+{
+    uint32_t repeat = run % repeats;
+    uint32_t scene = (run / repeats) % chosen.size ();
+    uint32_t combo = run / repeats / chosen.size ();
+
+    for (uint8_t k = 0; k < NUM_KNOBS; k++)
+    {
+        knobs[k].p_set (knobs[k].values[combo % knobs[k].num_values]);
+        combo /= knobs[k].num_values;
+    }
+
+    SimScenario scenario = scenarios[chosen[scene]];
+    scenario.seed += repeat * FARM_SEED_STRIDE;
+
+    world.begin (scenario);
+    Serial.enabled = false;
+    host_event_mode (!ticks);
+    setup ();
+    host_run (sim_done);
+
+    p_result->metrics = world.metrics ();
+    p_result->state = FARM_DONE;
+    _exit (0);
+}
+
+
+/** @brief   Work through this worker's runs, then other workers' runs,
+ *           until none are left.
+ *  @details This runs in a child process of its own and never returns.
+ *  @param   self This worker's number
+ *  @param   p_deques Every worker's deque
+ *  @param   workers The number of workers
+ *  @param   p_results The numbers of every run
+ *  @param   chosen The scenarios being played
+ *  @param   repeats How many times each scenario is played per setting
+ *  @param   ticks @c true to simulate every tick rather than skip idle time
+ */
+static void farm_worker (uint16_t self, FarmDeque* p_deques, uint16_t workers,
+                         FarmResult* p_results, const std::vector<size_t>& chosen,
+                         uint32_t repeats, bool ticks)
+{
+    for (;;)
+    {
+        int64_t run = deque_take (p_deques[self]);
+        for (uint16_t k = 1; run < 0 && k < workers; k++)
+        {
+            run = deque_steal (p_deques[(self + k) % workers]);
+        }
+        if (run < 0)
+        {
+            _exit (0);
+        }
+
+        pid_t child = fork ();
+        if (child == 0)
+        {
+            farm_run (run, chosen, repeats, ticks, &p_results[run]);
+        }
+        int status;
+        waitpid (child, &status, 0);
+        if (p_results[run].state != FARM_DONE)
+        {
+            p_results[run].state = FARM_FAILED;
+        }
+    }
+}
+
+
+/** @brief   Read a knob's list of values from the command line.
+ *  @param   p_arg The argument, such as @c side_deg=10,15,20
+ *  @return  @c true if the argument named a knob and gave it values
+ */
+static bool farm_parse_knob (const char* p_arg)
+{
+    const char* p_equals = strchr (p_arg, '=');
+    if (p_equals == NULL)
+    {
+        return (false);
+    }
+    for (FarmKnob& knob : knobs)
+    {
+        if (strlen (knob.p_name) == (size_t)(p_equals - p_arg)
+            && strncmp (knob.p_name, p_arg, p_equals - p_arg) == 0)
+        {
+            knob.num_values = 0;
+            const char* p_value = p_equals + 1;
+            while (*p_value != '\0' && knob.num_values < FARM_MAX_VALUES)
+            {
+                char* p_end;
+                float value = strtof (p_value, &p_end);
+                if (p_end == p_value || (*p_end != ',' && *p_end != '\0'))
+                {
+                    return (false);
+                }
+                knob.values[knob.num_values++] = value;
+                p_value = (*p_end == ',') ? p_end + 1 : p_end;
+            }
+            return (knob.num_values > 0);
+        }
+    }
+    return (false);
+}
+
+
+int main (int argc, char** argv)
+{
+    uint16_t workers = sysconf (_SC_NPROCESSORS_ONLN);
+    uint32_t repeats = 1;
+    bool ticks = false;
+    std::vector<size_t> chosen;
+
+    for (FarmKnob& knob : knobs)
+    {
+        knob.values[0] = knob.p_get ();
+        knob.num_values = 1;
+    }
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (strcmp (argv[arg], "-j") == 0 && arg + 1 < argc)
+        {
+            workers = max (atoi (argv[++arg]), 1);
+        }
+        else if (strcmp (argv[arg], "-r") == 0 && arg + 1 < argc)
+        {
+            repeats = max (atoi (argv[++arg]), 1);
+        }
+        else if (strcmp (argv[arg], "-t") == 0)
+        {
+            ticks = true;
+        }
+        else if (strchr (argv[arg], '=') != NULL)
+        {
+            if (!farm_parse_knob (argv[arg]))
+            {
+                fprintf (stderr, "Can't sweep %s\n", argv[arg]);
+                return (1);
+            }
+        }
+        else
+        {
+            size_t n = 0;
+            while (n < NUM_SCENARIOS && strcmp (argv[arg], scenarios[n].p_name) != 0)
+            {
+                n++;
+            }
+            if (n == NUM_SCENARIOS)
+            {
+                fprintf (stderr, "No scenario named %s\n", argv[arg]);
+                return (1);
+            }
+            chosen.push_back (n);
+        }
+    }
+    if (chosen.empty ())
+    {
+        for (size_t n = 0; n < NUM_SCENARIOS; n++)
+        {
+            chosen.push_back (n);
+        }
+    }
+
+    uint32_t combos = 1;
+    for (const FarmKnob& knob : knobs)
+    {
+        combos *= knob.num_values;
+    }
+    uint32_t runs = combos * chosen.size () * repeats;
+    workers = min ((uint32_t)workers, runs);
+
+    // The deques and results are shared with the workers and their runs
+    size_t bytes = workers * sizeof (FarmDeque) + runs * sizeof (FarmResult);
+    void* p_shared = mmap (NULL, bytes, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p_shared == MAP_FAILED)
+    {
+        perror ("mmap");
+        return (1);
+    }
+    FarmDeque* p_deques = new (p_shared) FarmDeque[workers];
+    FarmResult* p_results = (FarmResult*)(p_deques + workers);
+    for (uint16_t w = 0; w < workers; w++)
+    {
+        uint64_t front = (uint64_t)runs * w / workers;
+        uint64_t back = (uint64_t)runs * (w + 1) / workers;
+        p_deques[w].ends = front | (back << 32);
+    }
+
+    auto start = std::chrono::steady_clock::now ();
+    for (uint16_t w = 0; w < workers; w++)
+    {
+        if (fork () == 0)
+        {
+            farm_worker (w, p_deques, workers, p_results, chosen, repeats, ticks);
+        }
+    }
+    while (wait (NULL) > 0)
+    {
+    }
+    double wall_s = std::chrono::duration<double>
+                    (std::chrono::steady_clock::now () - start).count ();
+
+    // Gather the runs of each setting; the setting is the slowest-changing part of a run's number
+    std::vector<FarmScore> scores (combos);
+    uint32_t failed = 0;
+    for (uint32_t run = 0; run < runs; run++)
+    {
+        FarmScore& score = scores[run / (chosen.size () * repeats)];
+        const SimMetrics& m = p_results[run].metrics;
+        score.combo = run / (chosen.size () * repeats);
+        score.runs++;
+        if (p_results[run].state != FARM_DONE)
+        {
+            failed++;
+            continue;
+        }
+        if (m.contact)
+        {
+            score.contacts++;
+            score.ttc_sum += m.ttc_s;
+            score.ttc_worst = max (score.ttc_worst, m.ttc_s);
+            score.impact_sum += m.impact_mps;
+        }
+        if (m.false_starts > 0)
+        {
+            score.false_runs++;
+        }
+        if (m.detect_s > 0 && m.false_starts == 0) // a false start would already have the tracks going
+        {
+            score.detects++;
+            score.detect_sum += m.detect_s;
+        }
+    }
+
+    std::sort (scores.begin (), scores.end (),
+               [] (const FarmScore& a, const FarmScore& b)
+               {
+                   if (a.contacts * b.runs != b.contacts * a.runs)
+                   {
+                       return (a.contacts * b.runs > b.contacts * a.runs);
+                   }
+                   if (a.false_runs * b.runs != b.false_runs * a.runs)
+                   {
+                       return (a.false_runs * b.runs < b.false_runs * a.runs);
+                   }
+                   return (a.ttc_sum * b.contacts < b.ttc_sum * a.contacts);
+               });
+
+    printf ("rank");
+    for (const FarmKnob& knob : knobs)
+    {
+        printf (",%s", knob.p_name);
+    }
+    printf (",runs,contact_rate,mean_ttc_s,worst_ttc_s,false_start_rate,mean_detect_s,mean_impact_mps\n");
+    for (size_t rank = 0; rank < scores.size (); rank++)
+    {
+        const FarmScore& score = scores[rank];
+        printf ("%zu", rank + 1);
+        uint32_t combo = score.combo;
+        for (const FarmKnob& knob : knobs)
+        {
+            printf (",%g", knob.values[combo % knob.num_values]);
+            combo /= knob.num_values;
+        }
+        float contacts = max (score.contacts, 1U);
+        printf (",%u,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n", score.runs,
+                (float)score.contacts / score.runs, score.ttc_sum / contacts,
+                score.ttc_worst, (float)score.false_runs / score.runs,
+                score.detect_sum / max (score.detects, 1U),
+                score.impact_sum / contacts);
+    }
+    fprintf (stderr, "%u runs of %u settings on %u workers in %.1f s, %u failed\n",
+             runs, combos, workers, wall_s, failed);
+    return (0);
+}
@@ -0,0 +1,24 @@
+/** @file sim_scenarios.cpp
+ *      This file contains the encounters which the host simulator's programs
+ *      play: where the person stands or walks, how warm the room is and what
+ *      shape the robot's battery and tracks are in.
+ */
+
+#include "sim_world.h"
+
+/// The encounters to benchmark. People walk in after calibration is done.
+/// The last one runs on a tired battery with a dragging left track.
+const SimScenario scenarios[] =
+{
+    // name              room   x     y     vx    vy    temp  enter  batt  drag  timeout seed
+    { "standing-ahead",  22.0, { 3.0,  0.0,  0.0,  0.0, 31.0, 7.0 }, 1.0,  0.0,  40.0, 1 },
+    { "standing-left",   22.0, { 2.5,  1.1,  0.0,  0.0, 31.0, 7.0 }, 1.0,  0.0,  40.0, 2 },
+    { "standing-right",  22.0, { 2.5, -1.1,  0.0,  0.0, 31.0, 7.0 }, 1.0,  0.0,  40.0, 3 },
+    { "walking-across",  22.0, { 3.0,  1.5,  0.0, -0.4, 31.0, 7.0 }, 1.0,  0.0,  40.0, 4 },
+    { "walking-away",    22.0, { 2.0,  0.0,  0.2,  0.0, 31.0, 7.0 }, 1.0,  0.0,  40.0, 5 },
+    { "warm-room",       28.0, { 3.0,  0.5,  0.0,  0.0, 31.5, 7.0 }, 1.0,  0.0,  40.0, 6 },
+    { "far-away",        22.0, { 3.7,  0.3,  0.0,  0.0, 31.0, 7.0 }, 1.0,  0.0,  40.0, 7 },
+    { "tired-battery",   22.0, { 2.5,  1.1,  0.0,  0.0, 31.0, 7.0 }, 0.7,  0.15, 40.0, 8 },
+};
+
+const size_t NUM_SCENARIOS = sizeof (scenarios) / sizeof (scenarios[0]);
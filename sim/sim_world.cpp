@@ -0,0 +1,473 @@
+/** @file sim_world.cpp
+ *      This file contains the simulated world in which the Scroomba firmware
+ *      runs on the host: the tracked chassis, a room with a person in it, the
+ *      thermal camera's view of the room, the time of flight sensor, the
+ *      track encoders and the limit switches.
+ *
+ *  @details The chassis is driven by the same pins @c task_motor drives on the
+ *           robot. Motor A (in1, in2) is the right track and motor B (in3,
+ *           in4) the left one; a PWM on in2 or in3 drives its track forward
+ *           and on in1 or in4 drives it backward. Each track speeds up toward
+ *           a speed set by its duty cycle with a first-order lag, and nothing
+ *           moves below the motors' dead band. A scenario can weaken the
+ *           battery, which slows both tracks at a given duty, and make the
+ *           left track drag. Each track's encoder counts the track's travel,
+ *           including while it slips against something it can't push. The
+ *           tracks starting to move before the person has come in count as a
+ *           false start, since only noise can have set them going.
+ *
+ *           The person is a warm cylinder. Each of the camera's 64 pixels
+ *           covers 7.5 by 7.5 degrees, and its reading is the room temperature
+ *           plus the person's excess temperature times the fraction of the
+ *           pixel the person fills, plus fixed-pattern and random noise, in
+ *           the AMG88xx's 0.25 degree steps. Pixels are sent column by column
+ *           starting on the robot's right, with each column going from top to
+ *           bottom, just as the real camera does.
+ *
+ *           The VL53L0X time of flight sensor sits in the middle of the front
+ *           bumper looking straight ahead. It ranges to the nearest of the
+ *           person's near side and the walls inside its narrow cone, with
+ *           noise that grows with distance, and reports nothing beyond its
+ *           reach. Each time a range is done it pulls its interrupt pin low,
+ *           and the pin stays low until the range is read.
+ */
+
+#include "sim_world.h"
+#include "host.h"
+
+const float SIM_VMAX = 0.8;             ///< Track speed at full duty, m/s
+const float SIM_DEAD_BAND = 40;         ///< Duty below which tracks don't move
+const float SIM_TAU = 0.12;             ///< Track speed time constant, s
+const float SIM_TRACK_WIDTH = 0.35;     ///< Effective width with skidding, m
+const float SIM_ROBOT_HALF = 0.15;      ///< Centre to bumper distance, m
+const float SIM_PERSON_RADIUS = 0.2;    ///< Half the width of a person, m
+const float SIM_PERSON_HEIGHT = 1.7;    ///< Height of a person, m
+const float SIM_CAMERA_HEIGHT = 0.12;   ///< Height of the camera, m
+const float SIM_ROOM_HALF = 4.0;        ///< Half the width of the room, m
+const float SIM_BUMPER_DEG = 40;        ///< Half width of the front bumper
+const float SIM_PIXEL_DEG = 7.5;        ///< Field of view of one pixel
+const float SIM_NOISE = 0.25;           ///< Random noise of a middle pixel
+const float SIM_EDGE_NOISE = 0.5;       ///< Random noise of an edge pixel
+const float SIM_STOP_WAIT_S = 2.0;      ///< Longest to wait for a bump stop
+const float SIM_TOF_HALF_DEG = 12.5;    ///< Half the ToF sensor's cone
+const float SIM_TOF_MAX = 1.2;          ///< Longest range the ToF sensor sees, m
+const float SIM_TOF_NOISE = 0.003;      ///< ToF noise close up, m
+const float SIM_TOF_NOISE_FRAC = 0.01;  ///< ToF noise per metre of range
+const uint32_t SIM_TOF_BUDGET_MS = 20;  ///< Shortest time for one range, ms
+const float SIM_COUNTS_PER_M = 11459;   ///< Encoder counts per metre of track
+
+const uint32_t SIM_IN1 = D5;            ///< Right track reverse
+const uint32_t SIM_IN2 = D4;            ///< Right track forward
+const uint32_t SIM_IN3 = A0;            ///< Left track forward
+const uint32_t SIM_IN4 = A1;            ///< Left track reverse
+const uint32_t SIM_ENA = D2;            ///< Right track enable
+const uint32_t SIM_ENB = A4;            ///< Left track enable
+const uint32_t SIM_FRONT = D8;          ///< Front limit switch
+const uint32_t SIM_BACK = D12;          ///< Back limit switch
+const uint32_t SIM_TOF_INT = D7;        ///< ToF range ready, active low
+
+SimWorld world;                         ///< The one simulated world
+
+
+/** @brief   Find how much of one angular range overlaps another.
+ *  @return  The overlap as a fraction of the second range, 0 to 1
+ */
+static float overlap (float lo, float hi, float cell_lo, float cell_hi)
+{
+    float amount = min (hi, cell_hi) - max (lo, cell_lo);
+    return (amount > 0 ? amount / (cell_hi - cell_lo) : 0);
+}
+
+
+/** @brief   Set the world up for a scenario.
+ *  @param   scenario The room, person and time limit to simulate
+ */
+void SimWorld::begin (const SimScenario& scenario)
+{
+    scene = scenario;
+    rng.seed (scenario.seed);
+
+    std::normal_distribution<float> pattern (0, 0.3);
+    for (uint8_t i = 0; i < AMG88xx_PIXEL_ARRAY_SIZE; i++)
+    {
+        offset[i] = pattern (rng);
+    }
+    memset (duty, 0, sizeof (duty));
+
+    step_us = 0;
+    rx = ry = heading = 0;
+    v_left = v_right = 0;
+    px = scene.person.x;
+    py = scene.person.y;
+    cmd_left = cmd_right = 0;
+    enc_left = enc_right = 0;
+    tof_period_us = tof_next_us = 0;
+    tof_pending = false;
+    tof_mm = 0xFFFF;
+    tof_status = 4;
+    front_pressed = back_pressed = false;
+    contact_us = 0;
+    memset (&result, 0, sizeof (result));
+    over = false;
+    stepping = false;
+}
+
+
+/** @brief   Work out a track's command from its driver pins.
+ *  @param   fwd Pin whose PWM drives the track forward
+ *  @param   rev Pin whose PWM drives the track backward
+ *  @param   en The track's enable pin
+ *  @return  The command from -1 (full reverse) to 1 (full forward)
+ */
+float SimWorld::track_command (uint32_t fwd, uint32_t rev, uint32_t en)
+{
+    if (duty[en] == 0)
+    {
+        return (0);
+    }
+    return ((duty[fwd] - duty[rev]) / 255.0);
+}
+
+
+/** @brief   Move the world forward by one time step.
+ *  @param   dt The time step, s
+ */
+void SimWorld::step (float dt)
+{
+    float t = step_us / 1e6;
+    bool present = (t >= scene.person.enter_s);
+
+    // Commands and how often a track is made to change direction; a ramped
+    // command changes every step, so only the direction counts
+    float new_left = track_command (SIM_IN3, SIM_IN4, SIM_ENB);
+    float new_right = track_command (SIM_IN2, SIM_IN1, SIM_ENA);
+    if ((new_left > 0) != (cmd_left > 0) || (new_left < 0) != (cmd_left < 0)
+        || (new_right > 0) != (cmd_right > 0) || (new_right < 0) != (cmd_right < 0))
+    {
+        result.churn++;
+    }
+    if (cmd_left == 0 && cmd_right == 0 && (new_left != 0 || new_right != 0))
+    {
+        if (!present)
+        {
+            result.false_starts++;
+        }
+        else if (result.detect_s == 0)
+        {
+            result.detect_s = t - scene.person.enter_s;
+        }
+    }
+    cmd_left = new_left;
+    cmd_right = new_right;
+
+    // Each track lags toward the speed its duty cycle asks for
+    float targets[2] = { cmd_left, cmd_right };
+    float tops[2] = { SIM_VMAX * scene.battery * (1 - scene.drag_left),
+                      SIM_VMAX * scene.battery };
+    float* speeds[2] = { &v_left, &v_right };
+    for (uint8_t n = 0; n < 2; n++)
+    {
+        float drive = (fabs (targets[n]) * 255 - SIM_DEAD_BAND)
+                      / (255 - SIM_DEAD_BAND);
+        float target = drive > 0 ? copysign (drive * tops[n], targets[n]) : 0;
+        *speeds[n] += (target - *speeds[n]) * dt / SIM_TAU;
+    }
+    enc_left += v_left * dt * SIM_COUNTS_PER_M;
+    enc_right += v_right * dt * SIM_COUNTS_PER_M;
+
+    float v = (v_left + v_right) / 2;
+    float new_heading = heading + (v_right - v_left) / SIM_TRACK_WIDTH * dt;
+    float nx = rx + v * cos (heading) * dt;
+    float ny = ry + v * sin (heading) * dt;
+
+    // The person walks until they reach the robot or a wall
+    if (present && contact_us == 0)
+    {
+        float limit = SIM_ROOM_HALF - SIM_PERSON_RADIUS;
+        px = constrain (px + scene.person.vx * dt, -limit, limit);
+        py = constrain (py + scene.person.vy * dt, -limit, limit);
+    }
+
+    // The robot can't drive through the person or the walls
+    float reach = SIM_ROBOT_HALF + SIM_PERSON_RADIUS;
+    float old_gap = hypot (px - rx, py - ry);
+    float new_gap = hypot (px - nx, py - ny);
+    bool blocked = present && new_gap < reach && new_gap < old_gap;
+    blocked = blocked || fabs (nx) > SIM_ROOM_HALF - SIM_ROBOT_HALF
+                      || fabs (ny) > SIM_ROOM_HALF - SIM_ROBOT_HALF;
+    if (!blocked)
+    {
+        result.path_m += hypot (nx - rx, ny - ry);
+        rx = nx;
+        ry = ny;
+    }
+    heading = new_heading;
+
+    // Front bumper touches the person if they're close and in front; its
+    // switch interrupts the processor as it closes
+    float bearing = atan2 (py - ry, px - rx) - heading;
+    bearing = atan2 (sin (bearing), cos (bearing));
+    bool was_pressed = front_pressed;
+    front_pressed = present && hypot (px - rx, py - ry) <= reach + 0.005
+                    && fabs (bearing) <= SIM_BUMPER_DEG * M_PI / 180;
+    if (front_pressed && !was_pressed)
+    {
+        host_pin_edge (SIM_FRONT, RISING);
+    }
+    if (front_pressed && contact_us == 0)
+    {
+        contact_us = step_us;
+        result.contact = true;
+        result.ttc_s = t - scene.person.enter_s;
+        result.impact_mps = v;
+    }
+
+    // Back bumper touches a wall behind the robot
+    float bx = rx - SIM_ROBOT_HALF * cos (heading);
+    float by = ry - SIM_ROBOT_HALF * sin (heading);
+    back_pressed = fabs (bx) >= SIM_ROOM_HALF - 0.01
+                   || fabs (by) >= SIM_ROOM_HALF - 0.01;
+
+    // The ToF sensor finishes a range every period; its pin only falls if
+    // the last range was read, since it stays low until then
+    if (tof_period_us != 0 && step_us >= tof_next_us)
+    {
+        tof_next_us += tof_period_us;
+        tof_measure (present);
+        if (!tof_pending)
+        {
+            tof_pending = true;
+            host_pin_edge (SIM_TOF_INT, FALLING);
+        }
+    }
+
+    // After contact, wait for the tracks to stop pushing forward
+    if (contact_us != 0 && cmd_left <= 0 && cmd_right <= 0)
+    {
+        result.bump_stop_ms = (step_us - contact_us) / 1000.0;
+        over = true;
+    }
+    if ((contact_us != 0 && t - contact_us / 1e6 > SIM_STOP_WAIT_S)
+        || t > scene.timeout_s)
+    {
+        result.bump_stop_ms = contact_us ? SIM_STOP_WAIT_S * 1000 : 0;
+        over = true;
+    }
+}
+
+
+/** @brief   Move the world forward to the given virtual time in 1 ms steps.
+ *  @details An interrupt raised by a step may touch the world again; it sees
+ *           the world as that step left it.
+ *  @param   now_us The virtual time, in microseconds
+ */
+void SimWorld::advance_to (uint64_t now_us)
+{
+    if (stepping)
+    {
+        return;
+    }
+    stepping = true;
+    while (!over && step_us + 1000 <= now_us)
+    {
+        step (0.001);
+        step_us += 1000;
+    }
+    stepping = false;
+}
+
+
+/** @brief   Measure the range from the ToF sensor to whatever is ahead.
+ *  @param   present @c true if the person has come into the room
+ */
+void SimWorld::tof_measure (bool present)
+{
+    float sx = rx + SIM_ROBOT_HALF * cos (heading);
+    float sy = ry + SIM_ROBOT_HALF * sin (heading);
+
+    // Distance to the wall straight ahead
+    float range = SIM_TOF_MAX * 10;
+    float c = cos (heading);
+    float s = sin (heading);
+    if (fabs (c) > 1e-6)
+    {
+        range = min (range, ((c > 0 ? SIM_ROOM_HALF : -SIM_ROOM_HALF) - sx) / c);
+    }
+    if (fabs (s) > 1e-6)
+    {
+        range = min (range, ((s > 0 ? SIM_ROOM_HALF : -SIM_ROOM_HALF) - sy) / s);
+    }
+
+    // The person, if any part of them is inside the cone
+    if (present)
+    {
+        float d = hypot (px - sx, py - sy);
+        float bearing = atan2 (py - sy, px - sx) - heading;
+        bearing = atan2 (sin (bearing), cos (bearing));
+        float half_w = d > SIM_PERSON_RADIUS ? asin (SIM_PERSON_RADIUS / d)
+                                             : M_PI / 2;
+        if (fabs (bearing) - half_w <= SIM_TOF_HALF_DEG * M_PI / 180)
+        {
+            range = min (range, max (d - SIM_PERSON_RADIUS, 0.0f));
+        }
+    }
+
+    if (range > SIM_TOF_MAX)
+    {
+        tof_mm = 0xFFFF;
+        tof_status = 4;                     // phase fail; nothing seen
+        return;
+    }
+    std::normal_distribution<float> noise (0, 1);
+    range += noise (rng) * (SIM_TOF_NOISE + SIM_TOF_NOISE_FRAC * range);
+    tof_mm = round (max (range, 0.0f) * 1000);
+    tof_status = 0;
+}
+
+
+/** @brief   Start the ToF sensor ranging back to back.
+ *  @details A period shorter than the time one range takes means the next
+ *           range starts as soon as the last one is done.
+ *  @param   period_ms Time between the starts of ranges, ms
+ */
+void SimWorld::tof_start (uint32_t period_ms)
+{
+    tof_period_us = max (period_ms, SIM_TOF_BUDGET_MS) * 1000ULL;
+    tof_next_us = step_us + tof_period_us;
+    tof_pending = false;
+}
+
+
+/** @brief   Take the ToF sensor's newest range, which lets its pin go high.
+ *  @param   p_status Where to put the range status, 0 if valid, 4 if nothing
+ *           was in range
+ *  @return  The range, mm
+ */
+uint16_t SimWorld::tof_read (uint8_t* p_status)
+{
+    tof_pending = false;
+    *p_status = tof_status;
+    return (tof_mm);
+}
+
+
+/** @brief   Get a track's encoder count.
+ *  @param   track 0 for the left track, 1 for the right
+ *  @return  The count, wrapped to 16 bits as the timer does
+ */
+uint16_t SimWorld::encoder_count (uint8_t track)
+{
+    double count = (track == 0 ? enc_left : enc_right);
+    return ((uint16_t)(int64_t)floor (count));
+}
+
+
+/** @brief   Draw what the thermal camera sees right now.
+ *  @param   p_pixels Array which gets 64 temperatures, deg C
+ */
+void SimWorld::render (float* p_pixels)
+{
+    std::normal_distribution<float> noise (0, 1);
+
+    float d = hypot (px - rx, py - ry);
+    float bearing = -(atan2 (py - ry, px - rx) - heading) * 180 / M_PI;
+    bearing = remainder (bearing, 360);
+    float half_w = atan2 (SIM_PERSON_RADIUS, d) * 180 / M_PI;
+    float top = atan2 (SIM_PERSON_HEIGHT - SIM_CAMERA_HEIGHT, d) * 180 / M_PI;
+    float bottom = atan2 (-SIM_CAMERA_HEIGHT, d) * 180 / M_PI;
+    bool present = (step_us / 1e6 >= scene.person.enter_s);
+
+    for (uint8_t col = 0; col < 8; col++)
+    {
+        float col_deg = (3.5 - col) * SIM_PIXEL_DEG;  // positive to the right
+        float wide = present ? overlap (bearing - half_w, bearing + half_w,
+                                        col_deg - SIM_PIXEL_DEG / 2,
+                                        col_deg + SIM_PIXEL_DEG / 2) : 0;
+        for (uint8_t row = 0; row < 8; row++)
+        {
+            float row_deg = (3.5 - row) * SIM_PIXEL_DEG;  // positive upward
+            float tall = overlap (bottom, top, row_deg - SIM_PIXEL_DEG / 2,
+                                  row_deg + SIM_PIXEL_DEG / 2);
+            bool edge = (row == 0 || row == 7 || col == 0 || col == 7);
+            uint8_t i = col * 8 + row;
+
+            float value = scene.ambient + offset[i]
+                          + wide * tall * (scene.person.temp - scene.ambient)
+                          + noise (rng) * (edge ? SIM_EDGE_NOISE : SIM_NOISE);
+            p_pixels[i] = round (value * 4) / 4;
+        }
+    }
+}
+
+
+/** @brief   Read the level of a limit switch pin.
+ *  @param   pin The pin to read
+ *  @return  @c HIGH if the switch on that pin is pressed
+ */
+int SimWorld::pin_read (uint32_t pin)
+{
+    if (pin == SIM_FRONT)
+    {
+        return (front_pressed ? HIGH : LOW);
+    }
+    if (pin == SIM_BACK)
+    {
+        return (back_pressed ? HIGH : LOW);
+    }
+    return (LOW);
+}
+
+
+void world_pin_write (uint32_t pin, uint32_t duty)
+{
+    world.advance_to (host_now_us ());
+    world.pin_write (pin, duty);
+}
+
+
+int world_pin_read (uint32_t pin)
+{
+    world.advance_to (host_now_us ());
+    return (world.pin_read (pin));
+}
+
+
+void world_thermal_frame (float* p_pixels)
+{
+    world.advance_to (host_now_us ());
+    world.render (p_pixels);
+}
+
+
+float world_thermistor (void)
+{
+    return (world.thermistor ());
+}
+
+
+void world_tof_start (uint32_t period_ms)
+{
+    world.advance_to (host_now_us ());
+    world.tof_start (period_ms);
+}
+
+
+bool world_tof_ready (void)
+{
+    world.advance_to (host_now_us ());
+    return (world.tof_ready ());
+}
+
+
+uint16_t world_tof_read (uint8_t* p_status)
+{
+    world.advance_to (host_now_us ());
+    return (world.tof_read (p_status));
+}
+
+
+uint16_t world_encoder_count (uint8_t track)
+{
+    world.advance_to (host_now_us ());
+    return (world.encoder_count (track));
+}
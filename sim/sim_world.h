@@ -0,0 +1,163 @@
+/** @file sim_world.h
+ *      This file contains the simulated world in which the Scroomba firmware
+ *      runs on the host: the tracked chassis, a room with a person in it, the
+ *      thermal camera's view of the room, the time of flight sensor, the
+ *      track encoders and the limit switches.
+ *
+ *  @brief Closed-loop robot, scene and sensor model for the host simulator.
+ */
+
+#ifndef _SIM_WORLD_H_
+#define _SIM_WORLD_H_
+
+#include <stdint.h>
+#include <random>
+#include "Arduino.h"
+#include "Adafruit_AMG88xx.h"
+
+/** @brief   A person, or anything else warm, standing or walking in the room.
+ *  @details Positions are in metres with x straight ahead of the robot's
+ *           starting pose and y to its left.
+ */
+struct SimPerson
+{
+    float x;                    ///< Starting position ahead, m
+    float y;                    ///< Starting position to the left, m
+    float vx;                   ///< Walking speed ahead, m/s
+    float vy;                   ///< Walking speed to the left, m/s
+    float temp;                 ///< Surface temperature, deg C
+    float enter_s;              ///< Time the person walks into the room, s
+};
+
+/** @brief   Everything which describes one simulated encounter.
+ */
+struct SimScenario
+{
+    const char* p_name;         ///< Name used on the report
+    float ambient;              ///< Room temperature, deg C
+    SimPerson person;           ///< The target
+    float battery;              ///< Track speed at full duty, as a fraction of a charged battery's
+    float drag_left;            ///< Fraction of the left track's speed lost to drag
+    float timeout_s;            ///< Give up after this long, s
+    uint32_t seed;              ///< Seed for the sensor noise
+};
+
+/** @brief   Numbers reported for one simulated encounter.
+ */
+struct SimMetrics
+{
+    bool contact;               ///< The front bumper reached the person
+    float ttc_s;                ///< Person entering to contact, s
+    float path_m;               ///< Distance driven by the robot, m
+    uint32_t churn;             ///< Number of times a track was told to reverse or stop
+    float impact_mps;           ///< Forward speed at contact, m/s
+    float bump_stop_ms;         ///< Contact until the tracks stop pushing, ms
+    uint32_t false_starts;      ///< Times the tracks started moving with nobody in the room
+    float detect_s;             ///< Person entering until the tracks first start, s; 0 if never
+};
+
+// The encounters which robot_sim and scenario_farm play
+extern const SimScenario scenarios[];
+
+// The number of encounters in @c scenarios
+extern const size_t NUM_SCENARIOS;
+
+
+/** @brief   The simulated robot and its surroundings.
+ *  @details The world is moved forward in 1 ms steps whenever the firmware
+ *           touches it, so the chassis always reacts to the pin states which
+ *           were in effect over each step.
+ */
+class SimWorld
+{
+    protected:
+        SimScenario scene;                  ///< What is being simulated
+        std::mt19937 rng;                   ///< Sensor noise source
+        float offset[AMG88xx_PIXEL_ARRAY_SIZE]; ///< Fixed pattern noise, deg C
+        uint8_t duty[HOST_NUM_PINS];        ///< Output level of each pin
+
+        uint64_t step_us;                   ///< Time the world has reached
+        float rx, ry, heading;              ///< Robot pose, m and radians
+        float v_left, v_right;              ///< Track speeds, m/s
+        float px, py;                       ///< Person position, m
+        float cmd_left, cmd_right;          ///< Track commands last step
+        double enc_left, enc_right;         ///< Encoder counts, not yet wrapped
+
+        uint64_t tof_period_us;             ///< ToF ranging period, 0 if off
+        uint64_t tof_next_us;               ///< Time the next range is done
+        bool tof_pending;                   ///< A range is waiting to be read
+        uint16_t tof_mm;                    ///< Newest range, mm
+        uint8_t tof_status;                 ///< Newest range status, 0 if valid
+
+        bool front_pressed;                 ///< Front bumper on the person
+        bool back_pressed;                  ///< Back bumper on a wall
+        uint64_t contact_us;                ///< Time of first contact
+        SimMetrics result;                  ///< Numbers gathered so far
+        bool over;                          ///< The encounter is finished
+        bool stepping;                      ///< In a step, maybe in an interrupt it raised
+
+        float track_command (uint32_t fwd, uint32_t rev, uint32_t en);
+        void step (float dt);
+        void tof_measure (bool present);
+
+    public:
+        // Set the world up for a scenario
+        void begin (const SimScenario& scenario);
+
+        // Move the world forward to the given virtual time
+        void advance_to (uint64_t now_us);
+
+        // Draw what the thermal camera sees
+        void render (float* p_pixels);
+
+        /** @brief   Set a pin's output level or PWM duty cycle.
+         */
+        void pin_write (uint32_t pin, uint32_t value)
+        {
+            duty[pin] = value;
+        }
+
+        // Read a limit switch pin
+        int pin_read (uint32_t pin);
+
+        // Start the ToF sensor ranging back to back
+        void tof_start (uint32_t period_ms);
+
+        /** @brief   Check whether the ToF sensor has a range waiting.
+         */
+        bool tof_ready (void)
+        {
+            return (tof_pending);
+        }
+
+        // Take the ToF sensor's newest range
+        uint16_t tof_read (uint8_t* p_status);
+
+        // Get a track's encoder count
+        uint16_t encoder_count (uint8_t track);
+
+        /** @brief   Get the thermal camera board temperature.
+         */
+        float thermistor (void)
+        {
+            return (scene.ambient + 3.0);
+        }
+
+        /** @brief   Check whether the encounter is over.
+         */
+        bool finished (void)
+        {
+            return (over);
+        }
+
+        /** @brief   Get the numbers gathered for the encounter.
+         */
+        const SimMetrics& metrics (void)
+        {
+            return (result);
+        }
+};
+
+extern SimWorld world;
+
+#endif // _SIM_WORLD_H_
@@ -44,6 +44,7 @@ BaseShare* BaseShare::p_newest = NULL;
  *  @param   p_name The name for the shared data item, in a character string
  */
 BaseShare::BaseShare (const char* p_name)
+    : puts (0), gets (0), blocks (0)
 {
     // Allocate some memory and save the share's name; trim it to 12 characters
     if (p_name != NULL)
@@ -63,12 +64,31 @@ BaseShare::BaseShare (const char* p_name)
 }
 
 
-/** @brief   Start the printout showing the status of all shared data items.
- *  @details This method begins printing out the status of all items in the 
- *           system's linked list of shared data items (queues, task shares, 
- *           and so on). The most recently created share's status is printed
- *           first, followed by the status of other shares in reverse order of
- *           creation. 
+/** @brief   Fill in the numbers which describe this item's condition.
+ *  @details This fills in what the base class knows: the name and counts.
+ *           Descendent classes override it to add their kind and fill.
+ *  @param   stats The structure to fill in
+ */
+void BaseShare::get_stats (ShareStats& stats)
+{
+    stats.kind = SHARE_KIND_SHARE;
+    stats.name = name;
+    stats.capacity = 1;
+    stats.fill = (puts != 0);
+    stats.max_full = stats.fill;
+    stats.puts = puts;
+    stats.gets = gets;
+    stats.blocks = blocks;
+}
+
+
+/** @brief   Print out the status of all shared data items.
+ *  @details This method prints out the status of all items in the system's 
+ *           linked list of shared data items (queues, task shares, and so
+ *           on). The most recently created share's status is printed first,
+ *           followed by the status of other shares in reverse order of
+ *           creation. The list is walked in a loop, so a long list doesn't
+ *           need a deep stack.
  *  @param   printer Pointer to a serial device on which to print
  */
 void print_all_shares (Print& printer)
@@ -76,5 +96,9 @@ void print_all_shares (Print& printer)
     printer.println ("Share/Queue     Type    Max. Full");
     printer.println ("-----------     ----    ---------");
 
-    BaseShare::p_newest->print_in_list (printer);
+    for (BaseShare* p_share = BaseShare::p_newest; p_share != NULL;
+         p_share = p_share->p_next)
+    {
+        p_share->print_in_list (printer);
+    }
 }
@@ -33,9 +33,40 @@
 #ifndef _BASESHARE_H_
 #define _BASESHARE_H_
 
+#include <atomic>
 #include <Arduino.h>
 
 
+/// What sort of shared data item a @c ShareStats describes
+enum ShareKind
+{
+    SHARE_KIND_SHARE,           ///< A @c Share holding one value
+    SHARE_KIND_QUEUE,           ///< A @c Queue
+    SHARE_KIND_FRAMES,          ///< A @c FrameQueue which drops on overflow
+    SHARE_KIND_SEQSHARE,        ///< A sequence counted @c SeqShare
+    SHARE_KIND_FLAGS            ///< A @c FlagSet of event group flags
+};
+
+
+/** @brief   Condition of one shared data item, as numbers rather than text.
+ *  @details Each count is copied on its own, so a put or get made while the
+ *           stats are being read may show up in one count and not yet in
+ *           another.
+ */
+struct ShareStats
+{
+    uint8_t kind;               ///< A @c ShareKind
+    const char* name;           ///< The item's name
+    uint16_t capacity;          ///< Items it can hold; 1 for a share
+    uint16_t fill;              ///< Items it holds now, or flags raised
+    uint16_t max_full;          ///< Most items it has held
+    uint32_t puts;              ///< Items put in
+    uint32_t gets;              ///< Items taken or read out
+    uint32_t blocks;            ///< Times a caller had to wait, or for a
+                                ///< @c SeqShare had to read again
+};
+
+
 /** @brief   Base class for classes that share data in a thread-safe manner 
  *           between tasks.
  *  @details This is a base class for classes which share data between tasks
@@ -69,6 +100,12 @@ class BaseShare
          */
         static BaseShare* p_newest;
 
+        // The counts are atomic because several tasks, and interrupts, may
+        // put into or take from one item at the same moment
+        std::atomic<uint32_t> puts;         ///< Items put in so far
+        std::atomic<uint32_t> gets;         ///< Items taken out so far
+        std::atomic<uint32_t> blocks;       ///< Waits for room or for data
+
     public:
         // Construct a base shared data item
         BaseShare (const char* p_name = NULL);
@@ -83,8 +120,56 @@ class BaseShare
          */
         virtual void print_in_list (Print& printer) = 0;
 
+        // Fill in the numbers which describe this item's condition
+        virtual void get_stats (ShareStats& stats);
+
         // }
         friend void print_all_shares (Print& printer);
+        friend class ShareIterator;
+};
+
+
+/** @brief   Walks the list of all shared data items, filling in their stats.
+ *  @details The walk is a loop which takes no memory beyond this object, so a
+ *           low priority task can sample every item now and then without
+ *           printing anything:
+ *           @code{.cpp}
+ *           ShareIterator items;
+ *           ShareStats stats;
+ *           while (items.next (stats))
+ *           {
+ *               // Use stats.name, stats.fill, ...
+ *           }
+ *           @endcode
+ *           Items are visited newest first, the same order in which
+ *           @c print_all_shares() lists them.
+ */
+class ShareIterator
+{
+    protected:
+        BaseShare* p_share;                 ///< The next item to visit
+
+    public:
+        /** @brief   Start a walk at the most recently created item.
+         */
+        ShareIterator (void) : p_share (BaseShare::p_newest)
+        {
+        }
+
+        /** @brief   Fill in the stats of the next item, if there is one.
+         *  @param   stats The structure to fill in
+         *  @return  @c true if @c stats was filled in, @c false at the end
+         */
+        bool next (ShareStats& stats)
+        {
+            if (p_share == NULL)
+            {
+                return (false);
+            }
+            p_share->get_stats (stats);
+            p_share = p_share->p_next;
+            return (true);
+        }
 };
 
 
@@ -0,0 +1,307 @@
+/** @file calib_store.cpp
+ *      This file contains functions which keep the thermal camera calibration
+ *      in the microcontroller's internal flash so it survives a power cycle.
+ *
+ *  @details The last few pages of the STM32L476's second flash bank are used
+ *           as a ring of calibration records. Each save goes into the slot
+ *           after the newest record, and a page is only erased when the ring
+ *           comes back around to it, which spreads erase cycles over all of
+ *           the pages. Because the program runs from the first bank, the
+ *           second bank can be written without stalling the other tasks.
+ *           Records are checked with a magic number and a CRC, so a save
+ *           which was cut off by a power loss is simply ignored on the next
+ *           boot. The double word holding the magic number is programmed
+ *           last, so a record with good magic was written out in full.
+ *
+ *           A double word whose programming was cut off can also fail the
+ *           flash's ECC check, and reading it raises an NMI. At every boot
+ *           that would fault before the watchdog could be fed, and the
+ *           robot would reset forever. So records are read one double word
+ *           at a time through @c calib_readable(), and @c NMI_Handler()
+ *           clears the error and lets the read carry on when it came from
+ *           there. A record with an unreadable double word is ignored.
+ *
+ *           A save is skipped when the newest record already holds nearly
+ *           the same calibration, since recalibrating in the same room
+ *           would otherwise wear the flash for nothing. On anything other
+ *           than an STM32L4 the functions do nothing and the decoder always
+ *           calibrates from scratch.
+ */
+
+#include "calib_store.h"
+
+const uint32_t CALIB_MAGIC = 0x53435231;    ///< "SCR1" marks a good record
+const uint8_t CALIB_PAGES = 4;              ///< Flash pages in the ring
+const uint16_t CALIB_PAGE_SIZE = 2048;      ///< Bytes in an STM32L4 page
+
+/// Records which fit in each page; records never straddle two pages
+const uint8_t CALIB_PER_PAGE = CALIB_PAGE_SIZE / sizeof (CalibRecord);
+
+/// Total number of record slots in the ring
+const uint8_t CALIB_SLOTS = CALIB_PAGES * CALIB_PER_PAGE;
+
+
+#if (defined STM32L4xx)
+
+/// First page of the ring, counted from the start of flash bank 2
+const uint32_t CALIB_FIRST_PAGE = FLASH_BANK_SIZE / CALIB_PAGE_SIZE - CALIB_PAGES;
+
+/// Set while @c calib_readable() reads, so the NMI knows the error is expected
+static volatile bool ecc_probing = false;
+
+/// Set by the NMI when a read by @c calib_readable() failed its ECC check
+static volatile bool ecc_failed = false;
+
+
+/** @brief   Handle a non-maskable interrupt.
+ *  @details A double ECC error in flash raises the NMI. If it came from
+ *           @c calib_readable(), the error is cleared and noted and the
+ *           program carries on. Anything else is a real fault, so this
+ *           waits for the watchdog, as the default handler would.
+ */
+extern "C" void NMI_Handler (void)
+{
+    if (ecc_probing && (FLASH->ECCR & FLASH_ECCR_ECCD))
+    {
+        FLASH->ECCR |= FLASH_ECCR_ECCD;         // writing 1 clears the error
+        ecc_failed = true;
+        return;
+    }
+    for (;;)
+    {
+    }
+}
+
+
+/** @brief   Check that every double word of a record passes the ECC check.
+ *  @details Each double word is read with the NMI ready to catch an ECC
+ *           error. The barriers make sure the NMI, if there is one, has
+ *           been taken before the result is looked at.
+ *  @param   p_rec Pointer to the record to read
+ *  @return  @c true if the whole record can be read safely
+ */
+static bool calib_readable (const CalibRecord* p_rec)
+{
+    const volatile uint64_t* p_word = (const volatile uint64_t*)p_rec;
+
+    FLASH->ECCR |= FLASH_ECCR_ECCD;
+    ecc_failed = false;
+    ecc_probing = true;
+    for (uint16_t i = 0; !ecc_failed && i < sizeof (CalibRecord) / 8; i++)
+    {
+        (void)p_word[i];
+        __DSB ();
+        __ISB ();
+    }
+    ecc_probing = false;
+
+    return (!ecc_failed);
+}
+
+
+/** @brief   Compute the CRC-32 of a block of memory.
+ *  @details A bitwise CRC is slow but tiny, and it only runs over a few
+ *           records at boot and one record when saving.
+ *  @param   p_data Pointer to the first byte to check
+ *  @param   length Number of bytes to check
+ *  @return  The CRC-32 (IEEE 802.3 polynomial) of the data
+ */
+static uint32_t calib_crc (const uint8_t* p_data, uint16_t length)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        crc ^= p_data[i];
+        for (uint8_t bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return (~crc);
+}
+
+
+/** @brief   Check whether a record is complete and undamaged.
+ *  @param   p_rec Pointer to the record to check
+ *  @return  @c true if the record can be used, @c false if not
+ */
+static bool calib_valid (const CalibRecord* p_rec)
+{
+    return (calib_readable (p_rec)
+            && p_rec->magic == CALIB_MAGIC
+            && p_rec->crc == calib_crc ((const uint8_t*)p_rec,
+                                        offsetof (CalibRecord, crc)));
+}
+
+
+/** @brief   Check whether two sets of values are all close.
+ *  @param   p_a The first set of values
+ *  @param   p_b The second set of values
+ *  @param   count How many values are in each set
+ *  @return  @c true if no pair differs by more than @c CALIB_RESAVE_C
+ */
+static bool calib_close (const float* p_a, const float* p_b, uint8_t count)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (fabsf (p_a[i] - p_b[i]) > CALIB_RESAVE_C)
+        {
+            return (false);
+        }
+    }
+    return (true);
+}
+
+
+/** @brief   Find where a record slot is in memory.
+ *  @param   slot The slot number, from 0 to @c CALIB_SLOTS - 1
+ *  @return  Pointer to the record in flash
+ */
+static const CalibRecord* calib_slot (uint8_t slot)
+{
+    uint32_t address = FLASH_BASE + FLASH_BANK_SIZE
+                       + (CALIB_FIRST_PAGE + slot / CALIB_PER_PAGE) * CALIB_PAGE_SIZE
+                       + (slot % CALIB_PER_PAGE) * sizeof (CalibRecord);
+
+    return ((const CalibRecord*)address);
+}
+
+
+/** @brief   Find the slot holding the newest good record.
+ *  @param   newest Reference to a variable which gets the slot number
+ *  @return  @c true if a good record was found, @c false if none were
+ */
+static bool calib_find_newest (uint8_t& newest)
+{
+    bool found = false;
+
+    for (uint8_t slot = 0; slot < CALIB_SLOTS; slot++)
+    {
+        const CalibRecord* p_rec = calib_slot (slot);
+        if (calib_valid (p_rec)
+            && (!found || p_rec->sequence > calib_slot (newest)->sequence))
+        {
+            newest = slot;
+            found = true;
+        }
+    }
+    return (found);
+}
+
+#endif // STM32L4xx
+
+
+/** @brief   Load the most recently saved calibration.
+ *  @param   ambient Array of 64 floats which gets each pixel's mean
+ *  @param   limit Array of 64 floats which gets each pixel's detection limit
+ *  @param   thermistor Reference to a variable which gets the sensor board
+ *           temperature at the time the calibration was taken
+ *  @return  @c true if a calibration was loaded, @c false if there wasn't one
+ */
+bool calib_load (float* ambient, float* limit, float& thermistor)
+{
+#if (defined STM32L4xx)
+    uint8_t newest;
+
+    if (calib_find_newest (newest))
+    {
+        const CalibRecord* p_rec = calib_slot (newest);
+        memcpy (ambient, p_rec->ambient, sizeof (p_rec->ambient));
+        memcpy (limit, p_rec->limit, sizeof (p_rec->limit));
+        thermistor = p_rec->thermistor;
+        return (true);
+    }
+#else
+    (void)ambient;
+    (void)limit;
+    (void)thermistor;
+#endif
+    return (false);
+}
+
+
+/** @brief   Save a calibration into the next record slot in the ring.
+ *  @details Nothing is written if the newest record is within
+ *           @c CALIB_RESAVE_C of this calibration in every value. Otherwise,
+ *           if the slot is the first one on its page, the page is erased
+ *           first. The double word with the magic number is programmed
+ *           after the rest of the record. Erasing and programming take
+ *           roughly 30 ms, during which the calling task is busy but other
+ *           tasks keep running.
+ *  @param   ambient Array of 64 pixel means
+ *  @param   limit Array of 64 pixel detection limits
+ *  @param   thermistor The sensor board temperature, in degrees C
+ *  @return  @c true if the flash holds this calibration, whether it was
+ *           written now or was already there
+ */
+bool calib_save (const float* ambient, const float* limit, float thermistor)
+{
+#if (defined STM32L4xx)
+    CalibRecord rec;
+    uint8_t slot;
+
+    if (calib_find_newest (slot))
+    {
+        const CalibRecord* p_newest = calib_slot (slot);
+        if (fabsf (p_newest->thermistor - thermistor) <= CALIB_RESAVE_C
+            && calib_close (p_newest->ambient, ambient, AMG88xx_PIXEL_ARRAY_SIZE)
+            && calib_close (p_newest->limit, limit, AMG88xx_PIXEL_ARRAY_SIZE))
+        {
+            return (true);
+        }
+        rec.sequence = p_newest->sequence + 1;
+        slot = (slot + 1) % CALIB_SLOTS;
+    }
+    else
+    {
+        rec.sequence = 1;
+        slot = 0;
+    }
+
+    rec.magic = CALIB_MAGIC;
+    rec.saved_ms = millis ();
+    rec.thermistor = thermistor;
+    memcpy (rec.ambient, ambient, sizeof (rec.ambient));
+    memcpy (rec.limit, limit, sizeof (rec.limit));
+    rec.crc = calib_crc ((const uint8_t*)&rec, offsetof (CalibRecord, crc));
+    rec.spare = 0xFFFFFFFF;
+
+    HAL_FLASH_Unlock ();
+    __HAL_FLASH_CLEAR_FLAG (FLASH_FLAG_ALL_ERRORS);
+
+    bool ok = true;
+    if (slot % CALIB_PER_PAGE == 0)
+    {
+        FLASH_EraseInitTypeDef erase;
+        uint32_t bad_page;
+
+        erase.TypeErase = FLASH_TYPEERASE_PAGES;
+        erase.Banks = FLASH_BANK_2;
+        erase.Page = CALIB_FIRST_PAGE + slot / CALIB_PER_PAGE;
+        erase.NbPages = 1;
+        ok = (HAL_FLASHEx_Erase (&erase, &bad_page) == HAL_OK);
+    }
+
+    // The magic number is in double word 0, which goes last, so a record
+    // only looks written once everything else is
+    const uint64_t* p_src = (const uint64_t*)&rec;
+    const uint16_t words = sizeof (rec) / 8;
+    uint32_t address = (uint32_t)calib_slot (slot);
+    for (uint16_t n = 1; ok && n <= words; n++)
+    {
+        uint16_t i = n % words;
+        ok = (HAL_FLASH_Program (FLASH_TYPEPROGRAM_DOUBLEWORD, address + 8 * i,
+                                 p_src[i]) == HAL_OK);
+    }
+
+    HAL_FLASH_Lock ();
+
+    return (ok && calib_valid (calib_slot (slot)));
+#else
+    (void)ambient;
+    (void)limit;
+    (void)thermistor;
+    return (false);
+#endif
+}
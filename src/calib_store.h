@@ -0,0 +1,41 @@
+/** @file calib_store.h
+ *      This file contains functions which keep the thermal camera calibration
+ *      in the microcontroller's internal flash so it survives a power cycle.
+ *
+ *  @brief Wear-levelled flash storage of the thermal decoder's calibration matrix.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _CALIB_STORE_H_
+#define _CALIB_STORE_H_
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <Adafruit_AMG88xx.h>
+
+/// Change in any saved value, in degrees C, which is worth a new record
+const float CALIB_RESAVE_C = 0.5;
+
+/** @brief   One saved calibration as it is laid out in flash.
+ *  @details The size is a multiple of 8 bytes because the STM32L4 flash is
+ *           programmed one 64-bit double word at a time.
+ */
+struct CalibRecord
+{
+    uint32_t magic;                             ///< Marks a written record; programmed last
+    uint32_t sequence;                          ///< Newest record has the highest
+    uint32_t saved_ms;                          ///< Uptime when it was saved
+    float thermistor;                           ///< Sensor board temperature, deg C
+    float ambient[AMG88xx_PIXEL_ARRAY_SIZE];    ///< Mean of each pixel
+    float limit[AMG88xx_PIXEL_ARRAY_SIZE];      ///< Detection limit of each pixel
+    uint32_t crc;                               ///< CRC-32 of everything above
+    uint32_t spare;                             ///< Pads to a double word
+};
+
+// Load the most recently saved calibration, if there is a good one
+bool calib_load (float* ambient, float* limit, float& thermistor);
+
+// Save a calibration into the next free record
+bool calib_save (const float* ambient, const float* limit, float thermistor);
+
+#endif // _CALIB_STORE_H_
@@ -0,0 +1,154 @@
+/** @file console_log.cpp
+ *      This file contains a console log which lets any task print a message
+ *      without waiting for the serial port.
+ *
+ *  @details At 115200 baud a 20 character line takes almost 2 ms to send, and
+ *           @c Serial.println() makes the calling task wait for it once the
+ *           serial driver's small buffer is full. When that task is mastermind
+ *           or the decoder, the robot's reactions wait too.
+ *
+ *           The ring here is a bounded queue after Dmitry Vyukov's design.
+ *           Every slot carries a sequence number which says whose turn it is:
+ *           a writer claims the next free slot with one compare and swap on
+ *           the write position, formats its message straight into the slot,
+ *           then publishes it by advancing the slot's sequence. A task which
+ *           is preempted part way through only holds up its own slot, and no
+ *           task ever takes a lock or waits, so there is nothing for a higher
+ *           priority task to get stuck behind. Only @c task_log reads slots.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <atomic>
+#include <PrintStream.h>
+#if (defined STM32L4xx || defined STM32F4xx)
+    #include <STM32FreeRTOS.h>
+#endif
+#include "FreeRTOS.h"
+#include "console_log.h"
+
+/** @brief   One message waiting in the ring.
+ */
+struct LogSlot
+{
+    std::atomic<uint32_t> sequence;     ///< Equals the position when free,
+                                        ///< the position + 1 when full
+    uint32_t ms;                        ///< Time the message was logged
+    char text[LOG_LINE_SIZE];           ///< The formatted message
+};
+
+static LogSlot log_ring[LOG_SLOTS];             ///< The messages
+static std::atomic<uint32_t> write_pos (0);     ///< Next position to claim
+static uint32_t read_pos = 0;                   ///< Next position to print
+static std::atomic<uint32_t> dropped (0);       ///< Messages lost when full
+
+
+/** @brief   Set up the ring so every slot is free.
+ *  @details This must be called in @c setup() before any task runs.
+ */
+void log_begin (void)
+{
+    for (uint8_t n = 0; n < LOG_SLOTS; n++)
+    {
+        log_ring[n].sequence.store (n, std::memory_order_relaxed);
+    }
+    write_pos.store (0, std::memory_order_relaxed);
+    read_pos = 0;
+}
+
+
+/** @brief   Queue a formatted message to be printed.
+ *  @details The message is formatted by the calling task, which costs a few
+ *           microseconds, but it never waits for the serial port or for
+ *           another task. A newline is added when the message is printed.
+ *  @param   format A @c printf style format, followed by its arguments
+ *  @return  @c true if the message was queued, @c false if it was dropped
+ */
+bool log_print (const char* format, ...)
+{
+    uint32_t pos = write_pos.load (std::memory_order_relaxed);
+    LogSlot* p_slot;
+
+    // Claim a slot; another writer may beat us to it, so try the next one
+    for (;;)
+    {
+        p_slot = &log_ring[pos % LOG_SLOTS];
+        int32_t lag = (int32_t)(p_slot->sequence.load
+                                (std::memory_order_acquire) - pos);
+        if (lag == 0)
+        {
+            if (write_pos.compare_exchange_weak (pos, pos + 1,
+                                                 std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (lag < 0)           // the slot hasn't been printed yet
+        {
+            dropped.fetch_add (1, std::memory_order_relaxed);
+            return (false);
+        }
+        else
+        {
+            pos = write_pos.load (std::memory_order_relaxed);
+        }
+    }
+
+    va_list args;
+    va_start (args, format);
+    vsnprintf (p_slot->text, LOG_LINE_SIZE, format, args);
+    va_end (args);
+    p_slot->ms = millis ();
+
+    p_slot->sequence.store (pos + 1, std::memory_order_release);
+    return (true);
+}
+
+
+/** @brief   Get the number of messages dropped because the ring was full.
+ *  @return  The number of dropped messages since power-up
+ */
+uint32_t log_dropped (void)
+{
+    return (dropped.load (std::memory_order_relaxed));
+}
+
+
+/** @brief   Task which prints queued messages on the serial port.
+ *  @details This is the only task which waits on the serial port. Each
+ *           message is printed after the time it was logged, and a note is
+ *           printed whenever messages have been dropped since the last one.
+ *  @param   p_params A pointer to function parameters which we don't use.
+ */
+void task_log (void* p_params)
+{
+    (void)p_params;            // Does nothing but shut up a compiler warning
+
+    uint32_t reported = 0;     // dropped messages already noted
+
+    for (;;)
+    {
+        LogSlot& slot = log_ring[read_pos % LOG_SLOTS];
+
+        if (slot.sequence.load (std::memory_order_acquire) == read_pos + 1)
+        {
+            Serial.printf ("%7lu ", (unsigned long)slot.ms);
+            Serial.println (slot.text);
+            slot.sequence.store (read_pos + LOG_SLOTS,
+                                 std::memory_order_release);
+            read_pos++;
+        }
+        else
+        {
+            uint32_t lost = log_dropped ();
+            if (lost != reported)
+            {
+                Serial.printf ("%7lu log dropped %lu messages\n",
+                               (unsigned long)millis (),
+                               (unsigned long)(lost - reported));
+                reported = lost;
+            }
+            vTaskDelay (10);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+/** @file console_log.h
+ *      This file contains a console log which lets any task print a message
+ *      without waiting for the serial port.
+ *
+ *  @brief Lock-free message ring drained to @c Serial by a low priority task.
+ *
+ *  @details Call @c log_print() with a @c printf style format wherever a task
+ *           used to call @c Serial.println(). The message is formatted into a
+ *           slot of a shared ring and @c task_log prints it later. If the ring
+ *           is full the message is dropped and counted, and the log task says
+ *           how many were lost. Floating point formats need the
+ *           @c -u @c _printf_float link flag on the Nucleo.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _CONSOLE_LOG_H_
+#define _CONSOLE_LOG_H_
+
+#include <Arduino.h>
+
+/// Number of messages the ring holds
+const uint8_t LOG_SLOTS = 16;
+
+/// Longest message in characters; longer ones are cut short
+const uint8_t LOG_LINE_SIZE = 64;
+
+// Set up the ring; call in setup() before any task runs
+void log_begin (void);
+
+// Queue a formatted message to be printed, dropping it if the ring is full
+bool log_print (const char* format, ...)
+    __attribute__ ((format (printf, 1, 2)));
+
+// Number of messages dropped because the ring was full
+uint32_t log_dropped (void);
+
+// The task which prints queued messages on the serial port
+void task_log (void* p_params);
+
+#endif // _CONSOLE_LOG_H_
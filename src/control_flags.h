@@ -0,0 +1,35 @@
+/** @file control_flags.h
+ *      This file contains the flags which the limit switch tasks, mastermind
+ *      and the thermal decoder raise for each other.
+ *
+ *  @brief  On/off control flags shared by mastermind and the tasks it listens to, kept in one event group.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _CONTROL_FLAGS_H_
+#define _CONTROL_FLAGS_H_
+
+#include "flagset.h"
+
+/** @brief   The control flags, each one bit of the @c control_flags set.
+ */
+enum ControlFlag : uint32_t
+{
+    FLAG_NONE = 0,              ///< No flags
+    FLAG_FRONT_BUMP = 1 << 0,   ///< The front limit switch was pressed
+    FLAG_BACK_BUMP = 1 << 1,    ///< The back limit switch was pressed
+    FLAG_STOP_HUNT = 1 << 2,    ///< The thermal decoder should stop hunting
+    FLAG_RESET = 1 << 3         ///< The thermal decoder should start over
+};
+
+/** @brief   Combine control flags, to set, clear or wait on them together.
+ *  @param   a Some flags
+ *  @param   b Some more flags
+ *  @return  All of the flags
+ */
+inline ControlFlag operator| (ControlFlag a, ControlFlag b)
+{
+    return ((ControlFlag)((uint32_t)a | (uint32_t)b));
+}
+
+#endif // _CONTROL_FLAGS_H_
@@ -0,0 +1,68 @@
+/** @file cycle_count.h
+ *      This file contains a processor cycle counter for timing short pieces of
+ *      code, such as one queue operation or one pass of a task loop.
+ *
+ *  @details On the STM32 this reads the Cortex-M4 DWT cycle counter, which
+ *           counts every CPU clock and costs one load to read. On a PC, for
+ *           the simulator and the benchmarks, the x86 time stamp counter is
+ *           used, or @c std::chrono::steady_clock nanoseconds if there isn't
+ *           one. The counter is 32 bits and wraps after about 54 seconds at
+ *           80 MHz, so differences must be taken with unsigned arithmetic.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _CYCLE_COUNT_H_
+#define _CYCLE_COUNT_H_
+
+#include <Arduino.h>
+
+#if (defined STM32L4xx || defined STM32F4xx)
+
+/** @brief   Turn on the DWT cycle counter.
+ *  @details The counter is off after reset unless a debugger turned it on.
+ */
+inline void cycle_count_begin (void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/** @brief   Read the cycle counter.
+ *  @return  The number of CPU clocks since the counter was started
+ */
+inline uint32_t cycle_count (void)
+{
+    return (DWT->CYCCNT);
+}
+
+#elif (defined __x86_64__ || defined __i386__)
+
+#include <x86intrin.h>
+
+inline void cycle_count_begin (void)
+{
+}
+
+inline uint32_t cycle_count (void)
+{
+    return ((uint32_t)__rdtsc ());
+}
+
+#else
+
+#include <chrono>
+
+inline void cycle_count_begin (void)
+{
+}
+
+inline uint32_t cycle_count (void)
+{
+    return ((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>
+            (std::chrono::steady_clock::now ().time_since_epoch ()).count ());
+}
+
+#endif
+
+#endif // _CYCLE_COUNT_H_
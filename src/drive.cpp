@@ -0,0 +1,279 @@
+/** @file drive.cpp
+ *      This file contains the speed control for the two tracks, which turns
+ *      commanded track speeds and distances into duties for the ramp.
+ *
+ *  @details A fixed duty drives the tracks at a speed which depends on the
+ *           battery and the floor, so the same command goes slower on carpet
+ *           or late in a run, and one track often runs faster than the other.
+ *           Here the motor task asks for a speed for each track instead, and
+ *           a timer interrupt running at @c DRIVE_RATE_HZ holds the tracks at
+ *           those speeds.
+ *
+ *           Each pass reads both encoder counters, adds the change since the
+ *           last pass to each track's travel, and smooths the change into an
+ *           estimate of the track's speed. A PI loop per track then sets the
+ *           duty: it starts from the duty which would give the speed asked
+ *           for on a good battery, and adds a part for the error now and a
+ *           part for the error summed over time, which over a few tenths of
+ *           a second makes up for a weak battery or a dragging track. The sum
+ *           stops growing while the duty is at full, so a track which can't
+ *           keep up doesn't overshoot once it can. The error is taken from
+ *           the speed a good track would have reached by now, easing toward
+ *           the speed asked for over @c DRIVE_TAU, rather than from the speed
+ *           asked for itself; otherwise each new command would kick the duty
+ *           far past where it settles, and turns, which mastermind steers
+ *           from frames 100 ms apart, would overshoot. The duties go to the
+ *           ramp in motor_ramp.cpp, which still limits how fast they change.
+ *
+ *           A command may also give a distance. Once the two tracks have gone
+ *           that far on average, the loop stops them by itself and counts the
+ *           move as done, so a task can move the robot a set distance without
+ *           guessing how long that takes.
+ *
+ *           The travel, speeds and targets are published in @c drive_state
+ *           every pass for any task to read.
+ */
+
+#include "drive.h"
+#include "encoder.h"
+#include "motor_ramp.h"
+#if !(defined STM32L4xx || defined STM32F4xx)
+    #include "host.h"
+#endif
+
+extern SeqShare<DriveState> drive_state; ///<Track travel and speeds, written by the speed loop
+
+/** @brief   The speed loop of one track.
+ */
+struct DriveTrack
+{
+    uint16_t last_count;        ///< Encoder count at the last pass
+    int32_t counts;             ///< Travel since power-up, counts
+    float speed;                ///< Estimated speed, m/s
+    float target;               ///< Speed asked for, m/s
+    float reference;            ///< Speed a good track would be at by now, m/s
+    float integral;             ///< Speed error summed over time, m
+};
+
+/// Speed loops of the left and right tracks, in @c EncoderTrack order
+static DriveTrack tracks[ENCODER_NUM_TRACKS];
+
+static float move_distance = 0;                     ///< Length of the move under way, counts; 0 if none
+static int32_t move_start[ENCODER_NUM_TRACKS];      ///< Travel of each track when the move began
+static uint16_t moves_done = 0;                     ///< Distance moves finished
+
+
+/** @brief   Work out the duty which drives a track at a speed on a good
+ *           battery.
+ *  @param   speed The speed, m/s
+ *  @return  The duty, -255 to 255, or 0 for no speed
+ */
+static float drive_feedforward (float speed)
+{
+    if (speed == 0)
+    {
+        return (0);
+    }
+    float duty = RAMP_DEAD_BAND + fabs(speed) / DRIVE_FULL_SPEED * (255 - RAMP_DEAD_BAND);
+    return (copysign(duty, speed));
+}
+
+
+/** @brief   Stop both speed loops and finish any move.
+ *  @details A move which is cut short counts as done, so nothing waits for
+ *           it forever. This must be called with interrupts masked.
+ */
+static void drive_halt (void)
+{
+    for (DriveTrack& track : tracks)
+    {
+        track.target = 0;
+        track.reference = 0;
+        track.integral = 0;
+    }
+    if (move_distance > 0)
+    {
+        move_distance = 0;
+        moves_done++;
+    }
+}
+
+
+/** @brief   Interrupt which measures each track and sets its duty.
+ */
+static void drive_isr (void)
+{
+    const float dt = 1.0 / DRIVE_RATE_HZ;
+
+    for (uint8_t n = 0; n < ENCODER_NUM_TRACKS; n++)
+    {
+        DriveTrack& track = tracks[n];
+        uint16_t count = encoder_count(n);
+        int16_t delta = (int16_t)(count - track.last_count);
+        track.last_count = count;
+        track.counts += delta;
+        track.speed += DRIVE_SPEED_FILTER * (delta * DRIVE_RATE_HZ / ENCODER_COUNTS_PER_M - track.speed);
+    }
+
+    if (move_distance > 0)
+    {
+        float travel = (abs(tracks[ENCODER_LEFT].counts - move_start[ENCODER_LEFT])
+                        + abs(tracks[ENCODER_RIGHT].counts - move_start[ENCODER_RIGHT])) / 2.0;
+        if (travel >= move_distance)
+        {
+            drive_halt();
+        }
+    }
+
+    int16_t duty[ENCODER_NUM_TRACKS];
+    for (uint8_t n = 0; n < ENCODER_NUM_TRACKS; n++)
+    {
+        DriveTrack& track = tracks[n];
+        track.reference += (track.target - track.reference) * dt / DRIVE_TAU;
+        if (track.target == 0)
+        {
+            duty[n] = 0;
+            continue;
+        }
+
+        // Only sum the error once the speed should have settled, so the sum
+        // learns how far off the battery and floor are rather than how the
+        // ramp lags, and only while the duty has room to act on it
+        float error = track.reference - track.speed;
+        float base = drive_feedforward(track.target) + DRIVE_KP * error;
+        float out = base + DRIVE_KI * (track.integral + error * dt);
+        bool settled = fabs(track.target - track.reference) < DRIVE_SETTLED;
+        if (settled && (fabs(out) < 255 || out * error < 0))
+        {
+            track.integral += error * dt;
+        }
+        duty[n] = constrain(lround(base + DRIVE_KI * track.integral), -255L, 255L);
+    }
+    ramp_set_target(duty[ENCODER_LEFT], duty[ENCODER_RIGHT]);
+
+    DriveState state;
+    state.ms = millis();
+    state.left_m = tracks[ENCODER_LEFT].counts / ENCODER_COUNTS_PER_M;
+    state.right_m = tracks[ENCODER_RIGHT].counts / ENCODER_COUNTS_PER_M;
+    state.left_mps = tracks[ENCODER_LEFT].speed;
+    state.right_mps = tracks[ENCODER_RIGHT].speed;
+    state.left_target = tracks[ENCODER_LEFT].reference;
+    state.right_target = tracks[ENCODER_RIGHT].reference;
+    state.moves_done = moves_done;
+    drive_state.put(state);
+}
+
+
+#if (defined STM32L4xx || defined STM32F4xx)
+
+// The L476 has a second basic timer for this; some F4 parts don't
+#ifdef TIM7
+    #define DRIVE_TIMER TIM7
+#else
+    #define DRIVE_TIMER TIM10
+#endif
+
+/** @brief   Start the timer which runs the speed loop interrupt.
+ */
+static void drive_timer_start (void)
+{
+    HardwareTimer* p_timer = new HardwareTimer (DRIVE_TIMER);
+    p_timer->setOverflow (DRIVE_RATE_HZ, HERTZ_FORMAT);
+    p_timer->attachInterrupt (drive_isr);
+    p_timer->resume ();
+}
+
+#else
+
+/** @brief   Start the simulated kernel's timer which runs the speed loop
+ *           interrupt.
+ */
+static void drive_timer_start (void)
+{
+    host_timer_start (1000000 / DRIVE_RATE_HZ, drive_isr);
+}
+
+#endif // STM32L4xx || STM32F4xx
+
+
+/** @brief   Start counting the encoders and running the speed loop.
+ *  @details This must be called after @c ramp_begin(), since the loop sets
+ *           the ramp's targets.
+ */
+void drive_begin (void)
+{
+    encoder_begin();
+    for (uint8_t n = 0; n < ENCODER_NUM_TRACKS; n++)
+    {
+        tracks[n].last_count = encoder_count(n);
+    }
+    drive_timer_start();
+}
+
+
+/** @brief   Drive each track at a speed, optionally for a set distance.
+ *  @details A track whose direction changes starts its error sum again. A
+ *           new command replaces any move under way; that move doesn't count
+ *           as done. The ramp heads for the new duties at once, without
+ *           waiting up to a pass of the loop.
+ *  @param   left_mps Speed of the left track, m/s, negative backward
+ *  @param   right_mps Speed of the right track, m/s, negative backward
+ *  @param   distance_m Average distance for the tracks to go before they
+ *           stop by themselves, m, or 0 to keep going
+ */
+void drive_set_speed (float left_mps, float right_mps, float distance_m)
+{
+    const float targets[ENCODER_NUM_TRACKS] = {left_mps, right_mps};
+    int16_t duty[ENCODER_NUM_TRACKS];
+
+    portENTER_CRITICAL();
+    for (uint8_t n = 0; n < ENCODER_NUM_TRACKS; n++)
+    {
+        DriveTrack& track = tracks[n];
+        if ((targets[n] > 0) != (track.target > 0) || (targets[n] < 0) != (track.target < 0))
+        {
+            track.integral = 0;
+        }
+        track.target = targets[n];
+        move_start[n] = track.counts;
+        duty[n] = track.target == 0 ? 0 : constrain(lround(drive_feedforward(track.target)
+                                                           + DRIVE_KI * track.integral), -255L, 255L);
+    }
+    move_distance = distance_m * ENCODER_COUNTS_PER_M;
+
+    // Start the ramp now rather than at the loop's next pass
+    ramp_set_target(duty[ENCODER_LEFT], duty[ENCODER_RIGHT]);
+    portEXIT_CRITICAL();
+}
+
+
+/** @brief   Stop both tracks at once, skipping the ramp.
+ *  @details The speed loops are stopped first so they don't start the ramp
+ *           again, then @c ramp_stop_now() drives the pins low. This may be
+ *           called from a task or an interrupt.
+ */
+void drive_stop_now (void)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    drive_halt();
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+    ramp_stop_now();
+}
+
+
+/** @brief   Stop both tracks as fast as possible, from the front bumper's
+ *           interrupt.
+ *  @details This is @c drive_stop_now() with @c ramp_cut_now() in place of
+ *           @c ramp_stop_now(), so it is quick enough for an interrupt but
+ *           leaves the pins for a task to set up again with
+ *           @c drive_stop_now() before the tracks can be driven.
+ */
+void drive_cut_now (void)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    drive_halt();
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+
+    ramp_cut_now();
+}
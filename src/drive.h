@@ -0,0 +1,71 @@
+/** @file drive.h
+ *      This file contains the speed control for the two tracks, which turns
+ *      commanded track speeds and distances into duties for the ramp.
+ *
+ *  @brief  Encoder odometry, velocity estimates and a PI speed loop per track, run by a 100 Hz timer interrupt.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _DRIVE_H_
+#define _DRIVE_H_
+
+#include <Arduino.h>
+#if (defined STM32L4xx || defined STM32F4xx)
+    #include <STM32FreeRTOS.h>
+#endif
+#include "FreeRTOS.h"
+#include "seqshare.h"
+
+/// How often the speed loop runs
+const uint16_t DRIVE_RATE_HZ = 100;
+
+/// Track speed at full duty with a charged battery on a hard floor, m/s;
+/// the loop starts from the duty this suggests and corrects from there
+const float DRIVE_FULL_SPEED = 0.8;
+
+/// Time the tracks take to get most of the way to a new speed, s; the loop
+/// expects them to take this long rather than pushing them to be faster
+const float DRIVE_TAU = 0.12;
+
+/// Duty added per m/s the track is too slow
+const float DRIVE_KP = 20;
+
+/// Duty added per second per m/s the track has been too slow
+const float DRIVE_KI = 400;
+
+/// How close to the speed asked for a good track would be before the error
+/// is summed, m/s
+const float DRIVE_SETTLED = 0.05;
+
+/// Weight of each new speed measurement in the track speed estimates
+const float DRIVE_SPEED_FILTER = 0.5;
+
+/** @brief   What the speed loop knows about the tracks, published every pass.
+ */
+struct DriveState
+{
+    uint32_t ms;                ///< Time of the pass
+    float left_m;               ///< Left track travel since power-up, m
+    float right_m;              ///< Right track travel since power-up, m
+    float left_mps;             ///< Estimated left track speed, m/s
+    float right_mps;            ///< Estimated right track speed, m/s
+    float left_target;          ///< Speed the left track should be at now, m/s
+    float right_target;         ///< Speed the right track should be at now, m/s
+    uint16_t moves_done;        ///< Distance moves finished since power-up
+};
+
+// Start counting the encoders and running the speed loop
+void drive_begin (void);
+
+// Drive each track at a speed, m/s, until the tracks have gone a distance, m,
+// or for good if the distance is 0
+void drive_set_speed (float left_mps, float right_mps, float distance_m);
+
+// Stop both tracks at once, skipping the ramp
+void drive_stop_now (void);
+
+// Stop both tracks from an interrupt with a few register writes; a call to
+// drive_stop_now() from a task must follow before they are driven again
+void drive_cut_now (void);
+
+#endif // _DRIVE_H_
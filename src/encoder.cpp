@@ -0,0 +1,107 @@
+/** @file encoder.cpp
+ *      This file contains the quadrature encoder counters for the two tracks.
+ *
+ *  @details Each track's motor has a two channel Hall encoder on its shaft.
+ *           Rather than take an interrupt on every edge, which would be tens
+ *           of thousands of interrupts a second at full speed, each encoder
+ *           drives the first two inputs of a timer set to encoder mode, and
+ *           the timer counts up or down on every edge of both channels by
+ *           itself. Reading a count is then one register read. The counters
+ *           are 16 bits and wrap around; whoever reads them takes the
+ *           difference between two reads as a signed 16 bit number, which is
+ *           right as long as they read more often than 32767 counts, about
+ *           2.8 m of travel.
+ *
+ *           Only TIM4 and TIM8 can count encoders on pins this board leaves
+ *           free, since TIM2 and TIM3 make the motor PWM. The registers are
+ *           set up directly because the Arduino timer library has no encoder
+ *           mode. In the simulator the counts come from the world's tracks.
+ */
+
+#include "encoder.h"
+#if !(defined STM32L4xx || defined STM32F4xx)
+    #include "host.h"
+#endif
+
+
+#if (defined STM32L4xx || defined STM32F4xx)
+
+/** @brief   Set a timer to count both edges of its first two inputs.
+ *  @details Each input is filtered over eight samples so that ringing on the
+ *           encoder wires isn't counted.
+ *  @param   p_timer The timer
+ *  @param   invert @c true to count the other way, for a motor which is
+ *           mounted facing the other way
+ */
+static void encoder_timer_begin (TIM_TypeDef* p_timer, bool invert)
+{
+    p_timer->CR1 = 0;
+    p_timer->SMCR = 0;
+    p_timer->CCMR1 = TIM_CCMR1_CC1S_0 | TIM_CCMR1_CC2S_0
+                     | (3UL << TIM_CCMR1_IC1F_Pos) | (3UL << TIM_CCMR1_IC2F_Pos);
+    p_timer->CCER = invert ? TIM_CCER_CC1P : 0;
+    p_timer->ARR = 0xFFFF;
+    p_timer->SMCR = TIM_SMCR_SMS_0 | TIM_SMCR_SMS_1;   // count both inputs' edges
+    p_timer->CNT = 0;
+    p_timer->CR1 = TIM_CR1_CEN;
+}
+
+
+/** @brief   Set up both encoder timers and start them counting.
+ *  @details The right encoder's channels go to PB6 and PB7, which are TIM4's
+ *           first two inputs as alternate function 2; the left encoder's go
+ *           to PC6 and PC7, TIM8's as alternate function 3. The encoders'
+ *           outputs are open collector, so the pins are pulled up.
+ */
+void encoder_begin (void)
+{
+    #ifdef STM32L4xx
+        RCC->AHB2ENR |= RCC_AHB2ENR_GPIOBEN | RCC_AHB2ENR_GPIOCEN;
+        RCC->APB1ENR1 |= RCC_APB1ENR1_TIM4EN;
+    #else
+        RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN | RCC_AHB1ENR_GPIOCEN;
+        RCC->APB1ENR |= RCC_APB1ENR_TIM4EN;
+    #endif
+    RCC->APB2ENR |= RCC_APB2ENR_TIM8EN;
+
+    GPIOB->AFR[0] = (GPIOB->AFR[0] & ~(0xFFUL << 24)) | (0x22UL << 24);
+    GPIOB->PUPDR = (GPIOB->PUPDR & ~(0xFUL << 12)) | (0x5UL << 12);
+    GPIOB->MODER = (GPIOB->MODER & ~(0xFUL << 12)) | (0xAUL << 12);
+
+    GPIOC->AFR[0] = (GPIOC->AFR[0] & ~(0xFFUL << 24)) | (0x33UL << 24);
+    GPIOC->PUPDR = (GPIOC->PUPDR & ~(0xFUL << 12)) | (0x5UL << 12);
+    GPIOC->MODER = (GPIOC->MODER & ~(0xFUL << 12)) | (0xAUL << 12);
+
+    encoder_timer_begin (TIM8, false);
+    encoder_timer_begin (TIM4, true);
+}
+
+
+/** @brief   Get a track's encoder count.
+ *  @param   track Which track, from @c EncoderTrack
+ *  @return  The count, which wraps around at 16 bits and goes up going forward
+ */
+uint16_t encoder_count (uint8_t track)
+{
+    return (track == ENCODER_LEFT ? TIM8->CNT : TIM4->CNT);
+}
+
+#else
+
+/** @brief   Start the encoders, which the simulated world counts by itself.
+ */
+void encoder_begin (void)
+{
+}
+
+
+/** @brief   Get a track's encoder count from the simulated world.
+ *  @param   track Which track, from @c EncoderTrack
+ *  @return  The count, which wraps around at 16 bits and goes up going forward
+ */
+uint16_t encoder_count (uint8_t track)
+{
+    return (world_encoder_count (track));
+}
+
+#endif // STM32L4xx || STM32F4xx
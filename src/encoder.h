@@ -0,0 +1,31 @@
+/** @file encoder.h
+ *      This file contains the quadrature encoder counters for the two tracks.
+ *
+ *  @brief  Hardware timers counting both edges of each track's quadrature encoder.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _ENCODER_H_
+#define _ENCODER_H_
+
+#include <Arduino.h>
+
+/// Encoder counts per metre of track travel: 12 lines, counted on all four
+/// edges, through the 30:1 gearbox onto a 40 mm drive sprocket
+const float ENCODER_COUNTS_PER_M = 11459;
+
+/// The two tracks, as the encoders number them
+enum EncoderTrack
+{
+    ENCODER_LEFT,               ///< TIM8 on PC6 and PC7
+    ENCODER_RIGHT,              ///< TIM4 on PB6 and PB7
+    ENCODER_NUM_TRACKS          ///< Number of tracks
+};
+
+// Set up both encoder timers and start them counting
+void encoder_begin (void);
+
+// Get a track's count, which wraps around at 16 bits and goes up going forward
+uint16_t encoder_count (uint8_t track);
+
+#endif // _ENCODER_H_
@@ -0,0 +1,230 @@
+/** @file flagset.h
+ *      This file contains a set of on/off flags kept in one FreeRTOS event
+ *      group, which tasks and interrupts raise, lower and wait on one or
+ *      several at a time.
+ *
+ *  @brief Typed flags in a FreeRTOS event group, set, cleared and waited on several at a time.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _FLAGSET_H_
+#define _FLAGSET_H_
+
+#include <Arduino.h>
+#include <type_traits>
+#if (defined STM32L4xx || defined STM32F4xx)
+    #include <STM32FreeRTOS.h>
+    #include <event_groups.h>
+#endif
+#include "FreeRTOS.h"                       // Main header for FreeRTOS
+#include "baseshare.h"
+
+/// Flags one event group can hold; FreeRTOS keeps the top byte of the bits
+/// for itself when ticks are 32 bits
+const uint8_t FLAGSET_MAX_FLAGS = 24;
+
+
+/** @brief   Set of on/off flags, each one bit of a FreeRTOS event group.
+ *  @details A one-deep @c Queue used as a flag costs a queue control block
+ *           and storage for its one item, and each look at it is a kernel
+ *           call. A @c FlagSet keeps up to @c FLAGSET_MAX_FLAGS flags in one
+ *           event group, and one call reads them all.
+ *
+ *           @c FlagType is an enum whose values are single bits. Values may
+ *           be or'ed together, if the enum has an @c operator|, to set,
+ *           clear, take or wait on several flags in one call; each such call
+ *           is atomic, so no task ever sees some of the flags changed and
+ *           not the others.
+ *
+ *           An interrupt sets flags with @c ISR_set(). FreeRTOS doesn't
+ *           change an event group's bits inside an interrupt; it hands the
+ *           change to its timer service task, so the flags are set as soon
+ *           as that task runs after the interrupt returns. The timer service
+ *           task must be turned on, as it is in STM32FreeRTOS.
+ */
+template <class FlagType> class FlagSet : public BaseShare
+{
+    static_assert (std::is_enum<FlagType>::value,
+                   "FlagSet flags must be an enum of single bits");
+
+    protected:
+        EventGroupHandle_t handle;          ///< The FreeRTOS event group
+
+    public:
+        // Construct a set of flags, all lowered
+        FlagSet (const char* p_name = NULL);
+
+        // Raise one or more flags
+        void set (FlagType flags);
+
+        // Raise one or more flags from within an interrupt
+        void ISR_set (FlagType flags);
+
+        // Lower one or more flags
+        void clear (FlagType flags);
+
+        // Lower one or more flags, telling which of them were raised
+        FlagType take (FlagType flags);
+
+        // Wait until any or all of some flags are raised
+        FlagType wait (FlagType flags, bool all, bool take, TickType_t ticks);
+
+        /** @brief   Read all the flags at once.
+         *  @return  The raised flags, or'ed together
+         */
+        FlagType get (void)
+        {
+            return ((FlagType)xEventGroupGetBits (handle));
+        }
+
+        /** @brief   Read all the flags at once from within an interrupt.
+         *  @return  The raised flags, or'ed together
+         */
+        FlagType ISR_get (void)
+        {
+            return ((FlagType)xEventGroupGetBitsFromISR (handle));
+        }
+
+        /** @brief   Tell whether any of some flags is raised.
+         *  @param   flags The flags to look at
+         *  @return  @c true if at least one of them is raised
+         */
+        bool is_set (FlagType flags)
+        {
+            return ((xEventGroupGetBits (handle) & flags) != 0);
+        }
+
+        // Print the flags within a list of all shares' statuses
+        void print_in_list (Print& print_dev);
+
+        // Fill in the numbers which describe this set's condition
+        void get_stats (ShareStats& stats);
+};
+
+
+/** @brief   Construct a set of flags, all lowered.
+ *  @param   p_name A name to be shown in the list of task shares
+ *           (default @c NULL)
+ */
+template <class FlagType>
+FlagSet<FlagType>::FlagSet (const char* p_name)
+    : BaseShare (p_name)
+{
+    handle = xEventGroupCreate ();
+}
+
+
+/** @brief   Raise one or more flags.
+ *  @details Any task waiting on the flags is woken. This must not be called
+ *           from an interrupt.
+ *  @param   flags The flags to raise, or'ed together
+ */
+template <class FlagType>
+void FlagSet<FlagType>::set (FlagType flags)
+{
+    xEventGroupSetBits (handle, flags);
+    puts++;
+}
+
+
+/** @brief   Raise one or more flags from within an interrupt.
+ *  @details The timer service task raises them once the interrupt returns;
+ *           if that task is ready to run ahead of the interrupted one, the
+ *           scheduler switches to it straight away.
+ *  @param   flags The flags to raise, or'ed together
+ */
+template <class FlagType>
+void FlagSet<FlagType>::ISR_set (FlagType flags)
+{
+    BaseType_t woken = pdFALSE;
+    xEventGroupSetBitsFromISR (handle, flags, &woken);
+    puts++;
+    portYIELD_FROM_ISR (woken);
+}
+
+
+/** @brief   Lower one or more flags.
+ *  @param   flags The flags to lower, or'ed together
+ */
+template <class FlagType>
+void FlagSet<FlagType>::clear (FlagType flags)
+{
+    xEventGroupClearBits (handle, flags);
+    gets++;
+}
+
+
+/** @brief   Lower one or more flags, telling which of them were raised.
+ *  @details Reading and lowering the flags is one step, so a flag raised
+ *           just before the call is either returned or left raised, never
+ *           lost.
+ *  @param   flags The flags to take, or'ed together
+ *  @return  Those of the flags which were raised
+ */
+template <class FlagType>
+FlagType FlagSet<FlagType>::take (FlagType flags)
+{
+    EventBits_t were = xEventGroupClearBits (handle, flags);
+    gets++;
+    return ((FlagType)(were & flags));
+}
+
+
+/** @brief   Wait until any or all of some flags are raised.
+ *  @param   flags The flags to wait for, or'ed together
+ *  @param   all @c true to wait for all of them, @c false for any one
+ *  @param   take @c true to lower the flags waited for when the wait ends,
+ *           in the same step; they are left alone if the wait times out
+ *  @param   ticks How long to wait, in RTOS ticks, or @c portMAX_DELAY
+ *  @return  Those of the flags which were raised when the wait ended; if
+ *           the wait timed out, this has fewer flags than were asked for
+ */
+template <class FlagType>
+FlagType FlagSet<FlagType>::wait (FlagType flags, bool all, bool take,
+                                  TickType_t ticks)
+{
+    EventBits_t were = xEventGroupWaitBits (handle, flags,
+                                            take ? pdTRUE : pdFALSE,
+                                            all ? pdTRUE : pdFALSE, ticks);
+    bool met = all ? ((were & flags) == (EventBits_t)flags) : ((were & flags) != 0);
+    if (!met)
+    {
+        blocks++;
+    }
+    else if (take)
+    {
+        gets++;
+    }
+    return ((FlagType)(were & flags));
+}
+
+
+/** @brief   Print the name and raised flags of this set.
+ *  @details This function makes one line of the list of all the shares and
+ *           queues in the system printed by @c print_all_shares().
+ *  @param   print_dev Reference to a serial device on which to print
+ */
+template <class FlagType>
+void FlagSet<FlagType>::print_in_list (Print& print_dev)
+{
+    print_dev.printf ("%-16sflags\t0x%06lx\n", name,
+                      (unsigned long)xEventGroupGetBits (handle));
+}
+
+
+/** @brief   Fill in the numbers which describe this set's condition.
+ *  @details The fill is the number of flags raised now. Waits which timed
+ *           out are given as the set's blocks.
+ *  @param   stats The structure to fill in
+ */
+template <class FlagType>
+void FlagSet<FlagType>::get_stats (ShareStats& stats)
+{
+    BaseShare::get_stats (stats);
+    stats.kind = SHARE_KIND_FLAGS;
+    stats.capacity = FLAGSET_MAX_FLAGS;
+    stats.fill = __builtin_popcount (xEventGroupGetBitsFromISR (handle));
+    stats.max_full = stats.fill;
+}
+
+#endif // _FLAGSET_H_
@@ -0,0 +1,198 @@
+/** @file framequeue.h
+ *      This file contains a queue for whole frames of sensor data which
+ *      chooses what to lose, rather than making the sender wait, when the
+ *      receiver falls behind.
+ *
+ *  @brief Queue with a drop-oldest, drop-newest or blocking overflow policy and a get for the newest item.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _FRAMEQUEUE_H_
+#define _FRAMEQUEUE_H_
+
+#include <atomic>
+#include <Arduino.h>
+#include "FreeRTOS.h"                       // Main header for FreeRTOS
+#include "taskqueue.h"
+
+/// What @c FrameQueue::put() does when the queue is full
+enum OverflowPolicy
+{
+    OVERFLOW_BLOCK,             ///< Wait for room, like a plain @c Queue
+    OVERFLOW_DROP_OLDEST,       ///< Throw away the oldest item to make room
+    OVERFLOW_DROP_NEWEST        ///< Throw away the item being put
+};
+
+
+/** @brief   Queue for frames of data where fresh data matters more than
+ *           complete data.
+ *  @details A plain @c Queue makes the sender wait when the receiver falls
+ *           behind, and the receiver then works through a backlog of stale
+ *           items. A @c FrameQueue instead follows its overflow policy: with
+ *           @c OVERFLOW_DROP_OLDEST the sender never waits and the queue always
+ *           holds the newest items, and @c get_latest() lets the receiver skip
+ *           straight to the newest one. Dropped items, including the ones
+ *           @c get_latest() skips, are counted and shown in the list of
+ *           shares.
+ *
+ *           Each item should carry its own sequence number if the receiver
+ *           needs to know exactly which items it never saw. Only one task
+ *           should put items into a @c FrameQueue.
+ */
+template <class dataType> class FrameQueue : public Queue<dataType>
+{
+    protected:
+        OverflowPolicy policy;            ///< What to do when full
+        std::atomic<uint32_t> dropped;    ///< Items thrown away; the sender
+                                          ///< and receiver both count them
+
+    public:
+        // Create a queue with the given overflow policy
+        FrameQueue (BaseType_t queue_size, const char* p_name = NULL,
+                    OverflowPolicy overflow = OVERFLOW_DROP_OLDEST);
+
+        // Put an item into the queue, following the overflow policy
+        bool put (const dataType& item);
+
+        // Get the newest item, throwing away any older ones
+        uint16_t get_latest (dataType& recv_item);
+
+        /** @brief   Get the number of items thrown away when the queue was
+         *           full.
+         *  @return  The number of dropped items since the queue was created
+         */
+        uint32_t num_dropped (void)
+        {
+            return (dropped.load (std::memory_order_relaxed));
+        }
+
+        // Print the queue's status within a list of shares
+        void print_in_list (Print& print_dev);
+
+        // Fill in the numbers which describe this queue's condition
+        void get_stats (ShareStats& stats);
+};
+
+
+/** @brief   Construct a frame queue.
+ *  @param   queue_size The number of items which can be stored in the queue
+ *  @param   p_name A name to be shown in the list of task shares
+ *  @param   overflow What @c put() does when the queue is full
+ */
+template <class dataType>
+FrameQueue<dataType>::FrameQueue (BaseType_t queue_size, const char* p_name,
+                                  OverflowPolicy overflow)
+    : Queue<dataType> (queue_size, p_name, portMAX_DELAY), dropped (0)
+{
+    policy = overflow;
+}
+
+
+/** @brief   Put an item into the back of the queue.
+ *  @details If the queue is full, @c OVERFLOW_BLOCK waits for room,
+ *           @c OVERFLOW_DROP_NEWEST gives up on this item, and
+ *           @c OVERFLOW_DROP_OLDEST removes items from the front until this
+ *           one fits. This method must not be used within an ISR.
+ *  @param   item Reference to the item which is going to be put into the queue
+ *  @return  @c true if the item was queued, @c false if it was dropped
+ */
+template <class dataType>
+bool FrameQueue<dataType>::put (const dataType& item)
+{
+    if (policy == OVERFLOW_BLOCK)
+    {
+        return (Queue<dataType>::put (item));
+    }
+
+    bool queued = (bool)xQueueSendToBack (this->handle, &item, 0);
+    if (!queued && policy == OVERFLOW_DROP_OLDEST)
+    {
+        // The receiver may take an item meanwhile; then nothing is dropped
+        dataType oldest;
+        do
+        {
+            if (xQueueReceive (this->handle, &oldest, 0))
+            {
+                dropped.fetch_add (1, std::memory_order_relaxed);
+            }
+            queued = (bool)xQueueSendToBack (this->handle, &item, 0);
+        }
+        while (!queued);
+    }
+    else if (!queued)
+    {
+        dropped.fetch_add (1, std::memory_order_relaxed);
+    }
+    this->puts++;                       // queued, or counted as dropped
+
+    uint16_t fillage = uxQueueMessagesWaiting (this->handle);
+    if (fillage > this->max_full)
+    {
+        this->max_full = fillage;
+    }
+
+    return (queued);
+}
+
+
+/** @brief   Get the newest item in the queue, throwing away older ones.
+ *  @details If the queue is empty, this waits for an item like @c get().
+ *           Only the newest item counts as a get; the older ones are
+ *           counted as dropped.
+ *  @param   recv_item A reference to the item to be filled with the newest
+ *           data from the queue
+ *  @return  The number of older items which were thrown away
+ */
+template <class dataType>
+uint16_t FrameQueue<dataType>::get_latest (dataType& recv_item)
+{
+    uint16_t skipped = 0;
+
+    Queue<dataType>::get (recv_item);
+    while (xQueueReceive (this->handle, &recv_item, 0))
+    {
+        skipped++;
+    }
+    dropped.fetch_add (skipped, std::memory_order_relaxed);
+
+    return (skipped);
+}
+
+
+/** @brief   Print the queue's status to a serial device.
+ *  @details This shows the same as a @c Queue with the number of dropped
+ *           items added.
+ *  @param   print_dev Reference to the serial device on which to print
+ */
+template <class dataType>
+void FrameQueue<dataType>::print_in_list (Print& print_dev)
+{
+    print_dev.printf ("%-16sframes\t", this->name);
+
+    if (this->usable ())
+    {
+        print_dev << this->max_full << '/' << this->buf_size << ", "
+                  << num_dropped () << " dropped" << endl;
+    }
+    else
+    {
+        print_dev << "UNUSABLE" << endl;
+    }
+}
+
+
+/** @brief   Fill in the numbers which describe this queue's condition.
+ *  @details Dropped items, whether thrown away when the queue was full or
+ *           skipped by @c get_latest(), are counted as puts but never as
+ *           gets, so the puts are the gets plus the dropped items plus the
+ *           items waiting.
+ *  @param   stats The structure to fill in
+ */
+template <class dataType>
+void FrameQueue<dataType>::get_stats (ShareStats& stats)
+{
+    Queue<dataType>::get_stats (stats);
+    stats.kind = SHARE_KIND_FRAMES;
+}
+
+#endif // _FRAMEQUEUE_H_
@@ -0,0 +1,43 @@
+/** @file i2c_bus.cpp
+ *      This file contains the lock which lets more than one task talk on the
+ *      I2C bus.
+ *
+ *  @details The lock is a FreeRTOS mutex, so a low priority task holding the
+ *           bus is raised to the priority of any task waiting for it and
+ *           can't be held off by tasks in between. Transfers to either sensor
+ *           take at most a couple of milliseconds, so a task waiting for the
+ *           bus waits about that long.
+ */
+
+#include "i2c_bus.h"
+
+/// The mutex which the task using the bus holds
+static SemaphoreHandle_t i2c_mutex = NULL;
+
+
+/** @brief   Create the bus lock.
+ *  @details This must be called before any task which uses the bus starts.
+ */
+void i2c_bus_begin (void)
+{
+    i2c_mutex = xSemaphoreCreateMutex ();
+}
+
+
+/** @brief   Wait for the I2C bus and take it.
+ *  @details This must not be called from an interrupt, nor by a task which
+ *           already holds the bus.
+ */
+void i2c_bus_take (void)
+{
+    xSemaphoreTake (i2c_mutex, portMAX_DELAY);
+}
+
+
+/** @brief   Let other tasks use the I2C bus again.
+ *  @details Only the task which took the bus may give it back.
+ */
+void i2c_bus_give (void)
+{
+    xSemaphoreGive (i2c_mutex);
+}
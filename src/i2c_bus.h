@@ -0,0 +1,58 @@
+/** @file i2c_bus.h
+ *      This file contains the lock which lets more than one task talk on the
+ *      I2C bus.
+ *
+ *  @brief Mutex which every user of the shared @c Wire bus holds for each transaction.
+ *
+ *  @details The thermal camera and the time of flight sensor hang off the same
+ *           @c Wire bus, and their tasks run at the same priority, so without
+ *           a lock one task's transfer can be cut into by the other's and both
+ *           read garbage. Any code which calls a sensor library that uses
+ *           @c Wire makes an @c I2cLock first and keeps it for the whole
+ *           transfer, including a sensor's @c begin(), which starts @c Wire
+ *           over again.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _I2C_BUS_H_
+#define _I2C_BUS_H_
+
+#include <Arduino.h>
+#if (defined STM32L4xx || defined STM32F4xx)
+    #include <STM32FreeRTOS.h>
+#endif
+#include "FreeRTOS.h"
+
+// Create the bus lock; call in setup() before any task runs
+void i2c_bus_begin (void);
+
+// Wait for the bus and take it
+void i2c_bus_take (void);
+
+// Let other tasks use the bus again
+void i2c_bus_give (void);
+
+
+/** @brief   Holds the I2C bus for as long as it is in scope.
+ *  @details Declare one at the top of a block which talks to a sensor; the
+ *           bus is released when the block ends, however it ends.
+ */
+class I2cLock
+{
+    public:
+        /** @brief   Wait for the bus and take it.
+         */
+        I2cLock (void)
+        {
+            i2c_bus_take ();
+        }
+
+        /** @brief   Let other tasks use the bus again.
+         */
+        ~I2cLock (void)
+        {
+            i2c_bus_give ();
+        }
+};
+
+#endif // _I2C_BUS_H_
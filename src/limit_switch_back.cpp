@@ -12,8 +12,10 @@
  */
 
 #include "limit_switch_back.h"
+#include "supervisor.h"
+#include "control_flags.h"
 
-extern Queue<uint8_t> limitdetect_back; ///<Back Limit Switch Flag
+extern FlagSet<ControlFlag> control_flags; ///<Limit switch, stop hunt and reset flags
 
 /** @brief   Task which handles the back limit switches
  *  @details This task initializes the digital reading pin(s) and raises a flag for
@@ -24,19 +26,20 @@ void task_limit_back (void* p_params)
 {
     (void)p_params;             // Does nothing but shut up a compiler warning  
     
-    const uint8_t pin = D9;     // pin address
+    const uint8_t pin = D12;    // pin address; D9 counts the left encoder
     pinMode(pin,INPUT);         // enable the pin as an input
 
     for (;;)
     {
+        heartbeat(HEART_LIMIT_BACK); // still watching the switch
         //checks if limit switches are pressed
-        if (limitdetect_back.any())
+        if (control_flags.is_set(FLAG_BACK_BUMP))
         {
             vTaskDelay(500);
         }
         else if (digitalRead(pin))      //If the pin is high, then limit switch detected a boundary
         {
-            limitdetect_back.put(0); // put dir stop value in queue
+            control_flags.set(FLAG_BACK_BUMP); // tell mastermind to stop backing up
         }
         vTaskDelay(100); // Delays things so we can actually see stuff happening
     }
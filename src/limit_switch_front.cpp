@@ -3,6 +3,23 @@
  * 
  *  @details This task initializes the digital reading pin(s) and raises a flag for
  *           Mastermind if the front limit switch(es) were pressed.
+ *
+ *           The switch closing also interrupts the processor, and if the
+ *           tracks are driving forward the interrupt stops them itself
+ *           before raising the flag, rather than waiting for the task's next
+ *           look at the pin, mastermind's next pass and the motor task. The
+ *           profile build times the interrupt's own work in the
+ *           @c PROFILE_BUMP_REFLEX zone, but not the wait before it starts.
+ *           The interrupt raises a flag through FreeRTOS, so its priority
+ *           must be no more urgent than @c configMAX_SYSCALL_INTERRUPT_PRIORITY
+ *           (the core gives EXTI interrupts 6, FreeRTOS's limit is 5), and
+ *           that means it waits out every FreeRTOS critical section as well
+ *           as the serial, I2C and other more urgent interrupts. The time
+ *           from the switch closing to the motor pins going low has not been
+ *           measured on the robot; to measure it, put a scope on D8 and one
+ *           of the motor pins and bump the switch while driving forward. The
+ *           task checks the interrupt's priority when it starts, and still
+ *           polls the pin in case an edge is missed.
  * 
  *  @author Michael Conn
  *  @author Scott Mangin
@@ -12,8 +29,35 @@
  */
 
 #include "limit_switch_front.h"
+#include "supervisor.h"
+#include "drive.h"
+#include "motor_ramp.h"
+#include "profile.h"
+#include "control_flags.h"
+#include "console_log.h"
 
-extern Queue<uint8_t> limitdetect_front; ///<Front Limit Switch Flag
+extern FlagSet<ControlFlag> control_flags; ///<Limit switch, stop hunt and reset flags
+
+/** @brief   Interrupt which stops the tracks the moment the front switch
+ *           closes.
+ *  @details Only a bump while a track drives forward is stopped here, so the
+ *           switch bouncing open as the robot backs away doesn't stop the
+ *           reverse. The flag is raised either way, as the task would, and
+ *           mastermind stops the motors again with @c motor_stop_now(),
+ *           which sets the pins up for driving again.
+ */
+static void bump_isr (void)
+{
+    PROFILE_ZONE(PROFILE_BUMP_REFLEX);
+    if (ramp_duty(RAMP_LEFT) > 0 || ramp_duty(RAMP_RIGHT) > 0)
+    {
+        drive_cut_now();
+    }
+    if (!(control_flags.ISR_get() & FLAG_FRONT_BUMP)) // a bouncing switch needn't set it over and over
+    {
+        control_flags.ISR_set(FLAG_FRONT_BUMP);
+    }
+}
 
 /** @brief   Task which handles the front limit switch
  *  @details This task initializes the digital reading pin(s) and raises a flag for
@@ -26,17 +70,31 @@ void task_limit_front (void* p_params)
     
     const uint8_t pin = D8;     // pin address
     pinMode(pin,INPUT);         // enable the pin as an input
+    attachInterrupt(digitalPinToInterrupt(pin), bump_isr, RISING);
+
+#if (defined STM32L4xx || defined STM32F4xx)
+    // D8 is PA9, whose edges interrupt through EXTI9_5. The interrupt uses
+    // FreeRTOS, so it mustn't be more urgent (numerically lower) than the limit
+    const uint32_t syscall_priority = configMAX_SYSCALL_INTERRUPT_PRIORITY >> (8 - __NVIC_PRIO_BITS);
+    if (NVIC_GetPriority(EXTI9_5_IRQn) < syscall_priority)
+    {
+        log_print("Bumper interrupt priority %lu is above FreeRTOS's limit; lowering it to %lu",
+                  (unsigned long)NVIC_GetPriority(EXTI9_5_IRQn), (unsigned long)syscall_priority);
+        NVIC_SetPriority(EXTI9_5_IRQn, syscall_priority);
+    }
+#endif
 
     for (;;)
     {
+        heartbeat(HEART_LIMIT_FRONT); // still watching the switch
         //checks if front limit switch is pressed
-        if (limitdetect_front.any())
+        if (control_flags.is_set(FLAG_FRONT_BUMP))
         {
             vTaskDelay(500); // do nothing until mastermind clears it
         }
         else if (digitalRead(pin))      //If the pin is high, then limit switch detected a boundary
         {
-            limitdetect_front.put(2); // put dir back value in queue
+            control_flags.set(FLAG_FRONT_BUMP); // tell mastermind to back up
         }
         vTaskDelay(50); // Delays things as needed
     }
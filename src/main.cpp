@@ -19,20 +19,157 @@
 #include <Adafruit_AMG88xx.h>
 #include "taskqueue.h"
 #include "taskshare.h"
+#include "control_flags.h"
 #include "limit_switch_back.h"
 #include "limit_switch_front.h"
 #include "motor.h"
+#include "drive.h"
 #include "thermal_cam.h"
 #include "thermal_decoder.h"
+#include "tof_sensor.h"
+#include "i2c_bus.h"
+#include "profile.h"
+#include "telemetry.h"
+#include "console_log.h"
+#include "supervisor.h"
+#include "tuning.h"
 
-Queue<float> thermaldata (640, "Thermal Data"); ///<Thermal Camera Data Queue
-Queue<uint8_t> motordirection (1, "Motor Direction Parameter"); ///<Super-boolean for direction of travel Queue
-Queue<uint8_t> motorpower (1, "Motor Power Parameter"); ///<Duty cycle value for designated motor pins Queue
-Queue<uint8_t> limitdetect_back (1, "Back Limit Switch Detection Flag"); ///<Back Limit Switch Flag
-Queue<uint8_t> limitdetect_front (1, "Front Limit Switch Detection Flag"); ///<Front Limit Switch Flag
-Queue<uint8_t> stop_hunt (1, "Stop Thermal Hunt Flag"); ///<Flag to signal the thermal camera should stop detecting
-Queue<uint8_t> reset_this (1, "Reset Hunt Flag"); ///<Flag to reset thermal camera
-Queue<uint8_t> direction (1, "Person Direction Flag"); ///<Direction of detected person flag
+FrameQueue<ThermalFrame> thermaldata (2, "Thermal Data", OVERFLOW_DROP_OLDEST); ///<Thermal Camera Frame Queue, keeps the newest frames
+Queue<MotorCommand> motorcommand (1, "Motor Command", MOTOR_REPORT_MS); ///<Direction, speed and distance for the motors; the motor task waits a while for one
+FlagSet<ControlFlag> control_flags ("Control Flags"); ///<Limit switch, stop hunt and reset flags
+SeqShare<TargetReport> target_report ("Target"); ///<Newest report on the person from the thermal decoder
+Share<float> thermistor ("Thermistor"); ///<Thermal camera board temperature
+Queue<TelemetryRecord> telemetry (32, "Telemetry"); ///<Telemetry records waiting to be sent
+Queue<uint8_t> tof_ready (1, "ToF Range Ready", TOF_PERIOD_MS + 10); ///<Raised by the ToF sensor's interrupt; waits a little past the next range
+SeqShare<TofReading> tof_reading ("ToF Range"); ///<Newest range and closing speed from the ToF sensor
+SeqShare<DriveState> drive_state ("Drive"); ///<Track travel and speeds, written by the speed loop
+
+TUNABLE uint16_t CHASE_SPEED = 800;   ///<Forward speed while the way ahead is clear, mm/s
+const uint16_t CONTACT_SPEED = 220;  ///<Forward speed for the last stretch, so the bumper only touches, mm/s
+const uint16_t UNSURE_SPEED = 320;   ///<Forward speed at a person the decoder isn't yet sure of, mm/s
+TUNABLE uint16_t TURN_SPEED = 320;    ///<Track speed turning toward a person at the edge of view, mm/s
+const uint16_t TURN_MIN_SPEED = 200; ///<Track speed turning toward a person just off to the side, mm/s
+TUNABLE float SIDE_DEG = 15;         ///<Bearing past which the robot turns toward the person
+const float EDGE_DEG = 30;           ///<Bearing of the edge of the thermal camera's view
+const float SURE_CONFIDENCE = 0.5;   ///<Confidence in the person below which the robot won't charge them
+const uint16_t REPORT_STALE_MS = 400; ///<Age of the newest frame past which the person is taken as lost, ms
+const uint16_t REVERSE_SPEED = 320;  ///<Speed backing away from a person, mm/s
+const uint16_t INCH_SPEED = 300;     ///<Speed moving off the wall after backing into it, mm/s
+const uint16_t INCH_MM = 100;        ///<Distance to move off the wall, mm
+const uint16_t INCH_TIMEOUT_MS = 1000; ///<Longest to wait for that move, in case a track is stuck
+const float BRAKE_MARGIN_MM = 80;    ///<Range left over once slowed to contact speed, mm
+const float APPROACH_GAIN = 3.0;     ///<Speed added per mm of range past the margin, mm/s per mm
+const uint16_t APPROACH_STEP = 20;   ///<Steps the approach speed is rounded down to, so it isn't resent every pass, mm/s
+const float BLOB_RANGE_ERROR_MM = 800; ///<Most the range judged from the thermal camera reads long, mm
+const float AIM_LATERAL_MM = 300;    ///<How far off the bumper's middle a person may be and still be charged, mm
+const float PERSON_RADIUS_MM = 200;  ///<Distance from a person's front to their middle, mm
+TUNABLE uint16_t MASTERMIND_PERIOD_MS = 10; ///<Time mastermind waits between passes through its states
+
+/** @brief   Send the motors a command.
+ *  @param   direction 1 forward, 2 reverse, 3 left, 4 right
+ *  @param   speed_mmps Track speed, mm/s; 0 to stop
+ *  @param   distance_mm Distance to go before stopping, mm; 0 to keep going
+ */
+static void motor_command (uint8_t direction, uint16_t speed_mmps, uint16_t distance_mm = 0)
+{
+    MotorCommand command = {direction, speed_mmps, distance_mm};
+    motorcommand.put(command);
+}
+
+/** @brief   Get the number of distance moves the speed loop has finished.
+ *  @return  The number of moves since power-up
+ */
+static uint16_t moves_done (void)
+{
+    DriveState drive;
+    drive_state.get(drive);
+    return (drive.moves_done);
+}
+
+/** @brief   Find the fastest the robot may close on something at a range.
+ *  @details The speed falls in a straight line with the range, from full
+ *           speed a few hundred mm out to contact speed at the margin. The
+ *           speed loop eases each track to a new speed over @c DRIVE_TAU, and
+ *           a taper this steep is one it follows closely without running
+ *           past, so the robot keeps full speed until it is close and then
+ *           slows smoothly instead of dropping to contact speed early and
+ *           crawling the last stretch.
+ *  @param   range_mm Distance from the bumper, mm
+ *  @return  The closing speed, from contact speed to chase speed, mm/s
+ */
+static uint16_t approach_speed (float range_mm)
+{
+    float v = CONTACT_SPEED + APPROACH_GAIN * max(range_mm - BRAKE_MARGIN_MM, 0.0f);
+    uint16_t speed = min(v, (float)CHASE_SPEED);
+    return (max((uint16_t)(speed - speed % APPROACH_STEP), CONTACT_SPEED));
+}
+
+/** @brief   Choose the forward speed from the range to the person.
+ *  @details While the person is inside the time of flight sensor's cone, its
+ *           range is theirs, or they are beyond its reach if it sees nothing.
+ *           When they are off to one side of the cone its range may be of
+ *           something behind them, and when it gives no ranges at all there
+ *           is nothing else to go on, so then the range judged from the size
+ *           of the person's warm blob is used instead, taken as short as it
+ *           may really be.
+ *  @param   report The newest target report from the thermal decoder
+ *  @return  The speed to use going forward, mm/s
+ */
+static uint16_t chase_speed (const TargetReport& report)
+{
+    TofReading tof;
+    tof_reading.get(tof);
+    bool blind = tof_reading.num_writes() == 0 || millis() - tof.ms > TOF_STALE_MS;
+    if (blind || fabsf(report.bearing) > TOF_HALF_DEG)
+    {
+        return (approach_speed(report.range_m * 1000 - BLOB_RANGE_ERROR_MM));
+    }
+    return (approach_speed(tof.valid ? tof.range_mm : TOF_MAX_MM));
+}
+
+/** @brief   Choose the forward speed at a person from how sure the decoder is of them.
+ *  @details A person seen only faintly, or only coasted on for a frame or two,
+ *           may not be there, so the robot goes no faster than @c UNSURE_SPEED
+ *           until it is sure of them; otherwise the range ahead sets the speed.
+ *  @param   report The newest target report from the thermal decoder
+ *  @return  The speed to use going forward, mm/s
+ */
+static uint16_t charge_speed (const TargetReport& report)
+{
+    uint16_t speed = chase_speed(report);
+    if (report.confidence < SURE_CONFIDENCE)
+    {
+        speed = min(speed, UNSURE_SPEED);
+    }
+    return (speed);
+}
+
+/** @brief   Find how far off to one side a person may be and still be charged.
+ *  @details Far away, @c SIDE_DEG keeps the robot aimed well enough that it
+ *           doesn't drift past them. Close up, someone further off than that
+ *           is still in front of the bumper, and stopping to turn would only
+ *           waste time, so the band widens to take in the bumper.
+ *  @param   report The newest target report from the thermal decoder
+ *  @return  The largest bearing, either side, to charge at, degrees
+ */
+static float aim_deg (const TargetReport& report)
+{
+    float ahead_mm = report.range_m * 1000 + PERSON_RADIUS_MM;
+    return (max(SIDE_DEG, atan2f(AIM_LATERAL_MM, ahead_mm) * (float)(180 / M_PI)));
+}
+
+/** @brief   Choose the track speed for turning toward a person.
+ *  @details Turns toward someone just past the side of the middle band are
+ *           slow so they don't overshoot, and turns toward someone at the
+ *           edge of view are as fast as @c TURN_SPEED.
+ *  @param   bearing The person's bearing, degrees right
+ *  @return  The track speed, mm/s
+ */
+static uint16_t turn_speed (float bearing)
+{
+    float off = constrain((fabsf(bearing) - SIDE_DEG) / (EDGE_DEG - SIDE_DEG), 0.0f, 1.0f);
+    return (TURN_MIN_SPEED + (uint16_t)(off * (TURN_SPEED - TURN_MIN_SPEED)));
+}
 
 /** @brief   Task which controls the state of the robot.
  *  @details This task is the brain of the Scroomba that decides what should happen.
@@ -43,107 +180,172 @@ void task_mastermind (void* p_params)
 {
     (void)p_params;            // Does nothing but shut up a compiler warning  
 
-    uint8_t dir = 0;           // direction defaults to stopped
     byte state_m = 0;          // state defaults to initialization
+    byte state_sent = 0xFF;    // last state sent as telemetry
+    bool charging = false;     // driving forward at a person
+    uint16_t speed_sent = 0;   // forward speed last sent while charging
+    bool steering = false;     // moving toward a person, so stop if they're lost
+    uint32_t reports_read = 0; // target reports from the thermal decoder acted on
+    TargetReport report;       // the newest of them
 
     for (;;)
     {   
+        heartbeat(HEART_MASTERMIND); // still running the states
+
+        ControlFlag flags = control_flags.get(); // one look at all the flags each pass
+
+        if (state_m != state_sent) // record state changes on the telemetry stream
+        {
+            TelemState change = {millis(), state_m};
+            telemetry_send(TELEM_STATE, &change, sizeof(change));
+            state_sent = state_m;
+        }
+
         if (state_m == 0) //Initialization State
         {
+            PROFILE_ZONE(PROFILE_MM_INIT);
             state_m = 1; // transition to waiting/hunting
-            motordirection.put(1); // must always pass a direction when passing a motor power, default forward
-            motorpower.put(0); // motors default to stopped
+            motor_command(1, 0); // must always pass a direction when passing a speed; motors default to stopped
         }
         else if (state_m == 1) // Waiting/Hunting State
         {
-            if (limitdetect_front.any()) // flagged if the front bumper hits something
+            PROFILE_ZONE(PROFILE_MM_HUNT);
+            if (flags & FLAG_FRONT_BUMP) // flagged if the front bumper hits something
             {
-                limitdetect_front.get(dir); // clear the bumper flag
+                motor_stop_now(); // stop pushing at once rather than ramping down
+                control_flags.clear(FLAG_FRONT_BUMP); // clear the bumper flag
+                charging = false;
+                steering = false;
                 state_m = 2; // transition to the reverse state
-                stop_hunt.put(1);   // tells the thermaldecoder to stop hunting
+                control_flags.set(FLAG_STOP_HUNT);   // tells the thermaldecoder to stop hunting
             }
-            else if (direction.any()) // triggers if thermal cam finds a person
+            else if (target_report.num_writes() != reports_read) // the thermal decoder has a new frame
             {
-                direction.get(dir); // get the direction the person is in
-                if (dir == 0) // stopped state
-                {        
-                    motordirection.put(1); // doesn't really matter if 1/2/3/4 but needs to be one of them
-                    motorpower.put(0);
+                reports_read = target_report.num_writes();
+                target_report.get(report);
+                bool stale = millis() - report.ms > REPORT_STALE_MS; // too old to steer on
+                charging = false;
+                if (!report.locked || stale) // nobody there, or lost them
+                {
+                    if (steering)
+                    {
+                        motor_command(1, 0); // stop rather than chase the last command
+                    }
+                    steering = false;
                 }
-                else if (dir == 1) // forwards state
+                else if (report.bearing > aim_deg(report)) // right turn state
                 {
-                    motordirection.put(1);  // 1 indicates forward to the motors
-                    motorpower.put(125);    // power to the motors; slowed down due to removing ToF sensor
+                    motor_command(4, turn_speed(report.bearing)); // 4 indicates right to the motors
+                    steering = true;
                 }
-                else if (dir == 3) // left turn state
+                else if (report.bearing < -aim_deg(report)) // left turn state
                 {
-                    motordirection.put(3);  // 3 indicates left to the motors
-                    motorpower.put(125);    // power to the motors; slowed down due to removing ToF sensor
+                    motor_command(3, turn_speed(report.bearing)); // 3 indicates left to the motors
+                    steering = true;
                 }
-                else if (dir == 4) // right turn state
+                else // forwards state
                 {
-                    motordirection.put(4);  // 4 indicates right to the motors
-                    motorpower.put(125);    // power to the motors; slowed down due to removing ToF sensor
+                    speed_sent = charge_speed(report); // full speed until close, then taper off
+                    motor_command(1, speed_sent);  // 1 indicates forward to the motors
+                    charging = true;
+                    steering = true;
                 }
-            }               
+            }
+            else if (charging) // between frames, brake as soon as the range ahead says to
+            {
+                uint16_t speed = charge_speed(report);
+                if (speed != speed_sent)
+                {
+                    motor_command(1, speed);
+                    speed_sent = speed;
+                }
+            }
         }
         else if (state_m == 2) // Reverse State
         {
-            if (limitdetect_front.any()) // in case this got pressed again, or
+            PROFILE_ZONE(PROFILE_MM_REVERSE);
+            if (flags & FLAG_FRONT_BUMP) // in case this got pressed again, or
             {
-                limitdetect_front.get(dir);
+                control_flags.clear(FLAG_FRONT_BUMP);
             }
-            else if (stop_hunt.is_empty()) // just in case this somehow got cleared when it shouldn't
+            else if (!(flags & FLAG_STOP_HUNT)) // just in case this somehow got cleared when it shouldn't
             {
-                stop_hunt.put(1);
+                control_flags.set(FLAG_STOP_HUNT);
             }
-            motordirection.put(2);
-            motorpower.put(125);
+            motor_command(2, REVERSE_SPEED);
 
             //bot should keep backing up until the limit switches are pressed.
             //when pressed, bot should stop backing up and begin reset.
-            if(limitdetect_back.any()) // triggers if limit switch hit something
+            if(flags & FLAG_BACK_BUMP) // triggers if limit switch hit something
             {                
-                motordirection.put(1);
-                motorpower.put(0);
+                motor_command(1, 0);
                 state_m = 3; //Reset State
             }
         }
         else if (state_m == 3) //Reset State
         {
+            PROFILE_ZONE(PROFILE_MM_RESET);
             //Method to unpress back limit switch
             //and then transition to stopped state.
 
-            motordirection.put(1);
-            motorpower.put(150);
-            Serial.println("inch forward"); // so we see this happened during debug
-            vTaskDelay(500); // experimental number to give it time to move forward
-            motordirection.put(1);
-            motorpower.put(0);
+            uint16_t moves = moves_done();
+            motor_command(1, INCH_SPEED, INCH_MM); // the speed loop stops once it has gone this far
+            log_print("inch forward"); // so we see this happened during debug
+            uint32_t inch_start = millis();
+            while (moves_done() == moves && millis() - inch_start < INCH_TIMEOUT_MS)
+            {
+                heartbeat(HEART_MASTERMIND); // still waiting for the move
+                vTaskDelay(10);
+            }
+            motor_command(1, 0);
             vTaskDelay(500); // let have time to come to a stop 
-            limitdetect_back.get(dir); // legacy from old method but still need to clear limitdetect
-            reset_this.put(1); // reset system when back limit switch hit
-            // crash_detect_active.put(1); // reset ToF active use flag
+            control_flags.clear(FLAG_BACK_BUMP); // clear the back bumper flag
+            control_flags.set(FLAG_RESET); // reset system when back limit switch hit
             state_m = 1;       // go back to waiting/hunting state
         }
         else // should never get here
         {
-            Serial.println("Something is very wrong in mastermind");
-            Serial.println("reinitializing");
+            log_print("Something is very wrong in mastermind, reinitializing");
             state_m = 0;    // reinitialize to try and fix things
         }
-        vTaskDelay(10); // Delays things so we can actually see stuff happening
+
+        // Delays things so we can actually see stuff happening, but wakes at once
+        // when the limit switch this state is waiting for is pressed
+        ControlFlag wake = (state_m == 1) ? FLAG_FRONT_BUMP
+                           : (state_m == 2) ? FLAG_BACK_BUMP : FLAG_NONE;
+        if (wake != FLAG_NONE)
+        {
+            control_flags.wait(wake, false, false, MASTERMIND_PERIOD_MS);
+        }
+        else
+        {
+            vTaskDelay(MASTERMIND_PERIOD_MS);
+        }
     }
 }
 
 void setup () 
 {
     // Start the serial port, wait a short time, then say hello. Use the
-    // non-RTOS delay() function because the RTOS hasn't been started yet
+    // non-RTOS delay() function because the RTOS hasn't been started yet.
+    // Keep this short; the robot is blind until the tasks are running
     Serial.begin (115200);
-    delay (2000);
+    delay (100);
     Serial << endl << endl << "ME507 UI Lab Starting Program" << endl;
 
+    // Start the cycle counter used by the profiling zones
+    profile_begin ();
+
+    // Empty the ring which holds messages until the log task prints them
+    log_begin ();
+
+    // Make the lock which the thermal camera and ToF tasks share the I2C bus with
+    i2c_bus_begin ();
+
+    // Report why the last restart happened, if a task hung, and start the
+    // watchdog; every task's heartbeat deadline starts now
+    supervisor_begin ();
+
     // Create a task which runs the thermal camera
     xTaskCreate (task_thermal,
                  "Simul.",
@@ -184,6 +386,14 @@ void setup ()
                  4,                               // Priority
                  NULL);
 
+    // creates a task which ranges with the time of flight sensor
+    xTaskCreate (task_tof,
+                 "ToF",
+                 512,                             // Stack size
+                 NULL,
+                 4,                               // Priority
+                 NULL);
+
     // creates a task that runs the motors
     xTaskCreate (task_motor,
                  "Simul.",
@@ -192,6 +402,49 @@ void setup ()
                  4,                               // Priority
                  NULL); 
 
+    // creates a task which stops the motors and restarts if a task hangs;
+    // it must run above every task it watches
+    xTaskCreate (task_supervisor,
+                 "Supervisor",
+                 256,                             // Stack size
+                 NULL,
+                 5,                               // Priority
+                 NULL);
+
+    // creates a task which prints logged messages, so no other task waits on the serial port
+    xTaskCreate (task_log,
+                 "Log",
+                 512,                             // Stack size
+                 NULL,
+                 1,                               // Priority
+                 NULL);
+
+    // creates a task which sends telemetry whenever nothing else needs to run
+    xTaskCreate (task_telemetry,
+                 "Telemetry",
+                 512,                             // Stack size
+                 NULL,
+                 1,                               // Priority
+                 NULL);
+
+    // creates a task which sends every share's stats as telemetry once a second
+    xTaskCreate (task_share_stats,
+                 "Share Stats",
+                 256,                             // Stack size
+                 NULL,
+                 1,                               // Priority
+                 NULL);
+
+    #ifdef SCROOMBA_PROFILE
+    // creates a task which prints the profile when a key is typed
+    xTaskCreate (task_profile,
+                 "Profile",
+                 512,                             // Stack size
+                 NULL,
+                 1,                               // Priority
+                 NULL);
+    #endif
+
     // If using an STM32, we need to call the scheduler startup function now;
     // if using an ESP32, it has already been called for us
     #if (defined STM32L4xx || defined STM32F4xx)
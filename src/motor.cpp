@@ -1,9 +1,10 @@
 /** @file motor.cpp
- *      This file contains a task that operates the motors based on the direction and power inpu
- *      sent by the mastermind task.
+ *      This file contains a task that operates the motors based on the direction, speed and
+ *      distance sent by the mastermind task.
  * 
- *  @details This task initializes the motors and operates their power and direction based
- *           on the configuration of the in pins, changing based on input from mastermind task.
+ *  @details This task initializes the motors and turns the direction and speed sent by the
+ *           mastermind task into a speed for each track, which the speed loop in drive.cpp
+ *           holds the tracks at through the ramp in motor_ramp.cpp.
  * 
  *  @author Michael Conn
  *  @author Scott Mangin
@@ -13,114 +14,109 @@
  */
 
 #include "motor.h"
+#include "motor_ramp.h"
+#include "drive.h"
+#include "profile.h"
+#include "telemetry.h"
+#include "supervisor.h"
 
-extern Queue<uint8_t> motordirection; ///<Super-boolean for direction of travel Queue
-extern Queue<uint8_t> motorpower; ///<Duty cycle value for designated motor pins Queue
+extern Queue<MotorCommand> motorcommand; ///<Direction, speed and distance from mastermind
+extern SeqShare<DriveState> drive_state; ///<Track travel and speeds, written by the speed loop
+
+//Set Pins for motors; the in pins belong to the ramp in motor_ramp.cpp
+const uint8_t enA = D2; ///<Motor A enable, PA_10
+const uint8_t enB = A4; ///<Motor B enable, PC_1
+
+/** @brief   Stops both motors at once, without waiting for the motor task.
+ *  @details This skips the ramp: both tracks' speed loops stop, their duties
+ *           go straight to zero and all four in pins are set low so both
+ *           motors coast. This is for emergencies; the motor task will start
+ *           the tracks again on its next command.
+ */
+void motor_stop_now (void)
+{
+    drive_stop_now();
+}
 
 /** @brief   Motor Driver and Direction task for both robot chassis motors, specific to Scroomba.
- *  @details This task initializes the motors and operates their power and direction based
- *           on the configuration of the in pins, changing based on input from mastermind task.
+ *  @details This task turns each direction and speed from mastermind into a
+ *           speed for each track, and leaves it to the speed loop in drive.cpp
+ *           to hold the tracks at those speeds. Forward and reverse drive both
+ *           tracks the same way; a left turn runs the left track backward and
+ *           the right one forward, and a right turn the opposite. A command
+ *           with a distance stops by itself once the tracks have gone that far.
+ *           While no commands come, the task still reports the tracks every
+ *           @c MOTOR_REPORT_MS. It only checks in with the supervisor when
+ *           the speed loop has run since its last pass, so a stopped speed
+ *           loop interrupt is caught as well as a stuck task.
  *  @param   p_params A pointer to function parameters which we don't use.
  */
 void task_motor (void* p_params)
 {
     (void)p_params;            // Does nothing but shut up a compiler warning  
 
-    //Set Pins for motors
-    const uint8_t enA = D2; //PA_10
-    const uint8_t enB = A4; //PC_1
-    const uint8_t in1 = D5; //PB_4
-    const uint8_t in2 = D4; //PB_5
-    const uint8_t in3 = A0; //PA_0
-    const uint8_t in4 = A1; //PA_1
-
-    //Set all used pins as output pins
+    //Set the enable pins as outputs and turn them on, since the motor driver only has PWM on in pins.
     pinMode(enA, OUTPUT);
     pinMode(enB, OUTPUT);
-    pinMode(in1, OUTPUT);
-    pinMode(in2, OUTPUT);
-    pinMode(in3, OUTPUT);
-    pinMode(in4, OUTPUT);
-
-    //Initialize the motor enable pins to be on, since motor driver only has PWM on in pins.
     digitalWrite(enA, HIGH);
     digitalWrite(enB, HIGH);
 
-    //Set variables
-    uint8_t motordata [2]; ///<Local array to store motor data sent by mastermind
-    uint8_t motorapwm = 0; //Variable to set the desired PWM in pin for motor A
-    uint8_t motorbpwm = 0; //Variable to set the desired PWM in pin for motor B
+    //Set up the in pins and start ramping, then start the speed loop which feeds the ramp
+    ramp_begin();
+    drive_begin();
+
+    uint32_t drive_runs = 0;   // speed loop runs seen at the last heartbeat
 
     for (;;)
     {
-        if(motorpower.any()) // flagged if mastermind sends a change to the motor power share
+        uint32_t runs = drive_state.num_writes();
+        if (runs != drive_runs)
         {
-            motordirection.get(motordata[0]);
-            motorpower.get(motordata[1]);
+            drive_runs = runs;
+            heartbeat(HEART_MOTOR); // still taking commands, and the speed loop is still running
+        }
+
+        // wait for mastermind to send a command; blocking here lets lower priority tasks run
+        MotorCommand command = {0, 0, 0}; ///<Left as no command if the wait runs out
+        motorcommand.get(command);
+
+        if (command.direction != 0)
+        {   // time only the work of applying the command
+            PROFILE_ZONE(PROFILE_MOTOR_APPLY);
 
-            //Set Direction
-            if(motordata[0] == 1) //Forwards Direction
+            float speed = command.speed_mmps / 1000.0;
+            float distance = command.distance_mm / 1000.0;
+            if(command.direction == 1) //Forwards Direction
             {
-                //The initialization of the pinmodes for the in pins shouldn't do anything, but the code breaks without it
-                pinMode(in1, OUTPUT);
-                pinMode(in2, OUTPUT);
-                pinMode(in3, OUTPUT);
-                pinMode(in4, OUTPUT);
-                
-                //Sets the direction through the configuration of in pins that are low and in pins that will be PWM
-                digitalWrite(in1, LOW);
-                digitalWrite(in4, LOW);
-                motorapwm = in2;
-                motorbpwm = in3;
+                drive_set_speed(speed, speed, distance);
             }
-            else if(motordata[0] == 2) //Reverse Direction
+            else if(command.direction == 2) //Reverse Direction
             {
-                //The initialization of the pinmodes for the in pins shouldn't do anything, but the code breaks without it
-                pinMode(in1, OUTPUT); 
-                pinMode(in2, OUTPUT);
-                pinMode(in3, OUTPUT);
-                pinMode(in4, OUTPUT);
-
-                //Sets the direction through the configuration of in pins that are low and in pins that will be PWM
-                digitalWrite(in2, LOW);
-                digitalWrite(in3, LOW);
-                motorapwm = in1;
-                motorbpwm = in4;    
+                drive_set_speed(-speed, -speed, distance);
             }
-            else if(motordata[0] == 3) //Left Turn
+            else if(command.direction == 3) //Left Turn
             {
-                //The initialization of the pinmodes for the in pins shouldn't do anything, but the code breaks without it
-                pinMode(in1, OUTPUT);
-                pinMode(in2, OUTPUT);
-                pinMode(in3, OUTPUT);
-                pinMode(in4, OUTPUT);
-                
-                //Sets the direction through the configuration of in pins that are low and in pins that will be PWM
-                digitalWrite(in1, LOW);
-                digitalWrite(in3, LOW);
-                motorapwm = in2;
-                motorbpwm = in4;
+                drive_set_speed(-speed, speed, distance);
             }
-            else if(motordata[0] == 4) //Right Turn
+            else if(command.direction == 4) //Right Turn
             {
-                //The initialization of the pinmodes for the in pins shouldn't do anything, but the code breaks without it
-                pinMode(in1, OUTPUT);
-                pinMode(in2, OUTPUT);
-                pinMode(in3, OUTPUT);
-                pinMode(in4, OUTPUT);
-                
-                //Sets the direction through the configuration of in pins that are low and in pins that will be PWM
-                digitalWrite(in2, LOW);
-                digitalWrite(in4, LOW);
-                motorapwm = in1;
-                motorbpwm = in3;
+                drive_set_speed(speed, -speed, distance);
             }
 
-            //Set PWM signal to the desired in pins of motor A and motor B
-            analogWrite(motorapwm, motordata[1]);
-            analogWrite(motorbpwm, motordata[1]);
+            TelemMotor applied = {millis(), command.direction, command.speed_mmps, command.distance_mm};
+            telemetry_send(TELEM_MOTOR, &applied, sizeof(applied));
+        }
 
-            vTaskDelay(10);
+        if (drive_state.num_writes() != 0) // once the speed loop has run
+        {
+            DriveState state;
+            drive_state.get(state);
+            TelemDrive report = {state.ms,
+                                 (int16_t)lround(state.left_mps * 1000), (int16_t)lround(state.right_mps * 1000),
+                                 (int16_t)lround(state.left_target * 1000), (int16_t)lround(state.right_target * 1000),
+                                 ramp_duty(RAMP_LEFT), ramp_duty(RAMP_RIGHT),
+                                 (int32_t)lround((state.left_m + state.right_m) * 500)};
+            telemetry_send(TELEM_DRIVE, &report, sizeof(report));
         }
     }
-}
\ No newline at end of file
+}
@@ -1,6 +1,6 @@
 /** @file motor.h
- *      This file contains a task that operates the motors based on the direction and power input
- *      sent by the mastermind task.
+ *      This file contains a task that operates the motors based on the direction, speed and
+ *      distance sent by the mastermind task.
  * 
  *  @brief Motor Driver and Direction task for both robot chassis motors, specific to Scroomba.
  * 
@@ -19,5 +19,19 @@
 #include <Wire.h>
 #include "taskqueue.h"
 
+/** @brief   A command from mastermind to the motor task.
+ */
+struct MotorCommand
+{
+    uint8_t direction;          ///< 1 forward, 2 reverse, 3 left, 4 right; 0 for no command
+    uint16_t speed_mmps;        ///< Track speed, mm/s; 0 to stop
+    uint16_t distance_mm;       ///< Distance to go before stopping, mm; 0 to keep going
+};
+
+/// Longest the motor task waits for a command before reporting the tracks anyway
+const uint16_t MOTOR_REPORT_MS = 50;
+
 
 void task_motor (void* p_params); // the task function
+
+void motor_stop_now (void); // stops both motors straight from the pins
@@ -0,0 +1,374 @@
+/** @file motor_ramp.cpp
+ *      This file contains the ramp generator which moves each track's PWM
+ *      duty toward the duty the speed loop asks for, a little at a time.
+ *
+ *  @details Jumping the duty from stopped to full, or from forward straight
+ *           to reverse, spins the tracks on the floor and pulls a large
+ *           current from the battery. Instead, the speed loop in drive.cpp
+ *           only sets a target duty for each track, and a timer interrupt running at
+ *           @c RAMP_RATE_HZ moves the duty on the pins toward it. The rate
+ *           at which the duty changes is limited to @c RAMP_ACCEL, and the
+ *           rate itself can only change by @c RAMP_JERK per second, so the
+ *           tracks ease into and out of each change. Near the target the
+ *           rate is cut back to what can be brought to zero in the distance
+ *           left, so the duty settles on the target without overshooting.
+ *           A change of direction ramps down through zero and back up.
+ *
+ *           The core's @c analogWrite() and @c pinMode() set up and tear
+ *           down a timer object on the heap, so they can't be called from
+ *           the interrupt. Instead @c ramp_begin() puts the in pins on their
+ *           timers' PWM channels once, and the interrupt only writes the
+ *           channels' compare registers. A pin which isn't driving sits at
+ *           zero duty, which holds it low.
+ *
+ *           Stopping at once is still possible: @c ramp_stop_now() throws
+ *           the ramps away and drives all four in pins low. The supervisor
+ *           and the front bumper use it, through @c drive_stop_now(). The
+ *           front bumper's interrupt first uses @c ramp_cut_now(), which
+ *           takes the pins off their timers altogether.
+ *
+ *           The timer interrupt runs at the lowest priority, below
+ *           FreeRTOS's critical sections, so it never changes the duties
+ *           while a task is in the middle of setting them.
+ */
+
+#include "motor_ramp.h"
+#if !(defined STM32L4xx || defined STM32F4xx)
+    #include "host.h"
+#endif
+
+//Set Pins for motors
+const uint8_t in1 = D5; ///<Motor A in pin, PB_4
+const uint8_t in2 = D4; ///<Motor A in pin, PB_5
+const uint8_t in3 = A0; ///<Motor B in pin, PA_0
+const uint8_t in4 = A1; ///<Motor B in pin, PA_1
+
+/// The in pins, in the order the tables below index them
+static const uint8_t ramp_pins[4] = {in1, in2, in3, in4};
+
+/** @brief   The ramp of one track.
+ */
+struct RampState
+{
+    uint8_t fwd;                ///< Index of the pin PWMed to drive forward
+    uint8_t rev;                ///< Index of the pin PWMed to drive backward
+    int16_t target;             ///< Duty to ramp to, -255 to 255
+    float effort;               ///< Duty now, less the dead band, counts
+    float rate;                 ///< Rate the effort is changing, counts/s
+    int16_t written;            ///< Duty on the pins now
+};
+
+/// Ramps of the left and right tracks, in @c RampTrack order
+static RampState ramps[RAMP_NUM_TRACKS] =
+{
+    {2, 3, 0, 0, 0, 0},
+    {1, 0, 0, 0, 0, 0}
+};
+
+#if (defined STM32L4xx || defined STM32F4xx)
+/// Port of each in pin, looked up once so that the interrupts needn't
+static GPIO_TypeDef* cut_ports[4];
+
+/// Bit of each in pin in its port
+static uint32_t cut_masks[4];
+
+/// Compare register which sets each in pin's duty
+static volatile uint32_t* pwm_ccrs[4];
+
+/// Timer counts in one PWM period of each in pin
+static uint32_t pwm_periods[4];
+#endif
+
+
+/** @brief   Take the dead band out of a duty.
+ *  @param   duty The duty, -255 to 255
+ *  @return  The part of the duty which turns the track
+ */
+static float ramp_effort (int16_t duty)
+{
+    int16_t above = max(abs(duty) - RAMP_DEAD_BAND, 0);
+    return (duty < 0 ? -above : above);
+}
+
+
+/** @brief   Put the dead band back into an effort.
+ *  @param   effort The part of the duty which turns the track
+ *  @return  The duty, -255 to 255, or 0 for no effort
+ */
+static int16_t ramp_duty_of (float effort)
+{
+    int16_t above = lround(fabs(effort));
+    if (above == 0)
+    {
+        return (0);
+    }
+    return (effort < 0 ? -(above + RAMP_DEAD_BAND) : above + RAMP_DEAD_BAND);
+}
+
+
+/** @brief   Put a duty on one in pin.
+ *  @details On the STM32 this is one write to the pin's compare register,
+ *           so it is safe in an interrupt. The duty scales to the timer's
+ *           period, so 255 keeps the pin high all the time.
+ *  @param   n Index of the pin in @c ramp_pins
+ *  @param   duty The duty, 0 to 255
+ */
+static void ramp_pwm (uint8_t n, uint8_t duty)
+{
+#if (defined STM32L4xx || defined STM32F4xx)
+    *pwm_ccrs[n] = duty * pwm_periods[n] / 255;
+#else
+    analogWrite(ramp_pins[n], duty);
+#endif
+}
+
+
+/** @brief   Put a duty on a track's pins if it differs from the one there.
+ *  @details When the direction changes, the pin which was PWMed is set to
+ *           zero duty before the other pin is PWMed.
+ *  @param   ramp The track's ramp
+ *  @param   duty The duty, -255 to 255
+ */
+static void ramp_write (RampState& ramp, int16_t duty)
+{
+    if (duty == ramp.written)
+    {
+        return;
+    }
+
+    int8_t sign = (duty > 0) - (duty < 0);
+    int8_t old_sign = (ramp.written > 0) - (ramp.written < 0);
+    if (sign != old_sign && old_sign != 0)
+    {
+        ramp_pwm(old_sign > 0 ? ramp.fwd : ramp.rev, 0);
+    }
+    if (sign != 0)
+    {
+        ramp_pwm(sign > 0 ? ramp.fwd : ramp.rev, abs(duty));
+    }
+    ramp.written = duty;
+}
+
+
+/** @brief   Interrupt which moves each track's duty one step toward its
+ *           target.
+ *  @details The ramp works on the effort, which is the duty less the dead
+ *           band, so a track starting from rest or changing direction steps
+ *           straight to the edge of the dead band instead of ramping through
+ *           duties which don't move it.
+ */
+static void ramp_isr (void)
+{
+    const float dt = 1.0 / RAMP_RATE_HZ;
+
+    for (uint8_t track = 0; track < RAMP_NUM_TRACKS; track++)
+    {
+        RampState& ramp = ramps[track];
+        float error = ramp_effort(ramp.target) - ramp.effort;
+
+        // Fastest rate from which the duty can still ease to a stop at the
+        // target, then change the rate toward it no faster than the jerk
+        float reach = sqrt(2 * RAMP_JERK * fabs(error));
+        float want = copysign(min(RAMP_ACCEL, reach), error);
+        ramp.rate += constrain(want - ramp.rate, -RAMP_JERK * dt, RAMP_JERK * dt);
+
+        float step = ramp.rate * dt;
+        if (step * error > 0 && fabs(step) >= fabs(error))
+        {
+            ramp.effort += error;      // arrived; the rate left is tiny
+            ramp.rate = 0;
+        }
+        else
+        {
+            ramp.effort += step;
+        }
+        ramp_write(ramp, ramp_duty_of(ramp.effort));
+    }
+}
+
+
+#if (defined STM32L4xx || defined STM32F4xx)
+
+// The L476 has basic timers which no pin uses; some F4 parts don't
+#ifdef TIM6
+    #define RAMP_TIMER TIM6
+#else
+    #define RAMP_TIMER TIM11
+#endif
+
+/** @brief   Put the in pins on their timers' PWM channels at zero duty.
+ *  @details D5 and D4 (PB4 and PB5) are channels 1 and 2 of TIM3, and A0 and
+ *           A1 (PA0 and PA1) are channels 1 and 2 of TIM2, the same channels
+ *           @c analogWrite() used. The core sets up each pin's alternate
+ *           function and starts the timers; after that only the compare
+ *           registers change.
+ */
+static void ramp_pwm_begin (void)
+{
+    HardwareTimer* p_tim3 = new HardwareTimer (TIM3);
+    HardwareTimer* p_tim2 = new HardwareTimer (TIM2);
+    HardwareTimer* p_timers[] = {p_tim3, p_tim3, p_tim2, p_tim2};
+    TIM_TypeDef* p_regs[] = {TIM3, TIM3, TIM2, TIM2};
+    const uint32_t channels[] = {1, 2, 1, 2};
+
+    for (uint8_t n = 0; n < 4; n++)
+    {
+        p_timers[n]->setPWM (channels[n], ramp_pins[n], RAMP_PWM_HZ, 0);
+        pwm_ccrs[n] = channels[n] == 1 ? &p_regs[n]->CCR1 : &p_regs[n]->CCR2;
+        pwm_periods[n] = p_regs[n]->ARR + 1;
+        cut_ports[n] = digitalPinToPort(ramp_pins[n]);
+        cut_masks[n] = digitalPinToBitMask(ramp_pins[n]);
+    }
+}
+
+
+/** @brief   Start the timer which runs the ramp interrupt.
+ */
+static void ramp_timer_start (void)
+{
+    HardwareTimer* p_timer = new HardwareTimer (RAMP_TIMER);
+    p_timer->setOverflow (RAMP_RATE_HZ, HERTZ_FORMAT);
+    p_timer->attachInterrupt (ramp_isr);
+    p_timer->resume ();
+}
+
+#else
+
+/** @brief   Set the simulated in pins low; they take duties as they come.
+ */
+static void ramp_pwm_begin (void)
+{
+    for (uint8_t pin : ramp_pins)
+    {
+        digitalWrite(pin, LOW);
+    }
+}
+
+
+/** @brief   Start the simulated kernel's timer which runs the ramp interrupt.
+ */
+static void ramp_timer_start (void)
+{
+    host_timer_start (1000000 / RAMP_RATE_HZ, ramp_isr);
+}
+
+#endif // STM32L4xx || STM32F4xx
+
+
+/** @brief   Set up the motor pins and start the ramp interrupt.
+ *  @details The PWM timers are set up here, in a task, since the core
+ *           allocates memory to do it. All four pins are left at zero duty.
+ */
+void ramp_begin (void)
+{
+    ramp_pwm_begin();
+    ramp_timer_start();
+}
+
+
+/** @brief   Set the duty each track should ramp to.
+ *  @details Both targets are set together, so the interrupt never ramps one
+ *           track toward a new command and the other toward the old one.
+ *           This may be called from a task or an interrupt; the speed loop
+ *           in drive.cpp calls it from its own.
+ *  @param   left Duty for the left track, -255 (full reverse) to 255
+ *  @param   right Duty for the right track, -255 (full reverse) to 255
+ */
+void ramp_set_target (int16_t left, int16_t right)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    ramps[RAMP_LEFT].target = constrain(left, (int16_t)-255, (int16_t)255);
+    ramps[RAMP_RIGHT].target = constrain(right, (int16_t)-255, (int16_t)255);
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+
+/** @brief   Throw both ramps away, leaving them stopped with zero targets.
+ */
+static void ramp_reset (void)
+{
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    for (RampState& ramp : ramps)
+    {
+        ramp.target = 0;
+        ramp.effort = 0;
+        ramp.rate = 0;
+        ramp.written = 0;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+}
+
+
+/** @brief   Stop both tracks at once, skipping the ramp.
+ *  @details The ramps are reset to stopped before the pins are, so if the
+ *           interrupt runs in between it only writes zero again. All four
+ *           in pins are set to zero duty so both motors coast, and any pin
+ *           which @c ramp_cut_now() took off its timer is put back on it.
+ *           Interrupts are masked while the port modes change, so the cut
+ *           can't land in the middle. Both targets are left at zero, so the
+ *           tracks only move again when the speed loop asks. This may be
+ *           called from a task or an interrupt.
+ */
+void ramp_stop_now (void)
+{
+    ramp_reset();
+
+#if (defined STM32L4xx || defined STM32F4xx)
+    UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR();
+    for (uint8_t n = 0; n < 4; n++)
+    {
+        GPIO_TypeDef* p_port = cut_ports[n];
+        uint32_t shift = 2 * __builtin_ctz(cut_masks[n]);
+        *pwm_ccrs[n] = 0;
+        p_port->MODER = (p_port->MODER & ~(3UL << shift)) | (2UL << shift);
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(mask);
+#else
+    for (uint8_t pin : ramp_pins)
+    {
+        digitalWrite(pin, LOW);
+    }
+#endif
+}
+
+
+/** @brief   Stop both tracks as fast as the processor can, from an
+ *           interrupt.
+ *  @details The ramps are reset as in @c ramp_stop_now(). Then each in pin's
+ *           output latch is cleared and the pin is switched from its timer
+ *           to a plain output, two register writes per pin, so the pins go
+ *           low at once rather than at the end of the PWM period. Any duty
+ *           written to them afterward leaves them low until
+ *           @c ramp_stop_now() puts them back on their timers. A
+ *           @c pinMode() call which this interrupts on the same port can put
+ *           a pin back on its timer; that call also puts things right.
+ */
+void ramp_cut_now (void)
+{
+    ramp_reset();
+
+#if (defined STM32L4xx || defined STM32F4xx)
+    for (uint8_t n = 0; n < 4; n++)
+    {
+        GPIO_TypeDef* p_port = cut_ports[n];
+        uint32_t shift = 2 * __builtin_ctz(cut_masks[n]);
+        p_port->BSRR = cut_masks[n] << 16;
+        p_port->MODER = (p_port->MODER & ~(3UL << shift)) | (1UL << shift);
+    }
+#else
+    for (uint8_t pin : ramp_pins)
+    {
+        digitalWrite(pin, LOW);
+    }
+#endif
+}
+
+
+/** @brief   Get the duty a track is being driven at right now.
+ *  @param   track Which track, from @c RampTrack
+ *  @return  The duty on its pins, -255 (full reverse) to 255
+ */
+int16_t ramp_duty (uint8_t track)
+{
+    return (ramps[track].written);
+}
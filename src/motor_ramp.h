@@ -0,0 +1,58 @@
+/** @file motor_ramp.h
+ *      This file contains the ramp generator which moves each track's PWM
+ *      duty toward the duty the speed loop asks for, a little at a time.
+ *
+ *  @brief  Acceleration and jerk limited duty ramps for both tracks, run by a 1 kHz timer interrupt.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _MOTOR_RAMP_H_
+#define _MOTOR_RAMP_H_
+
+#include <Arduino.h>
+#if (defined STM32L4xx || defined STM32F4xx)
+    #include <STM32FreeRTOS.h>
+#endif
+#include "FreeRTOS.h"
+
+/// How often the ramp interrupt moves the duties
+const uint16_t RAMP_RATE_HZ = 1000;
+
+/// PWM frequency on the in pins, the same as @c analogWrite() used
+const uint32_t RAMP_PWM_HZ = 1000;
+
+/// Fastest change of duty, counts per second; 0 to full takes about 0.1 s,
+/// close to how long the tracks themselves take to get up to speed
+const float RAMP_ACCEL = 4000;
+
+/// Fastest change of that rate, counts per second per second
+const float RAMP_JERK = 100000;
+
+/// Duty below which the tracks don't turn; the ramp steps over it
+const int16_t RAMP_DEAD_BAND = 40;
+
+/// The two tracks, as the ramp numbers them
+enum RampTrack
+{
+    RAMP_LEFT,                  ///< Motor B, pins in3 and in4
+    RAMP_RIGHT,                 ///< Motor A, pins in1 and in2
+    RAMP_NUM_TRACKS             ///< Number of tracks
+};
+
+// Set up the motor pins and start the ramp interrupt
+void ramp_begin (void);
+
+// Set the duty each track should ramp to, -255 (full reverse) to 255
+void ramp_set_target (int16_t left, int16_t right);
+
+// Stop both tracks at once, skipping the ramp
+void ramp_stop_now (void);
+
+// Stop both tracks with a few register writes, from an interrupt; a call to
+// ramp_stop_now() from a task must follow before they are driven again
+void ramp_cut_now (void);
+
+// Get the duty a track is being driven at right now
+int16_t ramp_duty (uint8_t track);
+
+#endif // _MOTOR_RAMP_H_
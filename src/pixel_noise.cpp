@@ -0,0 +1,75 @@
+/** @file pixel_noise.cpp
+ *      This file contains the statistics used to judge whether a thermal camera
+ *      pixel is seeing a person or just its own noise.
+ *
+ *  @details Each pixel of the AMG88xx has its own noise level; the edge pixels
+ *           are a good deal noisier than the middle ones. During calibration
+ *           the decoder keeps a running mean and squared deviation for every
+ *           pixel with Welford's method, which needs no extra buffer and
+ *           doesn't lose precision the way a sum of squares does. Once
+ *           calibration is done, each pixel's squared deviation is replaced by
+ *           the temperature rise that pixel must see for a detection, so the
+ *           whole scheme costs just two 64-element arrays.
+ */
+
+#include "pixel_noise.h"
+
+/// Chance that any one pixel of a frame is falsely seen as a person
+TUNABLE float DETECT_FALSE_ALARM_RATE = 1e-4;
+
+
+/** @brief   Add a calibration sample to a pixel's running statistics.
+ *  @param   mean Reference to the pixel's running mean
+ *  @param   m2 Reference to the pixel's running sum of squared deviations
+ *  @param   sample The new temperature reading for the pixel
+ *  @param   n The number of samples including this one
+ */
+void welford_add (float& mean, float& m2, float sample, uint8_t n)
+{
+    if (n <= 1)     // special case for the first sample
+    {
+        mean = sample;
+        m2 = 0;
+    }
+    else
+    {
+        float delta = sample - mean;
+        mean += delta / n;
+        m2 += delta * (sample - mean);
+    }
+}
+
+
+/** @brief   Find the temperature rise a pixel must see to detect a person.
+ *  @details The limit is @c z times the pixel's standard deviation, but never
+ *           less than @c DETECT_MIN_DELTA so that very quiet pixels don't
+ *           trigger on a draft.
+ *  @param   m2 The pixel's sum of squared deviations from calibration
+ *  @param   n The number of calibration samples
+ *  @param   z The number of standard deviations to allow, from @c tail_z()
+ *  @return  The temperature rise over ambient which counts as a detection
+ */
+float detection_limit (float m2, uint8_t n, float z)
+{
+    float sigma = (n > 1) ? sqrt (m2 / (n - 1)) : 0;
+
+    return (max (z * sigma, DETECT_MIN_DELTA));
+}
+
+
+/** @brief   Find how many standard deviations give a one-sided tail
+ *           probability of a normal distribution.
+ *  @details This uses the rational approximation 26.2.23 from Abramowitz and
+ *           Stegun, which is good to 4.5e-4 and is cheap enough to run once
+ *           at the end of calibration.
+ *  @param   p The probability of a sample landing above the result, between
+ *           0 and 0.5
+ *  @return  The number of standard deviations above the mean
+ */
+float tail_z (float p)
+{
+    float t = sqrt (-2 * log (p));
+
+    return (t - (2.515517 + 0.802853 * t + 0.010328 * t * t)
+                / (1 + 1.432788 * t + 0.189269 * t * t + 0.001308 * t * t * t));
+}
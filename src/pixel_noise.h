@@ -0,0 +1,30 @@
+/** @file pixel_noise.h
+ *      This file contains the statistics used to judge whether a thermal camera
+ *      pixel is seeing a person or just its own noise.
+ *
+ *  @brief Per-pixel noise estimation and adaptive detection limits for the thermal decoder.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _PIXEL_NOISE_H_
+#define _PIXEL_NOISE_H_
+
+#include <Arduino.h>
+#include "tuning.h"
+
+// Chance that any one pixel of a frame is falsely seen as a person
+extern TUNABLE float DETECT_FALSE_ALARM_RATE;
+
+/// Smallest temperature rise over ambient ever counted as a person
+const float DETECT_MIN_DELTA = 1.0;
+
+// Add a calibration sample to a pixel's running mean and squared deviation
+void welford_add (float& mean, float& m2, float sample, uint8_t n);
+
+// Turn a pixel's squared deviation into the rise it must see to detect
+float detection_limit (float m2, uint8_t n, float z);
+
+// Find how many standard deviations give a one-sided tail probability
+float tail_z (float p);
+
+#endif // _PIXEL_NOISE_H_
@@ -0,0 +1,118 @@
+/** @file profile.cpp
+ *      This file contains scoped profiling zones which time hot pieces of the
+ *      tasks with the processor's cycle counter.
+ *
+ *  @details Each zone's totals live in one static table indexed by the zone's
+ *           number, so adding a run is a few adds and compares with no
+ *           searching. Each zone is only used from one task or interrupt, so
+ *           no locking is needed to add to it; a printout taken while a zone
+ *           is being updated may be off by one run.
+ */
+
+#include <PrintStream.h>
+#if (defined STM32L4xx || defined STM32F4xx)
+    #include <STM32FreeRTOS.h>
+#endif
+#include "FreeRTOS.h"
+#include "profile.h"
+
+/// Names printed in the table, in the same order as @c ProfileZoneId
+static const char* const profile_names[PROFILE_NUM_ZONES] =
+{
+    "Decode frame",
+    "Calib limits",
+    "Read pixels",
+    "Motor apply",
+    "MM init",
+    "MM hunt",
+    "MM reverse",
+    "MM reset",
+    "Bump reflex"
+};
+
+#ifdef SCROOMBA_PROFILE
+
+/// Timing totals for every zone
+static ProfileStat profile_table[PROFILE_NUM_ZONES];
+
+
+/** @brief   Add one run to a zone's totals.
+ *  @param   zone The zone, from @c ProfileZoneId
+ *  @param   cycles The cycles the run took
+ */
+void profile_add (uint8_t zone, uint32_t cycles)
+{
+    ProfileStat& stat = profile_table[zone];
+
+    if (stat.count == 0 || cycles < stat.least)
+    {
+        stat.least = cycles;
+    }
+    if (cycles > stat.most)
+    {
+        stat.most = cycles;
+    }
+    stat.total += cycles;
+    stat.count++;
+}
+
+#endif // SCROOMBA_PROFILE
+
+
+/** @brief   Start the cycle counter so the zones can be timed.
+ *  @details This must be called in @c setup() before any task runs.
+ */
+void profile_begin (void)
+{
+#ifdef SCROOMBA_PROFILE
+    cycle_count_begin ();
+#endif
+}
+
+
+/** @brief   Print the table of zone timings.
+ *  @param   printer Reference to a serial device on which to print
+ */
+void profile_print (Print& printer)
+{
+#ifdef SCROOMBA_PROFILE
+    printer.println ("Zone            Count     Min        Mean       Max (cycles)");
+    printer.println ("----            -----     ---        ----       ---");
+
+    for (uint8_t zone = 0; zone < PROFILE_NUM_ZONES; zone++)
+    {
+        const ProfileStat& stat = profile_table[zone];
+        uint32_t mean = stat.count ? stat.total / stat.count : 0;
+        printer.printf ("%-16s%-10lu%-11lu%-11lu%lu\n", profile_names[zone],
+                        (unsigned long)stat.count, (unsigned long)stat.least,
+                        (unsigned long)mean, (unsigned long)stat.most);
+    }
+#else
+    (void)profile_names;
+    printer.println ("Profiling is off; build with SCROOMBA_PROFILE");
+#endif
+}
+
+
+/** @brief   Task which prints the profile whenever a key is typed.
+ *  @details This only looks at the serial port a few times a second and
+ *           sleeps in between, so it doesn't disturb what is being timed.
+ *  @param   p_params A pointer to function parameters which we don't use.
+ */
+void task_profile (void* p_params)
+{
+    (void)p_params;            // Does nothing but shut up a compiler warning
+
+    for (;;)
+    {
+        if (Serial.available ())
+        {
+            while (Serial.available ())
+            {
+                Serial.read ();
+            }
+            profile_print (Serial);
+        }
+        vTaskDelay (200);
+    }
+}
@@ -0,0 +1,92 @@
+/** @file profile.h
+ *      This file contains scoped profiling zones which time hot pieces of the
+ *      tasks with the processor's cycle counter.
+ *
+ *  @brief Cycle-counting profiling zones which compile to nothing unless @c SCROOMBA_PROFILE is defined.
+ *
+ *  @details Put @c PROFILE_ZONE(id) at the top of a block and the time from
+ *           there to the end of the block is added to that zone's count,
+ *           fewest, most and total cycles. Zones measure elapsed time, so any
+ *           time the task spends blocked or preempted inside the block counts
+ *           too. Without @c SCROOMBA_PROFILE the macro is empty and costs
+ *           nothing; build the @c profile_l476rg environment to turn it on.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <Arduino.h>
+#include "cycle_count.h"
+
+/// The places which are timed; each has one line in the profile table
+enum ProfileZoneId
+{
+    PROFILE_DECODE_FRAME,       ///< Decoding one thermal camera frame
+    PROFILE_CALIB_LIMITS,       ///< Finishing calibration of all pixels
+    PROFILE_READ_PIXELS,        ///< Reading a frame from the AMG88xx
+    PROFILE_MOTOR_APPLY,        ///< Applying a motor command to the pins
+    PROFILE_MM_INIT,            ///< Mastermind initialization state
+    PROFILE_MM_HUNT,            ///< Mastermind waiting/hunting state
+    PROFILE_MM_REVERSE,         ///< Mastermind reverse state
+    PROFILE_MM_RESET,           ///< Mastermind reset state
+    PROFILE_BUMP_REFLEX,        ///< Front bumper interrupt stopping the tracks
+    PROFILE_NUM_ZONES
+};
+
+#ifdef SCROOMBA_PROFILE
+
+/** @brief   Timing totals for one profiling zone.
+ */
+struct ProfileStat
+{
+    uint32_t count;             ///< Times the zone was run
+    uint32_t least;             ///< Fewest cycles taken
+    uint32_t most;              ///< Most cycles taken
+    uint64_t total;             ///< Sum of cycles taken, for the mean
+};
+
+// Add one run to a zone's totals
+void profile_add (uint8_t zone, uint32_t cycles);
+
+/** @brief   Times the block it is created in.
+ *  @details The constructor reads the cycle counter and the destructor adds
+ *           the cycles since then to the zone's totals. Use it through the
+ *           @c PROFILE_ZONE() macro rather than directly.
+ */
+class ProfileZone
+{
+    protected:
+        uint8_t zone;           ///< Which zone this run belongs to
+        uint32_t start;         ///< Cycle count at the top of the block
+
+    public:
+        ProfileZone (uint8_t id) : zone (id), start (cycle_count ())
+        {
+        }
+
+        ~ProfileZone (void)
+        {
+            profile_add (zone, cycle_count () - start);
+        }
+};
+
+/// Time the rest of the enclosing block as the given zone
+#define PROFILE_ZONE(id) ProfileZone profile_zone_ (id)
+
+#else
+
+#define PROFILE_ZONE(id)
+
+#endif // SCROOMBA_PROFILE
+
+// Start the cycle counter
+void profile_begin (void);
+
+// Print the table of zone timings
+void profile_print (Print& printer);
+
+// Task which prints the table whenever a key is typed on the serial port
+void task_profile (void* p_params);
+
+#endif // _PROFILE_H_
@@ -0,0 +1,193 @@
+/** @file seqshare.h
+ *      This file contains a share for data too big to copy atomically, which
+ *      one task or interrupt writes and any number of tasks and interrupts
+ *      read without locks.
+ *
+ *  @brief Single writer share whose readers check a sequence count instead of masking interrupts.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _SEQSHARE_H_
+#define _SEQSHARE_H_
+
+#include <Arduino.h>
+#include <atomic>
+#include <type_traits>
+#include <string.h>
+#include "FreeRTOS.h"                       // Main header for FreeRTOS
+#include "baseshare.h"
+
+
+/** @brief   Share for multi-word data with one writer and lock-free readers.
+ *  @details A @c Share of a large struct copies the whole struct inside a
+ *           critical section, so interrupts stay masked for the whole copy.
+ *           A @c SeqShare never masks interrupts and its writer never waits.
+ *           It keeps two copies of the data and a sequence count. The writer
+ *           makes the count odd, writes the first copy, makes it even again
+ *           and writes the second copy; readers read the first copy while
+ *           the count is even and the second while it is odd, then check that
+ *           the count didn't change while they copied, and copy again if it
+ *           did.
+ *
+ *           Because one copy is always complete, a reader in an interrupt
+ *           which has interrupted the writer finishes in one pass. A task
+ *           only has to copy again if the writer runs while it is copying,
+ *           and those retries are counted and shown in the list of shares
+ *           along with the number of writes.
+ *
+ *           Only one task or interrupt may ever call @c put(); two writers
+ *           would corrupt the data. The data must be plain bytes which can
+ *           be copied with @c memcpy().
+ */
+template <class DataType> class SeqShare : public BaseShare
+{
+    static_assert (std::is_trivially_copyable<DataType>::value,
+                   "SeqShare data must be copyable as plain bytes");
+
+    protected:
+        DataType copies[2];                   ///< Two copies of the data
+        std::atomic<uint32_t> sequence;       ///< Bumped twice by each write
+        std::atomic<uint32_t> retries;        ///< Copies readers had to redo
+
+    public:
+        // Construct a sequence counted share
+        SeqShare (const char* p_name = NULL);
+
+        // Write new data; only one task or interrupt may do this
+        void put (const DataType& new_data);
+
+        // Read the data from a task
+        void get (DataType& recv_data);
+
+        // Read the data from an interrupt service routine
+        void ISR_get (DataType& recv_data);
+
+        /** @brief   Tell how many times the data has been written.
+         *  @return  The number of writes since the share was made
+         */
+        uint32_t num_writes (void)
+        {
+            return (puts);
+        }
+
+        /** @brief   Tell how many times readers had to copy the data again.
+         *  @return  The number of retries since the share was made
+         */
+        uint32_t num_retries (void)
+        {
+            return (retries.load (std::memory_order_relaxed));
+        }
+
+        // Print the share's status within a list of all shares' statuses
+        void print_in_list (Print& print_dev);
+
+        // Fill in the numbers which describe this share's condition
+        void get_stats (ShareStats& stats);
+};
+
+
+/** @brief   Construct a sequence counted share.
+ *  @details As with @c Share, the data is @b not initialized; it's best to
+ *           @c put() something before any task reads it.
+ *  @param   p_name A name to be shown in the list of task shares
+ *           (default @c NULL)
+ */
+template <class DataType>
+SeqShare<DataType>::SeqShare (const char* p_name)
+    : BaseShare (p_name), sequence (0), retries (0)
+{
+}
+
+
+/** @brief   Write new data into the share.
+ *  @details This never waits and never masks interrupts. It may be called
+ *           from a task or from an interrupt, but all writes must come from
+ *           the same one.
+ *  @param   new_data The data which is to be written
+ */
+template <class DataType>
+void SeqShare<DataType>::put (const DataType& new_data)
+{
+    uint32_t count = sequence.load (std::memory_order_relaxed);
+
+    // Send readers to the second copy while the first is written. The
+    // readers run on this core, so only the compiler has to be kept from
+    // moving the copy ahead of the count; the signal fence does that
+    sequence.store (count + 1, std::memory_order_relaxed);
+    std::atomic_signal_fence (std::memory_order_seq_cst);
+    memcpy (&copies[0], &new_data, sizeof (DataType));
+
+    // Then back to the first while the second catches up; the release store
+    // keeps the first copy ahead of it, and the fence keeps the second after
+    sequence.store (count + 2, std::memory_order_release);
+    std::atomic_signal_fence (std::memory_order_seq_cst);
+    memcpy (&copies[1], &new_data, sizeof (DataType));
+
+    puts++;
+}
+
+
+/** @brief   Read the data from within a task.
+ *  @details If the writer runs while the data is being copied, the copy is
+ *           made again, so the data received is always one whole write.
+ *  @param   recv_data A reference to the variable in which to put the data
+ */
+template <class DataType>
+void SeqShare<DataType>::get (DataType& recv_data)
+{
+    for (;;)
+    {
+        uint32_t count = sequence.load (std::memory_order_acquire);
+        memcpy (&recv_data, &copies[count & 1], sizeof (DataType));
+        std::atomic_thread_fence (std::memory_order_acquire);
+        if (sequence.load (std::memory_order_relaxed) == count)
+        {
+            gets++;
+            return;
+        }
+        retries.fetch_add (1, std::memory_order_relaxed);
+    }
+}
+
+
+/** @brief   Read the data from within an interrupt service routine.
+ *  @details The writer can't run during an interrupt which interrupted it,
+ *           so this reads the complete copy in one pass. It must not be used
+ *           by a task.
+ *  @param   recv_data A reference to the variable in which to put the data
+ */
+template <class DataType>
+void SeqShare<DataType>::ISR_get (DataType& recv_data)
+{
+    get (recv_data);
+}
+
+
+/** @brief   Print the name, writes and retries of this share.
+ *  @details This function makes one line of the list of all the shares and
+ *           queues in the system printed by @c print_all_shares().
+ *  @param   print_dev Reference to a serial device on which to print
+ */
+template <class DataType>
+void SeqShare<DataType>::print_in_list (Print& print_dev)
+{
+    print_dev.printf ("%-16sseqshare\t%lu writes, %lu retries\n", name,
+                      (unsigned long)num_writes (),
+                      (unsigned long)num_retries ());
+}
+
+
+/** @brief   Fill in the numbers which describe this share's condition.
+ *  @details Readers never wait, so the times they had to read again are given
+ *           as the share's blocks.
+ *  @param   stats The structure to fill in
+ */
+template <class DataType>
+void SeqShare<DataType>::get_stats (ShareStats& stats)
+{
+    BaseShare::get_stats (stats);
+    stats.kind = SHARE_KIND_SEQSHARE;
+    stats.blocks = num_retries ();
+}
+
+#endif // _SEQSHARE_H_
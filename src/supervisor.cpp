@@ -0,0 +1,324 @@
+/** @file supervisor.cpp
+ *      This file contains a supervisor which stops the motors and restarts
+ *      the robot when a task stops checking in.
+ *
+ *  @details A task which hangs, such as the decoder stuck in a loop or the
+ *           thermal camera task spinning after the sensor fails, would
+ *           otherwise leave the motors running the last command forever. Each
+ *           supervised task stores the time in its heartbeat slot every time
+ *           around its loop; a slot is one word, so this is a single store
+ *           with no locking. The supervisor runs at a higher priority than
+ *           any of them, so a task spinning without ever waiting can't hold
+ *           it off. When a heartbeat is later than its deadline, it stops the
+ *           motors from the pins without waiting for the motor task, saves a
+ *           fault record in the RTC backup registers, which keep their
+ *           contents through a restart, and restarts the processor at once.
+ *           The next power-up logs the record.
+ *
+ *           The supervisor only refreshes the independent watchdog while it
+ *           is running, so if interrupts are left masked or the scheduler
+ *           stops, the watchdog restarts the processor within
+ *           @c WATCHDOG_TIMEOUT_MS. The watchdog is stopped while a debugger
+ *           holds the processor. The simulator can't restart the firmware,
+ *           so there the supervisor only reports the fault and keeps the
+ *           motors stopped.
+ */
+
+#include <atomic>
+#include <PrintStream.h>
+#include "supervisor.h"
+#include "motor.h"
+#include "console_log.h"
+#if (defined STM32L4xx || defined STM32F4xx)
+    #include <backup.h>
+#endif
+
+/// Names used in fault reports, in the same order as @c HeartbeatTask
+static const char* const heart_names[HEART_NUM_TASKS] =
+{
+    "Thermal",
+    "Decoder",
+    "Mastermind",
+    "Limit front",
+    "Limit back",
+    "ToF",
+    "Motor"
+};
+
+/// Longest time each task may go without a heartbeat, in milliseconds
+static const uint16_t heart_deadline_ms[HEART_NUM_TASKS] =
+{
+    500,            // reads a frame every 100 ms or so
+    500,            // decodes every frame the camera reads
+    2000,           // checks in while waiting for the reset state's move
+    1000,           // waits half a second while the flag is up
+    1000,           // waits half a second while the flag is up
+    500,            // ranges every 20 ms, or looks for the sensor 4 times a second
+    500             // waits 50 ms at most for a command; the speed loop runs every 10 ms
+};
+
+/// Time of each task's last heartbeat, from @c millis()
+static std::atomic<uint32_t> heart_last_ms[HEART_NUM_TASKS];
+
+/// Marks a saved fault record; the low bits hold the task which missed
+const uint32_t FAULT_MAGIC = 0x5C0F0000;
+
+/// Backup registers which hold the fault record
+enum FaultRegister
+{
+    FAULT_REG_TAG = 1,          ///< @c FAULT_MAGIC plus the task's number
+    FAULT_REG_LATE = 2,         ///< Time since its last heartbeat, ms
+    FAULT_REG_UPTIME = 3,       ///< Time since power-up at the fault, ms
+    FAULT_REG_COUNT = 4         ///< Faults since the backup domain was reset
+};
+
+
+#if (defined STM32L4xx || defined STM32F4xx)
+
+/** @brief   Allow the backup registers to be written.
+ */
+static void fault_begin (void)
+{
+    enableBackupDomain ();
+}
+
+
+/** @brief   Read a word which was kept through the last restart.
+ *  @param   reg Which word, from @c FaultRegister
+ *  @return  The word
+ */
+static uint32_t fault_read (uint8_t reg)
+{
+    return (getBackupRegister (reg));
+}
+
+
+/** @brief   Save a word which will be kept through a restart.
+ *  @param   reg Which word, from @c FaultRegister
+ *  @param   value The word to save
+ */
+static void fault_write (uint8_t reg, uint32_t value)
+{
+    setBackupRegister (reg, value);
+}
+
+
+/** @brief   Tell whether the watchdog caused the last restart, and clear the
+ *           restart flags.
+ *  @return  @c true if the watchdog restarted the processor
+ */
+static bool watchdog_caused_reset (void)
+{
+    bool caused = (RCC->CSR & RCC_CSR_IWDGRSTF) != 0;
+    RCC->CSR |= RCC_CSR_RMVF;
+    return (caused);
+}
+
+
+/** @brief   Start the independent watchdog.
+ *  @details The watchdog counts down from its own 32 kHz oscillator, divided
+ *           by 8 to give four counts per millisecond. Once started it can't be
+ *           stopped except by a restart.
+ */
+static void watchdog_start (void)
+{
+    #ifdef STM32L4xx
+        DBGMCU->APB1FZR1 |= DBGMCU_APB1FZR1_DBG_IWDG_STOP;
+    #else
+        DBGMCU->APB1FZ |= DBGMCU_APB1_FZ_DBG_IWDG_STOP;
+    #endif
+
+    IWDG->KR = 0xCCCC;                      // start the watchdog
+    IWDG->KR = 0x5555;                      // allow the divider to be set
+    IWDG->PR = 1;                           // divide by 8
+    IWDG->RLR = WATCHDOG_TIMEOUT_MS * 4;
+    while (IWDG->SR != 0)
+    {
+        // wait for the new settings to reach the watchdog
+    }
+    IWDG->KR = 0xAAAA;                      // start counting from the top
+}
+
+
+/** @brief   Put off the watchdog's restart for another timeout.
+ */
+static void watchdog_feed (void)
+{
+    IWDG->KR = 0xAAAA;
+}
+
+
+/** @brief   Restart the processor now.
+ *  @param   task The task which missed its heartbeat
+ *  @param   late Time since its last heartbeat, ms
+ */
+static void supervisor_restart (uint8_t task, uint32_t late)
+{
+    (void)task;
+    (void)late;
+    NVIC_SystemReset ();
+}
+
+#else
+
+/// Stands in for the backup registers in the simulator
+static uint32_t fault_registers[FAULT_REG_COUNT + 1];
+
+
+/** @brief   Get the backup registers ready, which needs nothing here.
+ */
+static void fault_begin (void)
+{
+}
+
+
+/** @brief   Read a word which was kept through the last restart.
+ *  @param   reg Which word, from @c FaultRegister
+ *  @return  The word
+ */
+static uint32_t fault_read (uint8_t reg)
+{
+    return (fault_registers[reg]);
+}
+
+
+/** @brief   Save a word which will be kept through a restart.
+ *  @param   reg Which word, from @c FaultRegister
+ *  @param   value The word to save
+ */
+static void fault_write (uint8_t reg, uint32_t value)
+{
+    fault_registers[reg] = value;
+}
+
+
+/** @brief   Tell whether the watchdog caused the last restart.
+ *  @return  @c false; the simulated robot always starts from power-up
+ */
+static bool watchdog_caused_reset (void)
+{
+    return (false);
+}
+
+
+/** @brief   Start the watchdog, which the simulator doesn't have.
+ */
+static void watchdog_start (void)
+{
+}
+
+
+/** @brief   Feed the watchdog, which the simulator doesn't have.
+ */
+static void watchdog_feed (void)
+{
+}
+
+
+/** @brief   Keep the motors stopped, since the firmware can't be restarted.
+ *  @param   task The task which missed its heartbeat
+ *  @param   late Time since its last heartbeat, ms
+ */
+static void supervisor_restart (uint8_t task, uint32_t late)
+{
+    Serial.printf ("Supervisor: no heartbeat from %s for %lu ms; "
+                   "motors held stopped\n", heart_names[task],
+                   (unsigned long)late);
+    for (;;)
+    {
+        motor_stop_now ();
+        vTaskDelay (SUPERVISOR_PERIOD_MS);
+    }
+}
+
+#endif // STM32L4xx || STM32F4xx
+
+
+/** @brief   Report the fault saved before the last restart and start the
+ *           watchdog.
+ *  @details Every task's deadline starts counting from here. This must be
+ *           called in @c setup() after @c log_begin() and before any task
+ *           runs.
+ */
+void supervisor_begin (void)
+{
+    uint32_t now = millis ();
+    for (uint8_t task = 0; task < HEART_NUM_TASKS; task++)
+    {
+        heart_last_ms[task].store (now, std::memory_order_relaxed);
+    }
+
+    fault_begin ();
+    bool watchdog_reset = watchdog_caused_reset ();
+    uint32_t tag = fault_read (FAULT_REG_TAG);
+    if ((tag & 0xFFFF0000) == FAULT_MAGIC && (tag & 0xFF) < HEART_NUM_TASKS)
+    {
+        log_print ("Restarted: no heartbeat from %s for %lu ms at %lu ms "
+                   "(fault %lu)", heart_names[tag & 0xFF],
+                   (unsigned long)fault_read (FAULT_REG_LATE),
+                   (unsigned long)fault_read (FAULT_REG_UPTIME),
+                   (unsigned long)fault_read (FAULT_REG_COUNT));
+        fault_write (FAULT_REG_TAG, 0);
+    }
+    else if (watchdog_reset)
+    {
+        log_print ("Restarted by the watchdog; the supervisor stopped running");
+    }
+
+    watchdog_start ();
+}
+
+
+/** @brief   Tell the supervisor a task is still running.
+ *  @details This is a single store, so it can be called as often as a task
+ *           likes.
+ *  @param   task Which task, from @c HeartbeatTask
+ */
+void heartbeat (uint8_t task)
+{
+    heart_last_ms[task].store (millis (), std::memory_order_relaxed);
+}
+
+
+/** @brief   Stop the motors, save what happened and restart.
+ *  @param   task The task which missed its heartbeat
+ *  @param   late Time since its last heartbeat, ms
+ */
+static void supervisor_fault (uint8_t task, uint32_t late)
+{
+    // Stop first; everything else can wait
+    motor_stop_now ();
+
+    fault_write (FAULT_REG_TAG, FAULT_MAGIC | task);
+    fault_write (FAULT_REG_LATE, late);
+    fault_write (FAULT_REG_UPTIME, millis ());
+    fault_write (FAULT_REG_COUNT, fault_read (FAULT_REG_COUNT) + 1);
+
+    supervisor_restart (task, late);
+}
+
+
+/** @brief   Task which checks every heartbeat and feeds the watchdog.
+ *  @details This must run at a higher priority than any supervised task.
+ *  @param   p_params A pointer to function parameters which we don't use.
+ */
+void task_supervisor (void* p_params)
+{
+    (void)p_params;            // Does nothing but shut up a compiler warning
+
+    for (;;)
+    {
+        for (uint8_t task = 0; task < HEART_NUM_TASKS; task++)
+        {
+            // Read the heartbeat first, so one stored meanwhile isn't ahead
+            uint32_t last = heart_last_ms[task].load (std::memory_order_relaxed);
+            int32_t late = (int32_t)(millis () - last);
+            if (late > (int32_t)heart_deadline_ms[task])
+            {
+                supervisor_fault (task, late);
+            }
+        }
+        watchdog_feed ();
+        vTaskDelay (SUPERVISOR_PERIOD_MS);
+    }
+}
@@ -0,0 +1,55 @@
+/** @file supervisor.h
+ *      This file contains a supervisor which stops the motors and restarts
+ *      the robot when a task stops checking in.
+ *
+ *  @brief Per-task heartbeat deadlines backed by the independent watchdog.
+ *
+ *  @details Each supervised task calls @c heartbeat() every time around its
+ *           loop. The supervisor runs above every other task and looks at the
+ *           heartbeats a few times per deadline; if any task is late, it
+ *           stops the motors straight from the pins, saves a fault record
+ *           which lives through the restart, and restarts the processor. The
+ *           independent watchdog (IWDG) restarts the processor as well if the
+ *           supervisor itself stops running.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _SUPERVISOR_H_
+#define _SUPERVISOR_H_
+
+#include <Arduino.h>
+#if (defined STM32L4xx || defined STM32F4xx)
+    #include <STM32FreeRTOS.h>
+#endif
+#include "FreeRTOS.h"
+
+/// Tasks which must check in with the supervisor, each with its own deadline
+enum HeartbeatTask
+{
+    HEART_THERMAL,              ///< @c task_thermal, each frame read
+    HEART_DECODER,              ///< @c task_thermaldecoder, each frame decoded
+    HEART_MASTERMIND,           ///< @c task_mastermind, each pass of its states
+    HEART_LIMIT_FRONT,          ///< @c task_limit_front, each switch check
+    HEART_LIMIT_BACK,           ///< @c task_limit_back, each switch check
+    HEART_TOF,                  ///< @c task_tof, each range or retry
+    HEART_MOTOR,                ///< @c task_motor, each pass the speed loop has run since the last
+    HEART_NUM_TASKS             ///< Number of supervised tasks
+};
+
+/// How often the supervisor checks the heartbeats
+const uint16_t SUPERVISOR_PERIOD_MS = 20;
+
+/// Time without a refresh after which the watchdog restarts the processor
+const uint16_t WATCHDOG_TIMEOUT_MS = 100;
+
+// Report the fault saved before the last restart and start the watchdog;
+// call in setup() before any task runs
+void supervisor_begin (void);
+
+// Tell the supervisor a task is still running
+void heartbeat (uint8_t task);
+
+// The task which checks the heartbeats and feeds the watchdog
+void task_supervisor (void* p_params);
+
+#endif // _SUPERVISOR_H_
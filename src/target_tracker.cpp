@@ -0,0 +1,209 @@
+/** @file target_tracker.cpp
+ *      This file contains a lightweight Kalman filter tracker which follows the
+ *      bearing and heat of a person seen by the thermal camera.
+ *
+ *  @details The thermal camera only gives a new frame every 100 ms, and the
+ *           target has moved by the time the motors act on it. The tracker
+ *           smooths the detections and estimates how fast the target is moving
+ *           across the field of view so the robot can steer to where the
+ *           target is going to be rather than where it was.
+ */
+
+#include "target_tracker.h"
+
+
+/** @brief   Create a constant-velocity filter.
+ *  @param   accel_noise Process noise density, in (units/s^2)^2 per Hz
+ *  @param   meas_noise Variance of each measurement, in units^2
+ */
+ConstVelFilter::ConstVelFilter (float accel_noise, float meas_noise)
+{
+    q = accel_noise;
+    r = meas_noise;
+    reset (0);
+}
+
+
+/** @brief   Start the filter over at a measured value.
+ *  @details The value starts at the measurement with the measurement's
+ *           uncertainty, and the rate starts at zero with a large uncertainty
+ *           so the first few updates quickly find the real rate.
+ *  @param   z The first measurement
+ */
+void ConstVelFilter::reset (float z)
+{
+    x = z;
+    v = 0;
+    p00 = r;
+    p01 = 0;
+    p11 = 100 * r;
+}
+
+
+/** @brief   Move the estimate forward in time.
+ *  @details This is the Kalman predict step for the model x' = x + v dt with
+ *           a random acceleration; the covariance grows with the time step.
+ *  @param   dt Time step in seconds
+ */
+void ConstVelFilter::predict (float dt)
+{
+    float dt2 = dt * dt;
+
+    x += v * dt;
+
+    p00 += 2 * dt * p01 + dt2 * p11 + q * dt2 * dt / 3;
+    p01 += dt * p11 + q * dt2 / 2;
+    p11 += q * dt;
+}
+
+
+/** @brief   Correct the estimate with a measurement of the value.
+ *  @param   z The measured value
+ */
+void ConstVelFilter::update (float z)
+{
+    float s = p00 + r;              // innovation variance
+    float k0 = p00 / s;             // gain for the value
+    float k1 = p01 / s;             // gain for the rate
+    float y = z - x;                // innovation
+
+    x += k0 * y;
+    v += k1 * y;
+
+    p11 -= k1 * p01;
+    p01 -= k0 * p01;
+    p00 -= k0 * p00;
+}
+
+
+/** @brief   Create a tracker which isn't tracking anything yet.
+ *  @details Noise values were chosen for a person walking a few metres from
+ *           the robot: bearing measurements are good to about 3 degrees and
+ *           the bearing rate can change by around 20 degrees/second between
+ *           frames.
+ */
+TargetTracker::TargetTracker (void)
+    : bearing_f (400.0, 9.0), heat_f (1.0, 0.25)
+{
+    reset ();
+}
+
+
+/** @brief   Forget the target, such as when the robot is reset.
+ */
+void TargetTracker::reset (void)
+{
+    locked = false;
+    misses = 0;
+    last_ms = 0;
+}
+
+
+/** @brief   Move both filters forward to the given time.
+ *  @param   now_ms The time, from @c millis(), to move to
+ */
+void TargetTracker::advance (uint32_t now_ms)
+{
+    float dt = (now_ms - last_ms) / 1000.0;
+    bearing_f.predict (dt);
+    heat_f.predict (dt);
+    last_ms = now_ms;
+}
+
+
+/** @brief   Feed in a frame in which the target was seen.
+ *  @details If no target was being tracked, this starts a new track at the
+ *           detection; otherwise the track is predicted forward and corrected.
+ *  @param   bearing Measured bearing of the target in degrees
+ *  @param   heat Measured temperature rise of the target over ambient
+ *  @param   now_ms The time, from @c millis(), at which the frame was decoded
+ */
+void TargetTracker::update (float bearing, float heat, uint32_t now_ms)
+{
+    if (!locked)
+    {
+        bearing_f.reset (bearing);
+        heat_f.reset (heat);
+        last_ms = now_ms;
+        locked = true;
+    }
+    else
+    {
+        advance (now_ms);
+        bearing_f.update (bearing);
+        heat_f.update (heat);
+    }
+    misses = 0;
+}
+
+
+/** @brief   Feed in a frame in which the target wasn't seen.
+ *  @details The track coasts on its prediction; after too many misses in a
+ *           row the target is considered lost.
+ *  @param   now_ms The time, from @c millis(), at which the frame was decoded
+ */
+void TargetTracker::miss (uint32_t now_ms)
+{
+    if (!locked)
+    {
+        return;
+    }
+
+    advance (now_ms);
+    misses++;
+    if (misses > TRACK_MAX_MISSES)
+    {
+        reset ();
+    }
+}
+
+
+/** @brief   Predict the bearing of the target at some time.
+ *  @details Steering on this instead of the last measurement makes the robot
+ *           lead a moving target. The prediction is clamped to the camera's
+ *           field of view since the decoder can't see any further out.
+ *  @param   when_ms The time, from @c millis(), at which the bearing is wanted
+ *  @return  The predicted bearing in degrees, positive to the right
+ */
+float TargetTracker::bearing_at (uint32_t when_ms)
+{
+    float lead = bearing_f.ahead ((int32_t)(when_ms - last_ms) / 1000.0);
+
+    return (constrain (lead, -TRACK_FOV_DEG / 2, TRACK_FOV_DEG / 2));
+}
+
+
+/** @brief   Find the bearing of a detection in the differential frame.
+ *  @details The camera's columns are 7.5 degrees apart, far too coarse to see
+ *           a person's motion from one frame to the next. This takes the
+ *           heat-weighted centroid of the peak pixel and its neighbours in the
+ *           same row to get a bearing between columns. Neighbours outside
+ *           the columns which were decoded this frame hold old values, so
+ *           they are left out.
+ *  @param   diff Array of 64 temperatures over ambient
+ *  @param   peak Index of the hottest pixel in the array
+ *  @param   first_col First column decoded this frame (default 0)
+ *  @param   last_col Last column decoded this frame (default 7)
+ *  @return  Bearing of the detection in degrees, positive to the right
+ */
+float TargetTracker::measure (const float* diff, uint8_t peak,
+                              uint8_t first_col, uint8_t last_col)
+{
+    int8_t col = peak / 8;          // every group of 8 pixels is one column
+    float sum_w = 0;
+    float sum_wc = 0;
+
+    for (int8_t c = col - 1; c <= col + 1; c++)
+    {
+        if (c >= first_col && c <= last_col && diff[c * 8 + peak % 8] > 0)
+        {
+            sum_w += diff[c * 8 + peak % 8];
+            sum_wc += diff[c * 8 + peak % 8] * c;
+        }
+    }
+
+    float centroid = (sum_w > 0) ? sum_wc / sum_w : col;
+
+    // Column 0 is on the robot's right
+    return ((3.5 - centroid) * TRACK_FOV_DEG / 8);
+}
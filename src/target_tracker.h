@@ -0,0 +1,154 @@
+/** @file target_tracker.h
+ *      This file contains a lightweight Kalman filter tracker which follows the
+ *      bearing and heat of a person seen by the thermal camera.
+ *
+ *  @brief Constant-velocity Kalman tracker used by the thermal decoder to predict where the target will be.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _TARGET_TRACKER_H_
+#define _TARGET_TRACKER_H_
+
+#include <Arduino.h>
+
+/// Horizontal field of view of the AMG88xx in degrees, spread over 8 columns
+const float TRACK_FOV_DEG = 60.0;
+
+/// Number of frames the tracker will coast on its prediction before giving up
+const uint8_t TRACK_MAX_MISSES = 3;
+
+
+/** @brief   Two-state (value and rate) constant-velocity Kalman filter.
+ *  @details This filter estimates a scalar value and its rate of change from
+ *           noisy measurements taken at irregular intervals. The process noise
+ *           models a random acceleration, so the filter trusts the velocity
+ *           less the longer it goes between measurements. Only the five
+ *           floats needed for the state and its symmetric covariance are kept.
+ */
+class ConstVelFilter
+{
+    protected:
+        float x;                        ///< Estimated value
+        float v;                        ///< Estimated rate of change per second
+        float p00;                      ///< Variance of the value estimate
+        float p01;                      ///< Covariance of value and rate
+        float p11;                      ///< Variance of the rate estimate
+        float q;                        ///< Process (acceleration) noise density
+        float r;                        ///< Measurement noise variance
+
+    public:
+        // Create a filter with the given process and measurement noise
+        ConstVelFilter (float accel_noise, float meas_noise);
+
+        // Start the filter over at a measured value with an unknown rate
+        void reset (float z);
+
+        // Move the estimate forward in time by the given number of seconds
+        void predict (float dt);
+
+        // Correct the estimate with a new measurement
+        void update (float z);
+
+        /** @brief   Get the value extrapolated a given time past the estimate.
+         *  @param   dt Time in seconds past the current estimate
+         *  @return  The extrapolated value
+         */
+        float ahead (float dt)
+        {
+            return (x + v * dt);
+        }
+
+        /** @brief   Get the current value estimate.
+         *  @return  The estimated value
+         */
+        float value (void)
+        {
+            return (x);
+        }
+
+        /** @brief   Get the current rate estimate.
+         *  @return  The estimated rate of change per second
+         */
+        float rate (void)
+        {
+            return (v);
+        }
+};
+
+
+/** @brief   Tracks the bearing of a person and the heat they give off.
+ *  @details Bearing is in degrees with positive values to the robot's right,
+ *           matching the thermal camera's column order where the first
+ *           columns are on the right. The heat is the temperature rise of the
+ *           hottest pixel over ambient, which grows as the person gets closer
+ *           and so works as a rough range estimate. The tracker keeps running
+ *           on its prediction through up to @c TRACK_MAX_MISSES frames without
+ *           a detection before it reports the target lost.
+ */
+class TargetTracker
+{
+    protected:
+        ConstVelFilter bearing_f;       ///< Filter for bearing in degrees
+        ConstVelFilter heat_f;          ///< Filter for heat over ambient
+        uint32_t last_ms;               ///< Time of the most recent frame
+        uint8_t misses;                 ///< Frames in a row without a detection
+        bool locked;                    ///< True while a target is tracked
+
+        // Move both filters forward to the given time
+        void advance (uint32_t now_ms);
+
+    public:
+        // Create a tracker which isn't tracking anything
+        TargetTracker (void);
+
+        // Forget the target
+        void reset (void);
+
+        // Feed in a frame in which the target was seen
+        void update (float bearing, float heat, uint32_t now_ms);
+
+        // Feed in a frame in which the target wasn't seen
+        void miss (uint32_t now_ms);
+
+        // Predict the bearing of the target at some time
+        float bearing_at (uint32_t when_ms);
+
+        // Find a bearing for a detection from the differential frame, using
+        // only the columns which were decoded
+        static float measure (const float* diff, uint8_t peak,
+                              uint8_t first_col = 0, uint8_t last_col = 7);
+
+        /** @brief   Check whether a target is being tracked.
+         *  @return  @c true if the tracker has a target, @c false if not
+         */
+        bool is_locked (void)
+        {
+            return (locked);
+        }
+
+        /** @brief   Get the filtered heat of the target over ambient.
+         *  @return  The estimated temperature rise in degrees C
+         */
+        float heat (void)
+        {
+            return (heat_f.value ());
+        }
+
+        /** @brief   Get the filtered turning rate of the target.
+         *  @return  The estimated rate of change of bearing in degrees/second
+         */
+        float bearing_rate (void)
+        {
+            return (bearing_f.rate ());
+        }
+
+        /** @brief   Get the number of frames in a row without a detection.
+         *  @return  0 if the target was seen in the last frame, more while coasting
+         */
+        uint8_t missed (void)
+        {
+            return (misses);
+        }
+};
+
+#endif // _TARGET_TRACKER_H_
@@ -143,6 +143,9 @@ template <class dataType> class Queue : public BaseShare
         // Put an item into the queue behind other items.
         bool put (const dataType& item);
 
+        // Put an item into the queue only if there's room for it now
+        bool try_put (const dataType& item);
+
         // This method puts an item of data into the back of the queue from 
         // within an interrupt service routine. It must not be used within 
         // non-ISR code. 
@@ -164,7 +167,10 @@ template <class dataType> class Queue : public BaseShare
          */
         bool butt_in (const dataType& item)
         {
-            return ((bool)(xQueueSendToFront (handle, &item, ticks_to_wait)));
+            bool return_value = (bool)(xQueueSendToFront (handle, &item,
+                                                          ticks_to_wait));
+            puts += return_value;
+            return (return_value);
         }
 
         // This method puts an item into the front of the queue from within 
@@ -193,9 +199,35 @@ template <class dataType> class Queue : public BaseShare
             return (uxQueueMessagesWaitingFromISR (handle) == 0);
         }
 
+        /** @brief   Return true if the queue has no room for another item.
+         *  @details This method lets a task which must never wait check
+         *           whether @c put() would block. It must @b not be used
+         *           within an interrupt service routine.
+         *  @return  @c true if the queue is full, @c false if there's room
+         */
+        bool is_full (void)
+        {
+            return (uxQueueSpacesAvailable (handle) == 0);
+        }
+
         // Get an item from the queue
         void get (dataType& recv_item);
 
+        /** @brief   Get an item from the queue if there is one, never waiting.
+         *  @details This method must @b not be used within an interrupt
+         *           service routine.
+         *  @param   recv_item A reference to the item to be filled with data
+         *           from the queue; it's left alone if the queue is empty
+         *  @return  @c true if an item was taken, @c false if the queue was
+         *           empty
+         */
+        bool try_get (dataType& recv_item)
+        {
+            bool got = (xQueueReceive (handle, &recv_item, 0) == pdTRUE);
+            gets += got;
+            return (got);
+        }
+
         // Get an item from the queue from within an interrupt service routine
         void ISR_get (dataType& recv_item);
 
@@ -254,13 +286,15 @@ template <class dataType> class Queue : public BaseShare
 
         /** @brief   Print the queue's status to a serial device.
          *  @details This method makes a printout of the queue's status on 
-         *           the given serial device, then calls this same method 
-         *           for the next item of thread-safe data in the linked list
-         *           of items. 
+         *           the given serial device as one line of the list made by
+         *           @c print_all_shares().
          *  @param   print_dev Reference to the serial device on which to print
          */
         void print_in_list (Print& print_dev);
 
+        // Fill in the numbers which describe this queue's condition
+        void get_stats (ShareStats& stats);
+
         /** @brief   Indicates whether this queue is usable.
          *  @details This method returns a value which is @c true if this queue
          *           has been successfully set up and can be used. 
@@ -329,9 +363,16 @@ Queue<dataType>::Queue (BaseType_t queue_size, const char* p_name,
 template <class dataType>
 inline void Queue<dataType>::get (dataType& recv_item)
 {
-    // If xQueueReceive doesn't return pdTrue, nothing was found in the queue, 
-    // so no changes are made to the item
-    xQueueReceive (handle, &recv_item, ticks_to_wait);
+    // Try without waiting first, so that having to wait can be counted. If
+    // xQueueReceive doesn't return pdTrue, nothing was found in the queue, so
+    // no changes are made to the item
+    BaseType_t got = xQueueReceive (handle, &recv_item, 0);
+    if (got != pdTRUE && ticks_to_wait != 0)
+    {
+        blocks++;
+        got = xQueueReceive (handle, &recv_item, ticks_to_wait);
+    }
+    gets += (got == pdTRUE);
 }
 
 
@@ -349,7 +390,8 @@ inline void Queue<dataType>::ISR_get (dataType& recv_item)
 
     // If xQueueReceive doesn't return pdTrue, nothing was found in the queue,
     // so we'll return the item as created by its default constructor
-    xQueueReceiveFromISR (handle, &recv_item, &task_awakened);
+    gets += (xQueueReceiveFromISR (handle, &recv_item, &task_awakened)
+             == pdTRUE);
 }
 
 
@@ -407,8 +449,14 @@ inline void Queue<dataType>::ISR_peek (dataType& recv_item)
 template <class dataType>
 bool Queue<dataType>::put (const dataType& item)
 {
-    bool return_value = (bool)(xQueueSendToBack (handle, &item, 
-                                                 ticks_to_wait));
+    // Try without waiting first, so that having to wait can be counted
+    bool return_value = (bool)(xQueueSendToBack (handle, &item, 0));
+    if (!return_value && ticks_to_wait != 0)
+    {
+        blocks++;
+        return_value = (bool)(xQueueSendToBack (handle, &item, ticks_to_wait));
+    }
+    puts += return_value;
 
     // Keep track of the maximum fillage of the queue
     uint16_t fillage = uxQueueMessagesWaiting (handle);
@@ -421,6 +469,30 @@ bool Queue<dataType>::put (const dataType& item)
 }
 
 
+/** @brief   Put an item into the queue behind other items if there's room.
+ *  @details Unlike @c put(), this never waits, whatever wait time the queue
+ *           was made with, so a task which must not be held up can use it on
+ *           a queue whose reader waits. This method must \b not be used
+ *           within an interrupt service routine.
+ *  @param   item Reference to the item which is going to be put into the queue
+ *  @return  True if the item was queued, false if the queue was full
+ */
+template <class dataType>
+bool Queue<dataType>::try_put (const dataType& item)
+{
+    bool return_value = (bool)(xQueueSendToBack (handle, &item, 0));
+    puts += return_value;
+
+    uint16_t fillage = uxQueueMessagesWaiting (handle);
+    if (fillage > max_full)
+    {
+        max_full = fillage;
+    }
+
+    return (return_value);
+}
+
+
 /** @brief   Put an item into the queue from within an ISR.
  *  @details This method puts an item of data into the back of the queue from
  *           within an interrupt service routine. It must \b not be used within
@@ -439,6 +511,7 @@ inline bool Queue<dataType>::ISR_put (const dataType& item)
     // Call the FreeRTOS function and save its return value
     return_value = (bool)(xQueueSendToBackFromISR (handle, &item, 
                                                    &shouldSwitch));
+    puts += return_value;
 
     // Keep track of the maximum fillage of the queue. BUG: max_full isn't
     // thread safe (but getting max_full corrupted shouldn't cause a calamity)
@@ -471,6 +544,7 @@ bool Queue<dataType>::ISR_butt_in (const dataType& item)
     // Call the FreeRTOS function and save its return value
     return_value = (bool)(xQueueSendToFrontFromISR (handle, &item, 
                                                     &shouldSwitch));
+    puts += return_value;
 
     // Return the return value saved from the call to xQueueSendToBackFromISR()
     return (return_value);
@@ -479,8 +553,8 @@ bool Queue<dataType>::ISR_butt_in (const dataType& item)
 
 /** @brief   Print the queue's status to a serial device.
  *  @details This method makes a printout of the queue's status on the given
- *           serial device, then calls this same method for the next item of 
- *           thread-safe data in the linked list of items. 
+ *           serial device as one line of the list made by 
+ *           @c print_all_shares().
  *  @param   print_dev Reference to the serial device on which to print
  */
 template <class dataType>
@@ -499,12 +573,22 @@ void Queue<dataType>::print_in_list (Print& print_dev)
     {
         print_dev << "UNUSABLE" << endl;
     }
+}
 
-    // Call the next item
-    if (p_next != NULL)
-    {
-        p_next->print_in_list (print_dev);
-    }
+
+/** @brief   Fill in the numbers which describe this queue's condition.
+ *  @param   stats The structure to fill in
+ */
+template <class dataType>
+void Queue<dataType>::get_stats (ShareStats& stats)
+{
+    BaseShare::get_stats (stats);
+    stats.kind = SHARE_KIND_QUEUE;
+    stats.capacity = buf_size;
+    // The count is one word, so it can be read without a critical section;
+    // a sample taken as an item comes or goes may be off by that item
+    stats.fill = usable () ? uxQueueMessagesWaitingFromISR (handle) : 0;
+    stats.max_full = max_full;
 }
 
 
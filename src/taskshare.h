@@ -35,10 +35,159 @@
 #ifndef _TASKSHARE_H_
 #define _TASKSHARE_H_
 
+#include <atomic>
+#include <type_traits>
 #include "baseshare.h"                      // Base class for shared data items
 #include "FreeRTOS.h"                       // Main header for FreeRTOS
 
 
+/** @brief   Tells whether a type can be shared without masking interrupts.
+ *  @details Data of 1, 2 or 4 bytes, aligned to its own size and copyable as
+ *           plain bytes, is read and written with single atomic instructions
+ *           (@c LDREX and @c STREX on the Cortex-M4), so it never needs a
+ *           critical section. A packed or odd sized type, such as a 3 byte
+ *           structure, can't be copied by one instruction even though it fits
+ *           in a word, and the simulator follows the same rule so that it
+ *           picks the same kind of store as the robot does.
+ */
+template <class DataType> struct share_lock_free
+{
+    /// @c true if a @c Share of this type uses a lock-free atomic
+    static const bool value = (sizeof (DataType) == 1
+                               || sizeof (DataType) == 2
+                               || sizeof (DataType) == 4)
+                              && alignof (DataType) == sizeof (DataType)
+                              && std::is_trivially_copyable<DataType>::value;
+};
+
+
+/** @brief   Storage for a share's data, protected by critical sections.
+ *  @details This is used for data too big to copy atomically. Tasks mask
+ *           interrupts for the copy with @c portENTER_CRITICAL(), and the
+ *           @c ISR_ methods mask higher priority interrupts the same way so
+ *           that a nested interrupt can't see half-written data either.
+ */
+template <class DataType, bool lock_free> class ShareStore
+{
+    protected:
+        DataType the_data;                    ///< Holds the data to be shared
+
+    public:
+        /** @brief   Write the data from a task.
+         *  @param   new_data The data to write
+         */
+        void put (const DataType& new_data)
+        {
+            portENTER_CRITICAL ();
+            the_data = new_data;
+            portEXIT_CRITICAL ();
+        }
+
+        /** @brief   Write the data from an ISR.
+         *  @param   new_data The data to write
+         */
+        void ISR_put (const DataType& new_data)
+        {
+            UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR ();
+            the_data = new_data;
+            portCLEAR_INTERRUPT_MASK_FROM_ISR (mask);
+        }
+
+        /** @brief   Read the data from a task.
+         *  @param   recv_data Where to put the data
+         */
+        void get (DataType& recv_data)
+        {
+            portENTER_CRITICAL ();
+            recv_data = the_data;
+            portEXIT_CRITICAL ();
+        }
+
+        /** @brief   Read the data from an ISR.
+         *  @param   recv_data Where to put the data
+         */
+        void ISR_get (DataType& recv_data)
+        {
+            UBaseType_t mask = portSET_INTERRUPT_MASK_FROM_ISR ();
+            recv_data = the_data;
+            portCLEAR_INTERRUPT_MASK_FROM_ISR (mask);
+        }
+
+        /** @brief   Add to the data from a task.
+         *  @param   delta The amount to add
+         *  @return  The value before adding
+         */
+        DataType add (DataType delta)
+        {
+            portENTER_CRITICAL ();
+            DataType old = the_data;
+            the_data = old + delta;
+            portEXIT_CRITICAL ();
+            return (old);
+        }
+};
+
+
+/** @brief   Storage for a share's data in one lock-free atomic word.
+ *  @details Reads and writes are single instructions, so they need no
+ *           critical section and leave interrupts alone; tasks and ISRs use
+ *           the same code. Adding loops on a compare and swap, which only
+ *           repeats if another task or ISR wrote in between.
+ */
+template <class DataType> class ShareStore<DataType, true>
+{
+    protected:
+        std::atomic<DataType> the_data;       ///< Holds the data to be shared
+
+    public:
+        /** @brief   Write the data from a task.
+         *  @param   new_data The data to write
+         */
+        void put (const DataType& new_data)
+        {
+            the_data.store (new_data, std::memory_order_release);
+        }
+
+        /** @brief   Write the data from an ISR.
+         *  @param   new_data The data to write
+         */
+        void ISR_put (const DataType& new_data)
+        {
+            the_data.store (new_data, std::memory_order_release);
+        }
+
+        /** @brief   Read the data from a task.
+         *  @param   recv_data Where to put the data
+         */
+        void get (DataType& recv_data)
+        {
+            recv_data = the_data.load (std::memory_order_acquire);
+        }
+
+        /** @brief   Read the data from an ISR.
+         *  @param   recv_data Where to put the data
+         */
+        void ISR_get (DataType& recv_data)
+        {
+            recv_data = the_data.load (std::memory_order_acquire);
+        }
+
+        /** @brief   Add to the data from a task or an ISR.
+         *  @param   delta The amount to add
+         *  @return  The value before adding
+         */
+        DataType add (DataType delta)
+        {
+            DataType old = the_data.load (std::memory_order_relaxed);
+            while (!the_data.compare_exchange_weak (old, old + delta,
+                                                    std::memory_order_acq_rel))
+            {
+            }
+            return (old);
+        }
+};
+
+
 /** @brief   Class for data to be shared in a thread-safe manner between tasks.
  *  @details This class implements an item of data which can be shared between
  *           tasks without the risk of data corruption associated with global 
@@ -47,11 +196,15 @@
  *           value of the data is kept. Shares therefore do not provide the 
  *           task synchronization or incur the overhead associated with queues. 
  * 
- *           The data is protected by using critical code sections (see the 
- *           FreeRTOS documentation of @c portENTER_CRITICAL() ) so that tasks 
- *           can't interrupt each other when reading or writing the data is 
- *           taking place. This prevents data corruption due to thread 
- *           switching. The C++ template mechanism is used to ensure that only
+ *           Data of 1, 2 or 4 bytes aligned to its size, such as a
+ *           @c float or a @c uint16_t, is kept in a @c std::atomic and read or written 
+ *           with single atomic instructions, so interrupts are never masked
+ *           to use it. Larger data is protected by using critical code 
+ *           sections (see the FreeRTOS documentation of 
+ *           @c portENTER_CRITICAL() ) so that tasks can't interrupt each other
+ *           when reading or writing the data is taking place. This prevents
+ *           data corruption due to thread switching. The choice is made at 
+ *           compile time by @c share_lock_free. The C++ template mechanism is used to ensure that only
  *           data of the correct type is put into or taken from a shared data
  *           item. A @c TaskShare<DataType> object keeps its own separate copy
  *           of the data. This uses some memory, but it is necessary to 
@@ -100,7 +253,8 @@
 template <class DataType> class Share : public BaseShare
 {
     protected:
-        DataType the_data;                    ///< Holds the data to be shared
+        /// Holds the data to be shared, atomically if it fits in a word
+        ShareStore<DataType, share_lock_free<DataType>::value> store;
 
     public:
         /** @brief   Construct a shared data item.
@@ -115,178 +269,123 @@ template <class DataType> class Share : public BaseShare
         {
         }
 
-        // This method is used to write data into the shared data item
-        void put (DataType);
+        /** @brief   Put data into the shared data item.
+         *  @details This method is used to write data into the shared data
+         *           item. It's declared @c inline so that instead of a regular
+         *           function call at the assembly language level,
+         *           <tt>an_object.put (x);</tt> will result in the code within
+         *           this function being inserted directly into the calling
+         *           function.
+         *  @param   new_data The data which is to be written
+         */
+        void put (DataType new_data)
+        {
+            store.put (new_data);
+            puts++;
+        }
 
-        // This method is used to write data from within an ISR only
-        void ISR_put (DataType);
+        /** @brief   Put data into the shared data item from within an ISR.
+         *  @details This method must only be called from within an interrupt,
+         *           not a normal task.
+         *  @param   new_data The data which is to be written
+         */
+        void ISR_put (DataType new_data)
+        {
+            store.ISR_put (new_data);
+            puts++;
+        }
 
-        // This method is used to read data from the shared data item
-        void get (DataType&);
+        /** @brief   Read data from the shared data item.
+         *  @param   recv_data A reference to the variable in which to put
+         *           received data
+         */
+        void get (DataType& recv_data)
+        {
+            store.get (recv_data);
+            gets++;
+        }
 
-        // This method is used to read data from within an ISR only
-        void ISR_get (DataType&);
+        /** @brief   Read data from the shared data item, from within an ISR.
+         *  @details This method must only be called from within an interrupt
+         *           service routine, not a normal task.
+         *  @param   recv_data A reference to the variable in which to put
+         *           received data
+         */
+        void ISR_get (DataType& recv_data)
+        {
+            store.ISR_get (recv_data);
+            gets++;
+        }
+
+        /** @brief   Tell whether this share is read and written without
+         *           masking interrupts.
+         *  @return  @c true for a lock-free atomic share
+         */
+        static bool is_lock_free (void)
+        {
+            return (share_lock_free<DataType>::value);
+        }
 
         // Print the share's status within a list of all shares' statuses
         void print_in_list (Print& printer);
 
         /**   @brief   The prefix increment causes the shared data to increase
          *             by one.
-         *    @details This operator just increases by one the variable held by
-         *             the shared data item. @b BUG: It should return a 
-         *             reference to this shared data item, but for some reason 
-         *             the compiler insists it must return a reference to the 
-         *             data @e in the shared data object. Why is unknown. 
+         *    @details The whole read, add and write is atomic. The new value
+         *             is returned rather than a reference to the data, which
+         *             another task could change at any time.
+         *    @return  The value after the increment
          */
-        DataType& operator ++ (void)
+        DataType operator ++ (void)
         {
-            portENTER_CRITICAL ();
-            the_data++;
-            portEXIT_CRITICAL ();
-
-            return (the_data);
+            return (store.add (1) + 1);
         }
 
         /**   @brief The postfix increment causes the shared data to increase
          *           by one.
+         *    @return  The value before the increment
          */
         DataType operator ++ (int)
         {
-            DataType result = the_data;
-            portENTER_CRITICAL ();
-            the_data++;
-            portEXIT_CRITICAL ();
-
-            return (result);
+            return (store.add (1));
         }
 
         /**   @brief   The prefix decrement causes the shared data to decrease
          *             by one.
-         *    @details This operator just decreases by one the variable held by
-         *             the shared data item. @b BUG: It should return a 
-         *             reference to this shared data item, but for some reason 
-         *             the compiler insists it must return a reference to the 
-         *             data @e in the shared data object. Why is unknown. 
+         *    @return  The value after the decrement
          */
-        DataType& operator -- (void)
+        DataType operator -- (void)
         {
-            portENTER_CRITICAL ();
-            the_data--;
-            portEXIT_CRITICAL ();
-
-            return (the_data); //// *this);  The BUG
+            return (store.add (-1) - 1);
         }
 
         /**   @brief The postfix decrement causes the shared data to decrease
          *           by one.
+         *    @return  The value before the decrement
          */
         DataType operator -- (int)
         {
-            DataType result = the_data;
-            portENTER_CRITICAL ();
-            the_data--;
-            portEXIT_CRITICAL ();
-
-            return (result);
+            return (store.add (-1));
         }
 }; // class TaskShare<DataType>
 
 
-/** @brief   Put data into the shared data item.
- *  @details This method is used to write data into the shared data item. It's
- *           declared @c inline so that instead of a regular function call at 
- *           the assembly language level, <tt>an_object.put (x);</tt> will 
- *           result in the code within this function being inserted directly 
- *           into the calling function. This is faster than doing a regular 
- *           function call, which involves pushing the program counter on the 
- *           stack, pushing parameters, jumping, making space for local 
- *           variables, jumping back and popping the program counter, @e etc.
- *  @param   new_data The data which is to be written
- */
-
-template <class DataType>
-inline void Share<DataType>::put (DataType new_data)
-{
-    portENTER_CRITICAL ();
-    the_data = new_data;
-    portEXIT_CRITICAL ();
-}
-
-
-/** @brief   Put data into the shared data item from within an ISR.
- *  @details This method writes data from an ISR into the shared data item. It
- *           must only be called from within an interrupt, not a normal task. 
- *           This is because critical section protection isn't used here, which
- *           is OK, assuming that an interrupt can't be interrupted by another 
- *           interrupt, which is the case on most small microcontrollers. 
- *  @param   new_data The data which is to be written into the shared data item
- */
-
-template <class DataType>
-void Share<DataType>::ISR_put (DataType new_data)
-{
-    the_data = new_data;
-}
-
-
-/** @brief   Read data from the shared data item.
- *  @details This method is used to read data from the shared data item with 
- *           critical section protection to ensure that the data cannot be 
- *           corrupted by a task switch. The shared data is copied into the
- *           variable which is given as this parameter's function, replacing
- *           the previous contents of that variable. 
- *  @param   recv_data A reference to the variable in which to put received
- *           data
- */
-template <class DataType>
-void Share<DataType>::get (DataType& recv_data)
-{
-    // Copy the data from the queue into the receiving variable
-    portENTER_CRITICAL ();
-    recv_data = the_data;
-    portEXIT_CRITICAL ();
-}
-
-
-/** @brief   Read data from the shared data item, from within an ISR.
- *  @details This method is used to enable code within an ISR to read data from
- *           the shared data item. It must only be called from within an 
- *           interrupt service routine, not a normal task. This is because 
- *           critical section protection isn't used here, which is OK, assuming
- *           that an interrupt can't be interrupted by another interrupt, which
- *           is the case on most small microcontrollers. 
- *  @param   recv_data A reference to the variable in which to put received
- *           data
- */
-template <class DataType>
-void Share<DataType>::ISR_get (DataType& recv_data)
-{
-    recv_data = the_data;
-}
-
-
 /** @brief   Print the name and type (share) of this data item.
  *  @details This method prints the share's name and a word indicating that it
  *           is a shared data item, as opposed to a queue, formatted to match
- *           similar printouts from other task shares such as queues. After
- *           printing this share's information, it looks in the linked list of
- *           shares for the next one and asks it to print its information too.
+ *           similar printouts from other task shares such as queues, as one
+ *           line of the list made by @c print_all_shares().
  *  @param   printer Reference to a serial device on which to print the status
  */
 template <class DataType>
 void Share<DataType>::print_in_list (Print& printer)
 {
-    // Print this task's name and pad it to 16 characters
-    printer.printf ("%-16sshare\t", name);
+    // Print this task's name and pad it to 16 characters, and say whether
+    // the share is lock-free
+    printer.printf ("%-16sshare\t%s", name, is_lock_free () ? "lock-free" : "");
 
     // End the line
     printer << endl;
-
-    // Call the next item
-    if (p_next != NULL)
-    {
-        p_next->print_in_list (printer);
-    }
 }
 
 
@@ -0,0 +1,281 @@
+/** @file telemetry.cpp
+ *      This file contains a binary telemetry channel which streams typed
+ *      records from the tasks to a PC without slowing the tasks down.
+ *
+ *  @details Printing text with @c Serial.println at 115200 baud takes about a
+ *           millisecond per line, and the printing task waits the whole time.
+ *           Here a task only copies a small binary record into a queue, which
+ *           takes a few microseconds and never waits; if the queue is full the
+ *           record is dropped and counted. A low priority task gathers queued
+ *           records, gives each a sequence number and checksum, frames it with
+ *           Consistent Overhead Byte Stuffing so that a zero byte only ever
+ *           marks the end of a frame, and hands a whole batch of frames to DMA.
+ *           The UART then sends them on its own while the tasks keep running.
+ *
+ *           The serial port used by @c Serial stays free for text. Telemetry
+ *           goes out of USART3 on pin D6 (PB10), driven straight from the
+ *           registers because the Arduino serial driver owns the USART
+ *           interrupts and doesn't do DMA; the DMA transfer is polled rather
+ *           than interrupt driven for the same reason. In the simulator the
+ *           frames go to the world instead. @c tools/telemetry_decode.py
+ *           turns the stream back into records on the PC.
+ */
+
+#include <atomic>
+#include "telemetry.h"
+#if !(defined STM32L4xx || defined STM32F4xx)
+    #include "host.h"
+#endif
+
+extern Queue<TelemetryRecord> telemetry; ///<Telemetry records waiting to be sent
+
+/// Size of each DMA buffer; several frames are sent in one transfer
+const uint16_t TELEMETRY_BUFFER = 256;
+
+/// Longest framed record: type, sequence, payload and checksum, plus COBS
+/// overhead and the zero which ends the frame
+const uint16_t TELEMETRY_MAX_FRAME = TELEMETRY_MAX_PAYLOAD + 3 + 2 + 1;
+
+/// Records lost to a full queue; any task may add to it, so it's atomic
+static std::atomic<uint32_t> dropped (0);
+
+
+/** @brief   Queue a record to be sent.
+ *  @details This never waits, so it is safe to call from any task at any
+ *           point in its loop. The sender has the lowest priority, so a put
+ *           made with room in the queue never switches tasks either.
+ *  @param   type The kind of record, from @c TelemetryType
+ *  @param   p_payload Pointer to the record
+ *  @param   length Size of the record in bytes
+ *  @return  @c true if the record was queued, @c false if it was dropped
+ */
+bool telemetry_send (uint8_t type, const void* p_payload, uint8_t length)
+{
+    TelemetryRecord record;
+
+    record.type = type;
+    record.length = min (length, TELEMETRY_MAX_PAYLOAD);
+    memcpy (record.payload, p_payload, record.length);
+
+    bool queued = telemetry.try_put (record);
+    if (!queued)
+    {
+        dropped.fetch_add (1, std::memory_order_relaxed);
+    }
+
+    return (queued);
+}
+
+
+/** @brief   Get the number of records dropped because the queue was full.
+ *  @details @c task_share_stats() sends this to the PC as a @c TelemLost
+ *           record.
+ *  @return  The number of dropped records since power-up
+ */
+uint32_t telemetry_dropped (void)
+{
+    return (dropped.load (std::memory_order_relaxed));
+}
+
+
+/** @brief   Frame one record with COBS into a buffer.
+ *  @details The frame holds the type, a sequence number so the PC can spot
+ *           lost frames, the payload, and a checksum which makes the sum of
+ *           all those bytes zero. COBS replaces every zero byte with the
+ *           distance to the next one, so the frame's only zero is its end.
+ *  @param   record The record to frame
+ *  @param   sequence The record's sequence number
+ *  @param   p_out Where to put the frame; must have room for
+ *           @c TELEMETRY_MAX_FRAME bytes
+ *  @return  The number of bytes in the frame
+ */
+static uint16_t telemetry_frame (const TelemetryRecord& record,
+                                 uint8_t sequence, uint8_t* p_out)
+{
+    uint8_t raw[TELEMETRY_MAX_PAYLOAD + 3];
+    uint8_t raw_len = 0;
+    uint8_t sum = 0;
+
+    raw[raw_len++] = record.type;
+    raw[raw_len++] = sequence;
+    memcpy (&raw[raw_len], record.payload, record.length);
+    raw_len += record.length;
+    for (uint8_t n = 0; n < raw_len; n++)
+    {
+        sum += raw[n];
+    }
+    raw[raw_len++] = -sum;
+
+    uint16_t out_len = 1;               // room for the first code byte
+    uint16_t code_at = 0;
+    uint8_t code = 1;
+    for (uint8_t n = 0; n < raw_len; n++)
+    {
+        if (raw[n] == 0)
+        {
+            p_out[code_at] = code;
+            code_at = out_len++;
+            code = 1;
+        }
+        else
+        {
+            p_out[out_len++] = raw[n];
+            code++;
+        }
+    }
+    p_out[code_at] = code;
+    p_out[out_len++] = 0;
+
+    return (out_len);
+}
+
+
+#if (defined STM32L4xx)
+
+/** @brief   Set up USART3 on PB10 to send from DMA1 channel 2.
+ *  @details PB6, which USART1 could use instead, counts the right track's
+ *           encoder.
+ */
+static void telemetry_port_begin (void)
+{
+    RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+    RCC->AHB2ENR |= RCC_AHB2ENR_GPIOBEN;
+    RCC->APB1ENR1 |= RCC_APB1ENR1_USART3EN;
+
+    // PB10 is USART3_TX as alternate function 7
+    GPIOB->AFR[1] = (GPIOB->AFR[1] & ~(0xFUL << 8)) | (7UL << 8);
+    GPIOB->MODER = (GPIOB->MODER & ~(3UL << 20)) | (2UL << 20);
+
+    USART3->CR1 = 0;
+    USART3->BRR = HAL_RCC_GetPCLK1Freq () / TELEMETRY_BAUD;
+    USART3->CR3 = USART_CR3_DMAT;
+    USART3->CR1 = USART_CR1_TE | USART_CR1_UE;
+
+    // Channel 2 of DMA1 serves USART3_TX with request number 2
+    DMA1_CSELR->CSELR = (DMA1_CSELR->CSELR & ~DMA_CSELR_C2S) | (2UL << 4);
+    DMA1_Channel2->CCR = 0;
+    DMA1_Channel2->CPAR = (uint32_t)&USART3->TDR;
+}
+
+
+/** @brief   Check whether the last DMA transfer has finished.
+ *  @return  @c true if another transfer can be started
+ */
+static bool telemetry_port_idle (void)
+{
+    return (!(DMA1_Channel2->CCR & DMA_CCR_EN)
+            || (DMA1->ISR & DMA_ISR_TCIF2));
+}
+
+
+/** @brief   Start a DMA transfer of a buffer to the UART.
+ *  @param   p_data The buffer, which must not change until the port is idle
+ *  @param   length The number of bytes to send
+ */
+static void telemetry_port_write (const uint8_t* p_data, uint16_t length)
+{
+    DMA1_Channel2->CCR = 0;
+    DMA1->IFCR = DMA_IFCR_CGIF2;
+    DMA1_Channel2->CMAR = (uint32_t)p_data;
+    DMA1_Channel2->CNDTR = length;
+    DMA1_Channel2->CCR = DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_EN;
+}
+
+#else
+
+static void telemetry_port_begin (void)
+{
+}
+
+static bool telemetry_port_idle (void)
+{
+    return (true);
+}
+
+static void telemetry_port_write (const uint8_t* p_data, uint16_t length)
+{
+    world_telemetry (p_data, length);
+}
+
+#endif // STM32L4xx
+
+
+/** @brief   Task which frames queued records and sends them by DMA.
+ *  @details While one buffer is being sent, records are framed into the
+ *           other. The task waits on the queue for the first record of a
+ *           batch, then takes any others already waiting, so busy periods are
+ *           sent in a few large transfers.
+ *  @param   p_params A pointer to function parameters which we don't use.
+ */
+void task_telemetry (void* p_params)
+{
+    (void)p_params;            // Does nothing but shut up a compiler warning
+
+    static uint8_t buffers[2][TELEMETRY_BUFFER];    // one sends, one fills
+    uint8_t filling = 0;
+    uint8_t sequence = 0;
+    TelemetryRecord record;
+
+    telemetry_port_begin ();
+
+    for (;;)
+    {
+        uint16_t used = 0;
+
+        // Block for the first record, then take what else is waiting while
+        // there's room in the buffer for the longest frame
+        telemetry.get (record);
+        used += telemetry_frame (record, sequence++, &buffers[filling][used]);
+        while (used + TELEMETRY_MAX_FRAME <= TELEMETRY_BUFFER)
+        {
+            if (!telemetry.try_get (record))
+            {
+                break;
+            }
+            used += telemetry_frame (record, sequence++,
+                                     &buffers[filling][used]);
+        }
+
+        while (!telemetry_port_idle ())
+        {
+            vTaskDelay (1);
+        }
+        telemetry_port_write (buffers[filling], used);
+        filling ^= 1;
+    }
+}
+
+
+/** @brief   Task which sends the stats of every share and queue now and then.
+ *  @details Once every @c SHARE_STATS_MS it walks the list of shares and sends
+ *           one @c TelemShare record for each, numbered in the same order as
+ *           the list printed by @c print_all_shares(), so queues which fill up
+ *           or make tasks wait show up without printing anything. A
+ *           @c TelemLost record with the number of telemetry records dropped
+ *           so far follows them.
+ *  @param   p_params A pointer to function parameters which we don't use.
+ */
+void task_share_stats (void* p_params)
+{
+    (void)p_params;            // Does nothing but shut up a compiler warning
+
+    for (;;)
+    {
+        vTaskDelay (SHARE_STATS_MS);
+
+        ShareIterator items;
+        ShareStats stats;
+        uint8_t index = 0;
+        while (items.next (stats))
+        {
+            TelemShare record = {millis (), index++, stats.kind,
+                                 (uint8_t)min (stats.fill, (uint16_t)255),
+                                 (uint8_t)min (stats.max_full, (uint16_t)255),
+                                 stats.puts, stats.gets, stats.blocks};
+            telemetry_send (TELEM_SHARE, &record, sizeof (record));
+        }
+
+        TelemLost lost = {millis (), telemetry_dropped ()};
+        telemetry_send (TELEM_LOST, &lost, sizeof (lost));
+    }
+}
@@ -0,0 +1,143 @@
+/** @file telemetry.h
+ *      This file contains a binary telemetry channel which streams typed
+ *      records from the tasks to a PC without slowing the tasks down.
+ *
+ *  @brief Typed telemetry records, COBS framed and sent by a low priority task over UART DMA.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <Arduino.h>
+#if (defined STM32L4xx || defined STM32F4xx)
+    #include <STM32FreeRTOS.h>
+#endif
+#include "PrintStream.h"
+#include "taskqueue.h"
+
+/// Telemetry baud rate; a USB to serial adapter on pin D6 receives it
+const uint32_t TELEMETRY_BAUD = 1000000;
+
+/// Largest record payload in bytes
+const uint8_t TELEMETRY_MAX_PAYLOAD = 20;
+
+/// Kinds of record, which is the first byte of each frame
+enum TelemetryType
+{
+    TELEM_FRAME = 1,            ///< @c TelemFrame, once per decoded frame
+    TELEM_TARGET = 2,           ///< @c TelemTarget, each frame with a target
+    TELEM_MOTOR = 3,            ///< @c TelemMotor, each applied motor command
+    TELEM_STATE = 4,            ///< @c TelemState, each mastermind state change
+    TELEM_SHARE = 5,            ///< @c TelemShare, each share once a second
+    TELEM_RANGE = 6,            ///< @c TelemRange, each time of flight range
+    TELEM_DRIVE = 7,            ///< @c TelemDrive, the tracks every 50 ms or command
+    TELEM_LOST = 8              ///< @c TelemLost, after each round of share stats
+};
+
+/// How often @c task_share_stats() sends the stats of every share
+const uint16_t SHARE_STATS_MS = 1000;
+
+/// Statistics of one decoded thermal camera frame
+struct __attribute__ ((packed)) TelemFrame
+{
+    uint32_t ms;                ///< Time the frame was decoded
+    uint16_t frame;             ///< Frame sequence number from the camera
+    float peak_delta;           ///< Largest rise over ambient, deg C
+    uint8_t peak_index;         ///< Pixel with the largest rise
+    uint8_t calibrated;         ///< 1 once calibration is done
+    uint8_t skipped;            ///< Frames skipped since the last one decoded
+    uint16_t age_ms;            ///< Time from reading the frame to decoding it
+    uint8_t examined;           ///< Pixels searched for the person, 0 to 64
+};
+
+/// Where the tracked target is
+struct __attribute__ ((packed)) TelemTarget
+{
+    uint32_t ms;                ///< Time of the estimate
+    float bearing;              ///< Predicted bearing, degrees right
+    float rate;                 ///< Bearing rate, degrees/second
+    float heat;                 ///< Filtered rise over ambient, deg C
+    uint16_t range_mm;          ///< Range judged from the size of the warm blob, mm
+};
+
+/// A motor command as it was applied
+struct __attribute__ ((packed)) TelemMotor
+{
+    uint32_t ms;                ///< Time it was applied
+    uint8_t direction;          ///< 1 forward, 2 reverse, 3 left, 4 right
+    uint16_t speed_mmps;        ///< Track speed, mm/s
+    uint16_t distance_mm;       ///< Distance to go, mm, or 0 to keep going
+};
+
+/// A change of mastermind state
+struct __attribute__ ((packed)) TelemState
+{
+    uint32_t ms;                ///< Time of the change
+    uint8_t state;              ///< New state, 0 to 3
+};
+
+/// Stats of one share or queue, from @c ShareStats
+struct __attribute__ ((packed)) TelemShare
+{
+    uint32_t ms;                ///< Time of the sample
+    uint8_t index;              ///< Place in the list of shares, newest first
+    uint8_t kind;               ///< A @c ShareKind
+    uint8_t fill;               ///< Items held now, at most 255
+    uint8_t max_full;           ///< Most items ever held, at most 255
+    uint32_t puts;              ///< Items put in
+    uint32_t gets;              ///< Items taken out
+    uint32_t blocks;            ///< Waits for room or data
+};
+
+/// A range from the time of flight sensor
+struct __attribute__ ((packed)) TelemRange
+{
+    uint32_t ms;                ///< Time the range was read
+    uint16_t range_mm;          ///< Distance ahead, mm
+    uint8_t valid;              ///< 1 if something was in range
+    float closing;              ///< Smoothed closing speed, m/s
+};
+
+/// What the speed loop knows about the tracks
+struct __attribute__ ((packed)) TelemDrive
+{
+    uint32_t ms;                ///< Time of the speed loop's pass
+    int16_t left_mmps;          ///< Estimated left track speed, mm/s
+    int16_t right_mmps;         ///< Estimated right track speed, mm/s
+    int16_t left_target;        ///< Speed the left track should be at now, mm/s
+    int16_t right_target;       ///< Speed the right track should be at now, mm/s
+    int16_t left_duty;          ///< Left track duty now, -255 to 255
+    int16_t right_duty;         ///< Right track duty now, -255 to 255
+    int32_t travel_mm;          ///< Mean travel of the tracks since power-up, mm
+};
+
+/// How many records have been dropped because the queue was full
+struct __attribute__ ((packed)) TelemLost
+{
+    uint32_t ms;                ///< Time of the count
+    uint32_t dropped;           ///< Records dropped since power-up
+};
+
+/** @brief   One record waiting in the queue to be sent.
+ */
+struct TelemetryRecord
+{
+    uint8_t type;                               ///< A @c TelemetryType
+    uint8_t length;                             ///< Bytes of payload
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];     ///< The record itself
+};
+
+// Queue a record to be sent, dropping it if the queue is full
+bool telemetry_send (uint8_t type, const void* p_payload, uint8_t length);
+
+// Number of records dropped because the queue was full
+uint32_t telemetry_dropped (void);
+
+// The task which frames and sends queued records
+void task_telemetry (void* p_params);
+
+// The task which sends the stats of every share now and then
+void task_share_stats (void* p_params);
+
+#endif // _TELEMETRY_H_
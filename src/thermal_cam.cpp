@@ -1,6 +1,9 @@
 /** @file thermal_cam.cpp
  *      This file contains a task that collects data from the thermal camera.
  * 
+ *  @details The camera shares the @c Wire bus with the time of flight sensor,
+ *           so the task holds the bus lock in i2c_bus.h for each read.
+ * 
  *  @author Michael Conn
  *  @author Scott Mangin
  *  @author Nicholas Holman
@@ -9,8 +12,12 @@
  */
 
 #include "thermal_cam.h"
+#include "profile.h"
+#include "supervisor.h"
+#include "i2c_bus.h"
 
-extern Queue<float> thermaldata; ///<Thermal Camera Data Queue
+extern FrameQueue<ThermalFrame> thermaldata; ///<Thermal Camera Frame Queue
+extern Share<float> thermistor; ///<Thermal camera board temperature
 
 /** @brief   Task which runs the Thermal Camera. 
  *  @details This task initializes and collects data from the Thermal Camera into a [64] array.
@@ -23,11 +30,15 @@ void task_thermal (void* p_params)
     (void)p_params;            // Does nothing but shut up a compiler warning
 
     Adafruit_AMG88xx amg; //Constructor for Adafruit thermal sensor object
-    float pixels[AMG88xx_PIXEL_ARRAY_SIZE]; //Sets local array to handle the readPixels AMG88xx library function
+    ThermalFrame frame; //Holds the readPixels data from the AMG88xx library function with its sequence number and time
+    frame.sequence = 0; //Counts up for every frame so the decoder can see which it missed
     bool status = 0; //Calibration status
     
     // default settings
-    status = amg.begin();
+    {
+        I2cLock bus; // begin() talks to the camera and starts Wire
+        status = amg.begin();
+    }
     if (!status) 
     {
         Serial.println("Could not find a valid AMG88xx sensor, check wiring!");
@@ -38,12 +49,21 @@ void task_thermal (void* p_params)
     
     for (;;)
     {
-        //read all the pixels
-        amg.readPixels(pixels);
-        for(uint8_t i = 1; i <= 64; i++)
         {
-            thermaldata.put(pixels[i-1]);
+            I2cLock bus; // the ToF task uses the same bus
+
+            //read the board temperature first so it is current when the frame arrives
+            thermistor.put(amg.readThermistor());
+
+            //read all the pixels
+            PROFILE_ZONE(PROFILE_READ_PIXELS);
+            amg.readPixels(frame.pixels);
         }
+        frame.ms = millis();
+        //pass the whole frame; if the decoder is behind, the oldest frame is dropped rather than waiting
+        thermaldata.put(frame);
+        frame.sequence++;
+        heartbeat(HEART_THERMAL); // still reading frames
         //delay a bit
         vTaskDelay(100);
     }
@@ -10,6 +10,10 @@
  *  @date   2020-Dec-01 Original file
  */
 
+// This define prevents this .h file from being included more than once
+#ifndef _THERMAL_CAM_H_
+#define _THERMAL_CAM_H_
+
 #include "Arduino.h"
 #if (defined STM32L4xx || defined STM32F4xx)
     #include <STM32FreeRTOS.h>
@@ -18,5 +22,21 @@
 #include <Wire.h>
 #include <Adafruit_AMG88xx.h>
 #include "taskqueue.h"
+#include "taskshare.h"
+#include "framequeue.h"
+
+/** @brief   One frame from the thermal camera as it is passed to the decoder.
+ *  @details The sequence number goes up by one for every frame read, so the
+ *           decoder can tell how many frames it never saw, and the time lets
+ *           it tell how old the frame is.
+ */
+struct ThermalFrame
+{
+    uint32_t sequence;                          ///< Frames read before this one
+    uint32_t ms;                                ///< Time the frame was read
+    float pixels[AMG88xx_PIXEL_ARRAY_SIZE];     ///< Temperatures in deg C
+};
 
 void task_thermal (void* p_params); // the task function
+
+#endif // _THERMAL_CAM_H_
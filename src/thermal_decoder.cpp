@@ -5,8 +5,24 @@
  *  @details This task takes the thermal camera data and makes sense of it.
  *           It calibrates to ambient conditions and differentials to the
  *           calibration matrix are used to judge if a person is there.
- *           When a person is detected, their position is fed to mastermind
- *           for course correction.
+ *           Calibration also measures each pixel's noise, and a pixel only
+ *           counts as a person once it rises past its own noise limit.
+ *           Each calibration is saved to flash, and at power-up the saved one
+ *           is checked against the first few frames so hunting can start
+ *           without waiting through a full calibration.
+ *           After each frame it sends mastermind a report of where the
+ *           person is, how warm and how big they look and how sure it is of
+ *           them, and mastermind steers and sets its speed from that.
+ *           The person's range is judged from how many pixels their
+ *           warmth would fill if each were wholly covered; the nearer they
+ *           are, the more of the frame they fill.
+ *           A Kalman tracker follows the person between frames so the robot
+ *           steers at where they will be and rides out a few missed frames.
+ *           While it has the person, only a few columns around where they
+ *           should be are searched, and the rest of the frame only when the
+ *           person isn't plainly there.
+ *           It always decodes the newest frame from the camera and skips any
+ *           it fell behind on, so it never steers on stale data.
  *           Stops hunt and resets when signaled by mastermind.
  *           Warning: Messing up calibration gives bad results!
  * 
@@ -18,18 +34,138 @@
  */
 
 #include "thermal_decoder.h"
+#include "thermal_cam.h"
+#include "target_tracker.h"
+#include "pixel_noise.h"
+#include "tuning.h"
+#include "calib_store.h"
+#include "profile.h"
+#include "telemetry.h"
+#include "console_log.h"
+#include "supervisor.h"
+#include "control_flags.h"
 
-extern Queue<float> thermaldata; ///<Thermal Camera Data Queue
-extern Queue<uint8_t> direction; ///<Direction of detected person flag
-extern Queue<uint8_t> stop_hunt; ///<Flag to signal the thermal camera should stop detecting
-extern Queue<uint8_t> reset_this; ///<Flag to reset thermal camera
+extern FrameQueue<ThermalFrame> thermaldata; ///<Thermal Camera Frame Queue
+extern SeqShare<TargetReport> target_report; ///<Newest report on the person for mastermind
+extern FlagSet<ControlFlag> control_flags; ///<Stop hunt and reset flags, among others
+extern Share<float> thermistor; ///<Thermal camera board temperature
+
+TUNABLE uint8_t CALIB_FRAMES = 50;  ///< Frames averaged for a calibration
+TUNABLE uint16_t LEAD_MS = 140;     ///< Time from decoding a frame until the tracks have ramped to a new command
+
+const uint8_t ROI_HALF_COLS = 1;    ///< Columns searched each side of the tracked person's column
+const float ROI_SURE_LIMITS = 2;    ///< Times its noise limit a pixel must rise to be sure it's the person
+const float ROI_SURE_HEAT = 0.5;    ///< Fraction of the tracked heat it must rise to as well
+const float CONFIDENT_LIMITS = 4;   ///< Times its noise limit a pixel must rise for full confidence in it
+
+// Range from the bumper is RANGE_SPREAD_M / spread - RANGE_OFFSET_M, where the
+// spread is the blob's total rise over its peak rise. Fitted to 532 frames of
+// the eight robot_sim scenarios against the true range; 0.23 m rms within
+// reach of the ToF sensor and 0.36 m over all, from 0 to 3.5 m
+const float RANGE_SPREAD_M = 13.7;  ///< Range times spread, m
+const float RANGE_OFFSET_M = 0.47;  ///< Taken from that to give the range, m
+
+/** @brief   Find the warmest pixel past its noise limit in a band of columns.
+ *  @details Only the pixels in the band have their differential updated. A
+ *           band whose last column is before its first is empty.
+ *  @param   pixels The frame's 64 temperatures
+ *  @param   ambient The calibrated ambient temperature of each pixel
+ *  @param   limit The rise past which each pixel counts as a person
+ *  @param   diff Where each pixel's rise over ambient goes
+ *  @param   first First column of the band
+ *  @param   last Last column of the band
+ *  @param   high_v The highest rise found so far, raised if one here is higher
+ *  @param   high_i The index of that pixel
+ *  @return  The number of pixels searched
+ */
+static uint8_t decode_columns(const float* pixels, const float* ambient, const float* limit,
+                              float* diff, int8_t first, int8_t last,
+                              float& high_v, uint8_t& high_i)
+{
+    if (first > last)
+    {
+        return (0);
+    }
+    for (uint8_t i = first * 8; i < (last + 1) * 8; i++)
+    {
+        diff[i] = pixels[i] - ambient[i];
+        // checking if differential is past this pixel's noise and the warmest so far
+        if (diff[i] >= limit[i] && diff[i] > high_v)
+        {
+            high_v = diff[i];     // record the new highest differential
+            high_i = i;           // record the new index of this reading
+        }
+    }
+    return ((last - first + 1) * 8);
+}
+
+/** @brief   Count the pixels of the warm blob around a peak, and add up their rises.
+ *  @details The blob is every pixel joined to the peak, side by side or
+ *           corner to corner, through pixels past their noise limits. Only
+ *           the band of columns decoded this frame is looked at.
+ *  @param   diff Each pixel's rise over ambient
+ *  @param   limit The rise past which each pixel counts as a person
+ *  @param   peak Index of the warmest pixel, which must be past its limit
+ *  @param   first First column decoded
+ *  @param   last Last column decoded
+ *  @param   rise Where the total rise of the blob's pixels goes
+ *  @return  The number of pixels in the blob
+ */
+static uint8_t blob_area(const float* diff, const float* limit, uint8_t peak,
+                         uint8_t first, uint8_t last, float& rise)
+{
+    uint8_t stack[AMG88xx_PIXEL_ARRAY_SIZE]; // pixels found but not yet spread from
+    uint64_t seen = 1ULL << peak;            // one bit for each pixel found
+    uint8_t top = 0;
+    uint8_t area = 0;
+
+    rise = 0;
+    stack[top++] = peak;
+    while (top > 0)
+    {
+        uint8_t i = stack[--top];
+        area++;
+        rise += diff[i];
+        int8_t col = i / 8;
+        int8_t row = i % 8;
+        for (int8_t c = max(col - 1, (int)first); c <= min(col + 1, (int)last); c++)
+        {
+            for (int8_t r = max(row - 1, 0); r <= min(row + 1, 7); r++)
+            {
+                uint8_t j = c * 8 + r;
+                if (!(seen & (1ULL << j)) && diff[j] >= limit[j])
+                {
+                    seen |= 1ULL << j;
+                    stack[top++] = j;
+                }
+            }
+        }
+    }
+    return (area);
+}
 
 /** @brief   Task which interperates the thermal camera data. 
  *  @details This task takes the thermal camera data and makes sense of it.
  *           It calibrates to ambient conditions and differentials to the
  *           calibration matrix are used to judge if a person is there.
- *           When a person is detected, their position is fed to mastermind
- *           for course correction.
+ *           Calibration also measures each pixel's noise, and a pixel only
+ *           counts as a person once it rises past its own noise limit.
+ *           Each calibration is saved to flash, and at power-up the saved one
+ *           is checked against the first few frames so hunting can start
+ *           without waiting through a full calibration.
+ *           After each frame it sends mastermind a report of where the
+ *           person is, how warm and how big they look and how sure it is of
+ *           them, and mastermind steers and sets its speed from that.
+ *           The person's range is judged from how many pixels their
+ *           warmth would fill if each were wholly covered; the nearer they
+ *           are, the more of the frame they fill.
+ *           A Kalman tracker follows the person between frames so the robot
+ *           steers at where they will be and rides out a few missed frames.
+ *           While it has the person, only a few columns around where they
+ *           should be are searched, and the rest of the frame only when the
+ *           person isn't plainly there.
+ *           It always decodes the newest frame from the camera and skips any
+ *           it fell behind on, so it never steers on stale data.
  *           Stops hunt and resets when signaled by mastermind.
  *           Warning: Messing up calibration gives bad results!
  *  @param   p_params A pointer to function parameters which we don't use.
@@ -39,129 +175,234 @@ void task_thermaldecoder (void* p_params)
 {
     (void)p_params;            // Does nothing but shut up a compiler warning
 
-    float pixels[AMG88xx_PIXEL_ARRAY_SIZE];  // takes the current thermal camera data
+    ThermalFrame frame;                      // takes the newest thermal camera data
+    float* pixels = frame.pixels;            // the frame's temperature array
     float ambient[AMG88xx_PIXEL_ARRAY_SIZE]; // the ambient conditions calibration data
+    float limit[AMG88xx_PIXEL_ARRAY_SIZE];   // per-pixel detection limit (squared deviation while calibrating)
     float diff[AMG88xx_PIXEL_ARRAY_SIZE];    // the differential between ambient and pixels        
 
     bool calib = false;  // program starts in need of calibration
-    bool detect = false; // program starts without having seen something
+
+    float saved_therm = 0;  // camera board temperature when the saved calibration was taken
+    bool check = calib_load(ambient, limit, saved_therm); // try the calibration saved in flash first
+    uint16_t agree = 0;     // pixels which agreed with the saved calibration
+
+    const uint8_t CHECK_FRAMES = 3;     // frames the saved calibration is checked against
+    const float CHECK_THERM = 2;        // board temperature change that makes the saved calibration stale
 
     uint8_t count = 0;   // program starts without any calibration cycles done
 
-    const uint8_t LEFT = 3;     // match the motor driver left value
-    const uint8_t MIDDLE = 1;   // match the motor driver middle value
-    const uint8_t RIGHT = 4;    // match the motor driver right value
+    const float Z_LIMIT = tail_z(DETECT_FALSE_ALARM_RATE); // noise deviations that count as a person
 
-    uint8_t high_v = 0;         // highest value when checking the array
+    float high_v = 0;           // highest differential when checking the array
     uint8_t high_i = 0;         // index of highest value in 0 to 63 form
+    uint8_t first_col = 0;      // first column searched this frame
+    uint8_t last_col = 7;       // last column searched this frame
+    uint8_t roi_half = ROI_HALF_COLS; // columns searched each side of the person, wider after losing them
+    uint8_t examined = 0;       // pixels searched this frame
 
-    uint8_t reset = 0;          // used to trash reset flag 
+    TargetTracker tracker;      // follows the person between frames
+    uint32_t last_seq = -1;     // sequence number of the last frame decoded, so the first is number 0
+    uint32_t skipped = 0;       // frames never decoded since power-up
+    float confidence = 0;       // how sure of the person the last time they were seen
+    float range = 0;            // how far away they were then, m
 
     for (;;)
     {
-        if(reset_this.any()) // reset actions
+        // wait for the newest frame from the thermal camera, skipping any stale ones;
+        // blocking here lets lower priority tasks run
+        thermaldata.get_latest(frame);
+        heartbeat(HEART_DECODER); // still decoding frames
+        uint32_t missed = frame.sequence - last_seq - 1; // frames the camera read that we never saw
+        skipped += missed;
+        last_seq = frame.sequence;
+
+        // the whole frame arrives at once, so the flags only need looking at once per frame
+        ControlFlag flags = control_flags.get();
+
+        if(flags & FLAG_RESET) // reset actions
         {
             // Scroomba should no longer be calibrated or in dectected mode
             calib = false;
-            detect = false;
+            check = false;
+            tracker.reset();
             count = 0;
             high_v = 0;
             high_i = 0;
-            reset_this.get(reset); // clear reset flag
-            if (stop_hunt.any())
-            {
-                stop_hunt.get(reset); // clear stop hunt flag
-            }            
-            Serial.println("Scroomba reset!");
+            control_flags.clear(FLAG_RESET | FLAG_STOP_HUNT); // clear reset and stop hunt flags together
+            flags = FLAG_NONE;
+            log_print("Scroomba reset! %lu frames skipped so far", (unsigned long)skipped);
         }
         
-        if(thermaldata.any()) // only decode if there is data from the thermal camera
-        {
-            for(uint8_t i = 1; i<=AMG88xx_PIXEL_ARRAY_SIZE; i++)
+        {   // decode the frame
+            PROFILE_ZONE(PROFILE_DECODE_FRAME);
+            bool stopped = flags & FLAG_STOP_HUNT; // flagged if backing up, cleared when scroomba is ready to reset
+
+            examined = 0;
+            if (stopped)
             {
-                thermaldata.get(pixels[i-1]);
-                if (stop_hunt.any()) // flagged if backing up, cleared when scroomba is ready to reset
+                // not hunting, so the frame isn't needed
+            }
+            else if (check || !calib)
+            {
+                for(uint8_t i = 1; i<=AMG88xx_PIXEL_ARRAY_SIZE; i++)
                 {
-                    if (direction.any()) // just in case stuff gets into it when it shouldn't
+                    if (check)          // checking the saved calibration against the scene
+                    {
+                        if (fabs(pixels[i-1] - ambient[i-1]) <= limit[i-1])
+                        {
+                            agree++;
+                        }
+                    }
+                    else                // get the data for calibration ambient maxtrix
                     {
-                        direction.get(reset); // get rid of the data
+                        // running mean and noise of each pixel, count is the cycles done before this one
+                        welford_add(ambient[i-1], limit[i-1], pixels[i-1], count + 1);
                     }
                 }
-                else if (!calib)          // get the data for calibration ambient maxtrix
+            }
+            else // looking for or tracking a person
+            {
+                first_col = 0;
+                last_col = 7;
+                bool sure = false;
+                if (tracker.is_locked())
                 {
-                    if (count == 0) // special case for the first time through in calibration
+                    // search only the columns around where the person should be by now
+                    float bearing = tracker.bearing_at(millis());
+                    int8_t col = constrain(lround(3.5 - bearing * 8 / TRACK_FOV_DEG), 0L, 7L);
+                    first_col = max(col - roi_half, 0);
+                    last_col = min(col + roi_half, 7);
+                    examined += decode_columns(pixels, ambient, limit, diff, first_col, last_col, high_v, high_i);
+
+                    // a peak on an edge of the search may be them crossing out of it, so
+                    // follow it a column at a time until it is inside
+                    while (high_v > 0 && high_i / 8 == first_col && first_col > 0)
                     {
-                        ambient[i-1] = pixels[i-1];
+                        first_col--;
+                        examined += decode_columns(pixels, ambient, limit, diff, first_col, first_col, high_v, high_i);
                     }
-                    else
+                    while (high_v > 0 && high_i / 8 == last_col && last_col < 7)
                     {
-                        ambient[i-1] = pixels[i-1] + ambient[i-1];
+                        last_col++;
+                        examined += decode_columns(pixels, ambient, limit, diff, last_col, last_col, high_v, high_i);
                     }
+
+                    // sure it's them if the peak is well past the noise and about as warm as they have been
+                    sure = high_v >= ROI_SURE_LIMITS * limit[high_i]
+                           && high_v >= ROI_SURE_HEAT * tracker.heat();
                 }
-                else if (!detect) // looking for a person
+                if (sure)
                 {
-                    diff[i-1] = pixels[i-1] - ambient[i-1];
-                    if (diff[i-1]>=3)   // checking if differential is greater than threshold for person
-                    {
-                        detect = true;          // switch to detected mode
-                        high_v = pixels[i-1];   // highest value is now from here
-                        high_i = i-1;           // remember highest value index                    
-                    }
-                }                
-                else // tracking the detected person
+                    roi_half = ROI_HALF_COLS;   // found them where expected; keep the search narrow
+                }
+                else if (tracker.is_locked())
                 {
-                    if (pixels[i-1]>high_v) // check if the pixel is greater than highest recorded temp reading
-                        {
-                            high_v = pixels[i-1]; // record the new highest temp reading
-                            high_i = i-1; // record the new index of this reading
-                        }
+                    // search the rest of the frame, and search wider next frame
+                    examined += decode_columns(pixels, ambient, limit, diff, 0, (int8_t)first_col - 1, high_v, high_i);
+                    examined += decode_columns(pixels, ambient, limit, diff, last_col + 1, 7, high_v, high_i);
+                    first_col = 0;
+                    last_col = 7;
+                    roi_half = min(roi_half + 1, 7);
+                }
+                else
+                {
+                    // nobody tracked yet, so search the whole frame
+                    examined += decode_columns(pixels, ambient, limit, diff, 0, 7, high_v, high_i);
+                    roi_half = ROI_HALF_COLS;
                 }
             }
 
-            if (stop_hunt.is_empty()) // keeps from passing data to mastermind when not in hunting/waiting mode
+            uint32_t decoded = millis();
+            TelemFrame stats = {decoded, (uint16_t)frame.sequence, high_v, high_i, calib,
+                                (uint8_t)min(missed, (uint32_t)255), (uint16_t)(decoded - frame.ms),
+                                examined};
+            telemetry_send(TELEM_FRAME, &stats, sizeof(stats));
+
+            if (!stopped) // keeps from passing data to mastermind when not in hunting/waiting mode
             {
                 if (calib)      // must be calibrated to pass data
                 {             
-                    if (detect)   // must have detected something to pass data
+                    uint32_t now = millis();
+                    TargetReport report = {frame.sequence, frame.ms, false, 0, 0, 0, 0, 0, 0};
+
+                    if (high_v > 0)   // some pixel rose past its detection limit
+                    {
+                        tracker.update(TargetTracker::measure(diff, high_i, first_col, last_col), high_v, now);
+                        confidence = constrain((high_v / limit[high_i] - 1) / (CONFIDENT_LIMITS - 1), 0.0f, 1.0f);
+                        report.peak_c = pixels[high_i];
+                        report.delta_c = high_v;
+                        float rise;
+                        report.area = blob_area(diff, limit, high_i, first_col, last_col, rise);
+                        // a whole pixel's worth of them rises by about the peak, so this is
+                        // how many pixels they would fill; a far person only partly fills
+                        // the pixels they're in, so this counts their dimness too
+                        range = max(RANGE_SPREAD_M * high_v / rise - RANGE_OFFSET_M, 0.0f);
+                    }
+                    else
+                    {
+                        tracker.miss(now);      // coast on the prediction for a few frames
+                    }
+
+                    if (tracker.is_locked())   // must be tracking something to pass data
                     {   
-                        // check the index of the highest value
-                        // pass corresponding direction to mastermind
-                        // (using the direction queue)
-                        // current configuration uses a wide middle band for the field of view
-                        
-                        if (high_i<16) // 24 for wide sides FoV config.
-                        {
-                            direction.put(RIGHT);
-                            //Serial.println("right"); // debug check
-                        }
-                        else if (high_i>=48) // 40 for wide sides FoV config.
+                        // aim where the person will be when the motors act, not where they were
+                        float bearing = tracker.bearing_at(now + LEAD_MS);
+
+                        TelemTarget target = {now, bearing, tracker.bearing_rate(), tracker.heat(),
+                                              (uint16_t)min(range * 1000, 65535.0f)};
+                        telemetry_send(TELEM_TARGET, &target, sizeof(target));
+
+                        report.locked = true;
+                        report.bearing = bearing;
+                        report.range_m = range;     // as they were last seen while coasting
+                        // less sure of where they are with each frame spent coasting
+                        report.confidence = confidence * (1 - (float)tracker.missed() / (TRACK_MAX_MISSES + 1));
+                    }
+                    else
+                    {
+                        // waiting to dectect someone, or lost them; mastermind stops if it was chasing
+                    }
+                    target_report.put(report); // pass it to mastermind
+                    high_v = 0; // reset high value after passing data
+                    high_i = 0; // reset high value index after passing data
+                }
+                else if (check) // rest of checking the saved calibration
+                {
+                    count++;
+                    if (count >= CHECK_FRAMES)
+                    {
+                        float therm;
+                        thermistor.get(therm);
+                        check = false;
+                        count = 0;
+                        // a person in view may spoil a few pixels, but most must match
+                        if (agree >= 0.9 * CHECK_FRAMES * AMG88xx_PIXEL_ARRAY_SIZE
+                            && fabs(therm - saved_therm) <= CHECK_THERM)
                         {
-                            direction.put(LEFT);
-                            //Serial.println("left"); // debug check
+                            calib = true; // saved calibration is good, start hunting now
+                            log_print("Saved calibration OK");
                         }
                         else
                         {
-                            direction.put(MIDDLE);
-                            //Serial.println("middle"); // debug check
+                            log_print("Saved calibration stale, recalibrating");
                         }
-                        high_v = 0; // reset high value after passing data
-                        high_i = 0; // reset high value index after passing data                    
-                    }
-                    else
-                    {
-                        // waiting to dectect someone
                     }
                 }
                 else // rest of calibration
                 {
                     count++; // keep track of times calibration data is taken
-                    if (count >= 50) // set the number of times calibration data should be averaged over
+                    if (count >= CALIB_FRAMES) // set the number of times calibration data should be averaged over
                     {
+                        PROFILE_ZONE(PROFILE_CALIB_LIMITS);
                         for(uint8_t i = 1; i<=AMG88xx_PIXEL_ARRAY_SIZE; i++)
                         {
-                            ambient[i-1] = ambient[i-1]/count;
+                            limit[i-1] = detection_limit(limit[i-1], count, Z_LIMIT);
                         }
                         calib = true; // stops calibration mode
+
+                        thermistor.get(saved_therm);
+                        calib_save(ambient, limit, saved_therm); // so the next power-up can skip this
                     }
                 }
             }
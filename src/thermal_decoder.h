@@ -11,6 +11,10 @@
  *  @date   2020-Dec-01 Original file
  */
 
+// This define prevents this .h file from being included more than once
+#ifndef _THERMAL_DECODER_H_
+#define _THERMAL_DECODER_H_
+
 #include "Arduino.h"
 #if (defined STM32L4xx || defined STM32F4xx)
     #include <STM32FreeRTOS.h>
@@ -19,7 +23,30 @@
 #include <Wire.h>
 #include <Adafruit_AMG88xx.h>
 #include "taskqueue.h"
+#include "taskshare.h"
+#include "seqshare.h"
+
+/** @brief   What the decoder knows about the person, sent to mastermind after
+ *           every frame decoded while hunting.
+ *  @details Only the newest report matters, so it goes through a
+ *           @c SeqShare; mastermind tells a new one by its sequence number
+ *           and a stale one by its capture time.
+ */
+struct TargetReport
+{
+    uint32_t sequence;          ///< Number of the camera frame it comes from
+    uint32_t ms;                ///< Time that frame was captured, ms since power-up
+    bool locked;                ///< A person is tracked; if not, the rest is zero
+    float bearing;              ///< Where the person will be when the motors act, degrees right
+    float peak_c;               ///< Temperature of the warmest pixel on them, deg C
+    float delta_c;              ///< How far that pixel rose over its ambient, deg C
+    uint8_t area;               ///< Pixels on them which rose past their detection limits
+    float range_m;              ///< Distance from the bumper to them, judged from the size of their blob, m
+    float confidence;           ///< How plainly they were seen, 0 to 1; less while coasting
+};
 
 void task_thermaldecoder (void* p_params); // the task function
 
+#endif // _THERMAL_DECODER_H_
+
 
@@ -0,0 +1,125 @@
+/** @file tof_sensor.cpp
+ *      This file contains a task that measures the distance to whatever is in
+ *      front of the robot with the time of flight sensor.
+ *
+ *  @details The VL53L0X ranges continuously, starting each range as soon as
+ *           the last one is done, and pulls its GPIO1 pin low when a range is
+ *           ready. That pin's interrupt wakes this task through a queue, so
+ *           the task sleeps between ranges instead of waiting on the I2C bus
+ *           for a single-shot range to finish. If the interrupt is missed,
+ *           the wait times out a little after the range should have been done
+ *           and the sensor's status is read instead.
+ *
+ *           The sensor shares the @c Wire bus with the thermal camera, so
+ *           every call into the sensor library, including @c begin(), which
+ *           starts @c Wire over again, holds the bus lock in i2c_bus.h.
+ *
+ *           Each range is published in a @c SeqShare with the closing speed,
+ *           which is the rate at which the range shrinks, smoothed with a
+ *           first-order filter because one range to the next differs by only
+ *           a few times the sensor's noise.
+ */
+
+#include "tof_sensor.h"
+#include "supervisor.h"
+#include "telemetry.h"
+#include "console_log.h"
+#include "i2c_bus.h"
+
+extern Queue<uint8_t> tof_ready; ///<Raised by the ToF sensor's interrupt when a range is ready
+extern SeqShare<TofReading> tof_reading; ///<Newest range and closing speed
+
+/// Weight of each new closing speed in the smoothed one
+const float TOF_SPEED_ALPHA = 0.25;
+
+/// Time to wait before trying to start a missing sensor again, ms
+const uint16_t TOF_RETRY_MS = 250;
+
+
+/** @brief   Interrupt which runs when the ToF sensor has a range ready.
+ */
+static void tof_ready_isr (void)
+{
+    tof_ready.ISR_put(1);
+}
+
+
+/** @brief   Task which runs the time of flight sensor.
+ *  @details This task starts the sensor ranging back to back, then reads
+ *           each range as the sensor's interrupt says it's ready and
+ *           publishes the range and closing speed for mastermind.
+ *  @param   p_params A pointer to function parameters which we don't use.
+ */
+void task_tof (void* p_params)
+{
+    (void)p_params;            // Does nothing but shut up a compiler warning
+
+    Adafruit_VL53L0X lidar;    // the time of flight sensor
+    TofReading reading = {0, 0, 0, 0.0};
+    bool running = false;      // the sensor has been found and started
+    bool reported = false;     // the missing sensor has been logged
+    uint8_t flag = 0;          // holds the flag from the interrupt
+
+    pinMode(TOF_READY_PIN, INPUT_PULLUP); // GPIO1 is open drain
+    attachInterrupt(digitalPinToInterrupt(TOF_READY_PIN), tof_ready_isr, FALLING);
+
+    for (;;)
+    {
+        heartbeat(HEART_TOF); // still ranging, or still looking for the sensor
+
+        if (!running)
+        {
+            {   // begin() starts Wire again, so hold the bus for it too
+                I2cLock bus;
+                // High speed mode takes 20 ms per range and still reaches 1.2 m
+                running = lidar.begin(VL53L0X_I2C_ADDR, false, &Wire,
+                                      Adafruit_VL53L0X::VL53L0X_SENSE_HIGH_SPEED)
+                          && lidar.startRangeContinuous(TOF_PERIOD_MS);
+            }
+            if (!running)
+            {
+                if (!reported)
+                {
+                    log_print("Could not find a valid VL53L0X sensor, check wiring!");
+                    reported = true;
+                }
+                vTaskDelay(TOF_RETRY_MS);
+            }
+            continue;
+        }
+
+        // Sleep until the interrupt or a little past when the range is due;
+        // either way the status says whether there really is a new range
+        tof_ready.get(flag);
+        uint16_t range;
+        uint8_t status;
+        {
+            I2cLock bus; // the thermal camera task uses the same bus
+            if (!lidar.isRangeComplete())
+            {
+                continue;
+            }
+            range = lidar.readRangeResult();
+            status = lidar.readRangeStatus();
+        }
+        uint32_t now = millis();
+        bool valid = (status == 0 && range < TOF_MAX_MM);
+
+        if (valid && reading.valid && now != reading.ms)
+        {
+            float closing = (reading.range_mm - (float)range) / (now - reading.ms);
+            reading.closing_mps += TOF_SPEED_ALPHA * (closing - reading.closing_mps);
+        }
+        else if (!valid)
+        {
+            reading.closing_mps = 0; // start again when something comes in range
+        }
+        reading.ms = now;
+        reading.range_mm = valid ? range : TOF_MAX_MM;
+        reading.valid = valid;
+        tof_reading.put(reading);
+
+        TelemRange sent = {now, reading.range_mm, reading.valid, reading.closing_mps};
+        telemetry_send(TELEM_RANGE, &sent, sizeof(sent));
+    }
+}
@@ -0,0 +1,51 @@
+/** @file tof_sensor.h
+ *      This file contains a task that measures the distance to whatever is in
+ *      front of the robot with the time of flight sensor.
+ *
+ *  @brief  Ranges continuously with the VL53L0X and publishes the distance ahead and how fast it is closing.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _TOF_SENSOR_H_
+#define _TOF_SENSOR_H_
+
+#include "Arduino.h"
+#if (defined STM32L4xx || defined STM32F4xx)
+    #include <STM32FreeRTOS.h>
+#endif
+#include "PrintStream.h"
+#include <Wire.h>
+#include <Adafruit_VL53L0X.h>
+#include "taskqueue.h"
+#include "seqshare.h"
+
+/// Pin wired to the sensor's GPIO1, which goes low when a range is ready
+const uint32_t TOF_READY_PIN = D7;
+
+/// Time between ranges; no longer than the high speed timing budget, so the
+/// sensor starts each range as soon as the last one is done
+const uint16_t TOF_PERIOD_MS = 20;
+
+/// Ranges beyond this are too unreliable to use, mm
+const uint16_t TOF_MAX_MM = 1200;
+
+/// A reading older than this means the sensor has stopped, ms
+const uint16_t TOF_STALE_MS = 100;
+
+/// Half the width of the sensor's cone; anything further off to one side
+/// isn't in its ranges, degrees
+const float TOF_HALF_DEG = 12.5;
+
+/** @brief   The newest range from the time of flight sensor.
+ */
+struct TofReading
+{
+    uint32_t ms;                ///< Time the range was read
+    uint16_t range_mm;          ///< Distance to whatever is ahead, mm
+    uint8_t valid;              ///< 1 if something is in range
+    float closing_mps;          ///< Smoothed closing speed, m/s, positive nearing
+};
+
+void task_tof (void* p_params); // the task function
+
+#endif // _TOF_SENSOR_H_
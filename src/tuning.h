@@ -0,0 +1,21 @@
+/** @file tuning.h
+ *      This file contains the marker for the firmware constants which the
+ *      host simulator's parameter sweeps may change.
+ *
+ *  @brief  Constants on the robot which the scenario farm can set on the host.
+ */
+
+// This define prevents this .h file from being included more than once
+#ifndef _TUNING_H_
+#define _TUNING_H_
+
+/// Marks a tuning constant. On the robot it is an ordinary constant. On the
+/// host it is a variable, so that @c sim/scenario_farm.cpp can try other
+/// values in each run before calling @c setup().
+#if (defined STM32L4xx || defined STM32F4xx)
+    #define TUNABLE const
+#else
+    #define TUNABLE
+#endif
+
+#endif // _TUNING_H_
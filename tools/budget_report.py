@@ -0,0 +1,462 @@
+#!/usr/bin/env python3
+"""RAM, flash and stack budget report for the Scroomba firmware.
+
+After the firmware links, this reads the linker map, the .su files written by
+-fstack-usage, a disassembly of the ELF and the task and queue declarations in
+src/main.cpp, then prints:
+
+  * flash and static RAM used by each object file;
+  * the FreeRTOS heap needed for each task's stack, each queue's storage and
+    each mutex;
+  * the shares, which need no heap, with the static RAM each one takes;
+  * the worst-case stack depth of each task, found by walking the call graph
+    from the task function, with the deepest call chain and each frame's size.
+
+It fails the build when flash, RAM or any task's stack is over budget. The
+budget_l476rg environment in platformio.ini runs it after every link, taking
+its limits from the custom_budget_* options there. It can also be run by hand:
+
+    budget_report.py --build-dir .pio/build/budget_l476rg \\
+        --elf .pio/build/budget_l476rg/firmware.elf \\
+        --map .pio/build/budget_l476rg/firmware.map --main src/main.cpp
+
+The stack walk is only as good as the call graph. Calls through function
+pointers can't be followed, functions built without -fstack-usage count as
+using no stack, and recursion is cut at the first repeat; each of these is
+listed under the report so the numbers can be judged.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+# Bytes of each item type which main.cpp puts in a queue or share. Add a type
+# here when a queue of a new type is declared; the report fails until it is.
+TYPE_SIZES = {
+    "bool": 1,
+    "uint8_t": 1,
+    "int8_t": 1,
+    "uint16_t": 2,
+    "int16_t": 2,
+    "uint32_t": 4,
+    "int32_t": 4,
+    "float": 4,
+    "ThermalFrame": 264,
+    "TelemetryRecord": 22,
+    "MotorCommand": 6,
+}
+
+# FreeRTOS bookkeeping which comes out of the heap with every task, queue and
+# event group
+TCB_BYTES = 96
+QUEUE_BYTES = 80
+EVENT_GROUP_BYTES = 32
+
+# Stack words are 32 bits on the Cortex-M4
+STACK_WORD_BYTES = 4
+
+# A context switch pushes the integer and floating point registers onto the
+# task's stack; interrupts use the main stack and don't count against tasks
+CONTEXT_BYTES = 200
+
+# Output sections and whether they take flash, RAM or both
+FLASH_SECTIONS = (".isr_vector", ".text", ".rodata", ".ARM", ".init_array",
+                  ".fini_array", ".preinit_array", ".eh_frame",
+                  ".gcc_except_table")
+RAM_SECTIONS = (".bss", ".tbss", "._user_heap_stack", ".noinit")
+BOTH_SECTIONS = (".data", ".tdata")
+
+
+def parse_size(text):
+    """Turn a size such as 96K or 1M or 4096 into bytes."""
+    text = str(text).strip().upper()
+    scale = {"K": 1024, "M": 1024 * 1024}.get(text[-1:], 1)
+    return int(text.rstrip("KM"), 0) * scale
+
+
+def module_name(path):
+    """Shorten an object path from the map to the file or archive member."""
+    match = re.match(r"(.*)\((.*)\)$", path)
+    if match:
+        return os.path.basename(match.group(1)) + "(" + match.group(2) + ")"
+    name = os.path.basename(path)
+    return name[:-2] if name.endswith(".cpp.o") or name.endswith(".c.o") else name
+
+
+def parse_map(map_path):
+    """Add up flash and RAM for each object file from a GNU ld map.
+
+    Returns a dictionary from module name to [flash bytes, RAM bytes].
+    """
+    modules = {}
+    output = None
+    pending = None
+    started = False
+
+    with open(map_path, errors="replace") as map_file:
+        for line in map_file:
+            line = line.rstrip("\n")
+            if not started:
+                started = line.startswith("Linker script and memory map")
+                continue
+            if line and not line[0].isspace():
+                output = line.split()[0]
+                pending = None
+                continue
+
+            fields = line.split()
+            if len(fields) == 1 and fields[0].startswith("."):
+                pending = fields[0]             # size is on the next line
+                continue
+            if pending and len(fields) >= 3 and fields[0].startswith("0x"):
+                fields = [pending] + fields
+            pending = None
+            if (len(fields) < 4 or not fields[0].startswith(".")
+                    or not fields[1].startswith("0x")
+                    or not fields[2].startswith("0x")):
+                continue
+
+            size = int(fields[2], 16)
+            if size == 0 or output is None:
+                continue
+            flash = output.startswith(FLASH_SECTIONS + BOTH_SECTIONS)
+            ram = output.startswith(RAM_SECTIONS + BOTH_SECTIONS)
+            if not (flash or ram):
+                continue
+            usage = modules.setdefault(module_name(" ".join(fields[3:])), [0, 0])
+            usage[0] += size if flash else 0
+            usage[1] += size if ram else 0
+    return modules
+
+
+def function_key(signature):
+    """Reduce a function's signature to a name both GCC and objdump agree on.
+
+    Template arguments and parameter lists are spelled differently by the
+    two, so Queue<float>::put(float const&) and
+    "bool Queue<dataType>::put(const dataType&) [with dataType = float]" both
+    become Queue::put. Functions which end up with the same key are taken to
+    use the most stack of any of them.
+    """
+    depth = 0
+    name = ""
+    for char in signature:
+        if char == "<":
+            depth += 1
+        elif char == ">":
+            depth -= 1
+        elif depth == 0:
+            if char == "(" and name.strip() and not name.endswith("operator"):
+                break
+            name += char
+    return name.strip().split(" ")[-1]
+
+
+def name_from_source(path, line_number):
+    """Get the name of the function defined on a line of a source file.
+
+    GCC writes the name of a variadic function to the .su file as just ")",
+    but the file and line are still right.
+    """
+    try:
+        with open(path, errors="replace") as source:
+            for number, line in enumerate(source, 1):
+                if number == line_number:
+                    match = re.search(r"([\w:~]+)\s*\(", line)
+                    return match.group(1) if match else ")"
+    except OSError:
+        pass
+    return ")"
+
+
+def parse_stack_usage(build_dir):
+    """Read every .su file under the build directory.
+
+    Returns a dictionary from function key to (bytes, qualifiers, file).
+    """
+    frames = {}
+    for root, _, files in os.walk(build_dir):
+        for file_name in files:
+            if not file_name.endswith(".su"):
+                continue
+            with open(os.path.join(root, file_name), errors="replace") as su_file:
+                for line in su_file:
+                    parts = line.rstrip("\n").split("\t")
+                    match = re.match(r"^(.*?):(\d+):\d+:(.*)$", parts[0])
+                    if len(parts) < 3 or not match:
+                        continue
+                    key = function_key(match.group(3))
+                    if not re.search(r"\w", key):
+                        key = name_from_source(match.group(1), int(match.group(2)))
+                    size = int(parts[1])
+                    if key not in frames or size > frames[key][0]:
+                        frames[key] = (size, parts[2], os.path.basename(match.group(1)))
+    return frames
+
+
+def parse_calls(objdump, elf):
+    """Build the call graph from a disassembly of the ELF.
+
+    Returns (calls, indirect) where calls maps each function key to the set
+    of keys it calls or jumps to, and indirect is the set of functions which
+    call through a pointer.
+    """
+    listing = subprocess.run([objdump, "-d", "-C", "--no-show-raw-insn", elf],
+                             check=True, capture_output=True, text=True).stdout
+    calls = {}
+    indirect = set()
+    current = None
+    for line in listing.splitlines():
+        header = re.match(r"^[0-9a-f]+ <(.+)>:$", line)
+        if header:
+            current = function_key(header.group(1))
+            calls.setdefault(current, set())
+            continue
+        if current is None or "\t" not in line:
+            continue
+        instruction = line.split("\t", 1)[1].strip()
+        opcode = instruction.split(None, 1)[0] if instruction else ""
+        if not re.match(r"^(bl|blx|b|b\.w|b\.n|call|callq|jmp|jmpq)$", opcode):
+            continue
+        target = re.search(r"<(.+)>$", instruction)
+        if target:
+            if not re.search(r"\+0x[0-9a-f]+$", target.group(1)):
+                callee = function_key(target.group(1))
+                if callee != current:
+                    calls[current].add(callee)
+        elif opcode in ("blx", "call", "callq") or "*" in instruction:
+            indirect.add(current)
+    return calls, indirect
+
+
+def worst_stack(entry, frames, calls, notes):
+    """Find the deepest stack under a function.
+
+    Returns (bytes, chain) where chain lists (function, frame bytes) along the
+    deepest path. Anything the walk couldn't account for is added to notes.
+    """
+    memo = {}
+
+    def walk(function, visiting):
+        if function in memo:
+            return memo[function]
+        if function in visiting:
+            notes["recursive"].add(function)
+            return (0, [])
+        frame = frames.get(function)
+        if frame is None:
+            if "@" not in function:     # dynamic linker stubs on a PC build
+                notes["unknown"].add(function)
+            own = 0
+        else:
+            own = frame[0]
+            if "dynamic" in frame[1]:
+                notes["dynamic"].add(function)
+        best = (0, [])
+        visiting.add(function)
+        for callee in sorted(calls.get(function, ())):
+            below = walk(callee, visiting)
+            if below[0] > best[0]:
+                best = below
+        visiting.discard(function)
+        memo[function] = (own + best[0], [(function, own)] + best[1])
+        return memo[function]
+
+    return walk(entry, set())
+
+
+def parse_main(main_path):
+    """Find the tasks, queues and shares which main.cpp creates.
+
+    Returns (tasks, queues, shares): tasks is a list of (function, stack
+    words), queues a list of (name, item type, depth) and shares a list of
+    (name, class, item type). A FlagSet is listed as a queue of depth 0 whose
+    item type is its flag enum. A Share or SeqShare keeps its data in the
+    object itself, whether in a lock-free atomic or not, so it takes no heap.
+    """
+    with open(main_path) as main_file:
+        source = main_file.read()
+    tasks = [(name, int(words)) for name, words in re.findall(
+        r"xTaskCreate\s*\(\s*(\w+)\s*,\s*\"[^\"]*\"\s*,\s*(\d+)", source)]
+    queues = [(name, item, int(depth)) for _, item, name, depth in re.findall(
+        r"^(Frame)?Queue<(\w+)>\s+(\w+)\s*\(\s*(\d+)", source, re.M)]
+    queues += [(name, item, 0) for item, name in re.findall(
+        r"^FlagSet<(\w+)>\s+(\w+)\s*\(", source, re.M)]
+    shares = [(name, kind, item) for kind, item, name in re.findall(
+        r"^((?:Seq)?Share)<(\w+)>\s+(\w+)\s*\(", source, re.M)]
+    return tasks, queues, shares
+
+
+def parse_mutexes(source_dir):
+    """Find the mutexes which the source files create.
+
+    Returns a list of (variable, file) for each handle assigned from
+    xSemaphoreCreateMutex(), such as the I2C bus lock.
+    """
+    mutexes = []
+    for file_name in sorted(os.listdir(source_dir)):
+        if not file_name.endswith(".cpp"):
+            continue
+        with open(os.path.join(source_dir, file_name), errors="replace") as source:
+            mutexes += [(name, file_name) for name in re.findall(
+                r"(\w+)\s*=\s*xSemaphoreCreateMutex\s*\(", source.read())]
+    return mutexes
+
+
+def symbol_sizes(objdump, elf):
+    """Get the size of each data object in the ELF from its symbol table.
+
+    Returns a dictionary from the object's name to its size in bytes.
+    """
+    listing = subprocess.run([objdump, "-t", "-C", elf],
+                             check=True, capture_output=True, text=True).stdout
+    sizes = {}
+    for line in listing.splitlines():
+        match = re.match(r"^[0-9a-f]+\s.*\sO\s+\S+\s+([0-9a-f]+)\s+(.+)$", line)
+        if match:
+            sizes[match.group(2).strip()] = int(match.group(1), 16)
+    return sizes
+
+
+def budget_report(elf, map_path, build_dir, main_path, objdump,
+                  flash_budget, ram_budget, out=sys.stdout):
+    """Print the report and return a list of the budgets which were exceeded."""
+    failures = []
+
+    modules = parse_map(map_path)
+    flash_total = sum(usage[0] for usage in modules.values())
+    static_total = sum(usage[1] for usage in modules.values())
+
+    print("\nFlash and static RAM by object file (bytes)", file=out)
+    print("%-44s %8s %8s" % ("Object", "Flash", "RAM"), file=out)
+    ranked = sorted(modules.items(), key=lambda item: -(item[1][0] + item[1][1]))
+    for name, usage in ranked[:20]:
+        print("%-44s %8d %8d" % (name[:44], usage[0], usage[1]), file=out)
+    rest = ranked[20:]
+    if rest:
+        print("%-44s %8d %8d" % ("(%d others)" % len(rest),
+                                 sum(u[0] for _, u in rest),
+                                 sum(u[1] for _, u in rest)), file=out)
+    print("%-44s %8d %8d" % ("Total", flash_total, static_total), file=out)
+
+    tasks, queues, shares = parse_main(main_path)
+    print("\nFreeRTOS heap for task stacks, queues and mutexes (bytes)", file=out)
+    heap_total = 0
+    for name, words in tasks:
+        size = words * STACK_WORD_BYTES + TCB_BYTES
+        heap_total += size
+        print("%-44s %8d  task, %d word stack" % (name, size, words), file=out)
+    for name, item, depth in queues:
+        if depth == 0:
+            heap_total += EVENT_GROUP_BYTES
+            print("%-44s %8d  flags of %s" % (name, EVENT_GROUP_BYTES, item), file=out)
+            continue
+        if item not in TYPE_SIZES:
+            failures.append("unknown size of queue item type %s; add it to "
+                            "TYPE_SIZES in %s" % (item, os.path.basename(__file__)))
+            continue
+        size = depth * TYPE_SIZES[item] + QUEUE_BYTES
+        heap_total += size
+        print("%-44s %8d  %d x %s" % (name, size, depth, item), file=out)
+    for name, file_name in parse_mutexes(os.path.dirname(main_path) or "."):
+        heap_total += QUEUE_BYTES
+        print("%-44s %8d  mutex in %s" % (name, QUEUE_BYTES, file_name), file=out)
+    print("%-44s %8d" % ("Total", heap_total, ), file=out)
+
+    sizes = symbol_sizes(objdump, elf)
+    print("\nShares, which take no heap; counted in main's static RAM above (bytes)", file=out)
+    for name, kind, item in shares:
+        size = sizes.get(name)
+        print("%-44s %8s  %s of %s" % (name, "?" if size is None else size,
+                                       kind, item), file=out)
+
+    frames = parse_stack_usage(build_dir)
+    calls, indirect = parse_calls(objdump, elf)
+    notes = {"unknown": set(), "recursive": set(), "dynamic": set()}
+    print("\nWorst-case task stacks (bytes, %d added for a context switch)"
+          % CONTEXT_BYTES, file=out)
+    for name, words in tasks:
+        key = function_key(name)
+        depth, chain = worst_stack(key, frames, calls, notes)
+        need = depth + CONTEXT_BYTES
+        have = words * STACK_WORD_BYTES
+        status = "ok" if need <= have else "OVER"
+        print("%-24s needs %6d of %6d  %s" % (name, need, have, status), file=out)
+        print("    " + " > ".join("%s %d" % step for step in chain if step[1] or
+                                  step is chain[0]), file=out)
+        if need > have:
+            failures.append("%s needs %d bytes of stack but has %d"
+                            % (name, need, have))
+        notes["indirect"] = notes.get("indirect", set()) | (
+            indirect & {step[0] for step in chain})
+
+    print("\nLimits of the stack walk", file=out)
+    for label, key in (("Calls through pointers in", "indirect"),
+                       ("No stack usage known for", "unknown"),
+                       ("Recursion cut at", "recursive"),
+                       ("Variable-size frames in", "dynamic")):
+        found = sorted(notes.get(key, ()))
+        shown = ", ".join(found[:8]) + (" and %d more" % (len(found) - 8)
+                                        if len(found) > 8 else "")
+        print("  %-26s %s" % (label, shown or "none"), file=out)
+
+    ram_total = static_total + heap_total
+    print("\nFlash %d of %d bytes, RAM %d (static %d + heap %d) of %d bytes"
+          % (flash_total, flash_budget, ram_total, static_total, heap_total,
+             ram_budget), file=out)
+    if flash_total > flash_budget:
+        failures.append("flash %d bytes is over the budget of %d"
+                        % (flash_total, flash_budget))
+    if ram_total > ram_budget:
+        failures.append("RAM %d bytes is over the budget of %d"
+                        % (ram_total, ram_budget))
+
+    for failure in failures:
+        print("BUDGET EXCEEDED: " + failure, file=out)
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--elf", required=True)
+    parser.add_argument("--map", required=True)
+    parser.add_argument("--build-dir", required=True, help="where the .su files are")
+    parser.add_argument("--main", default="src/main.cpp")
+    parser.add_argument("--objdump", default="arm-none-eabi-objdump")
+    parser.add_argument("--flash", default="1016K", help="flash budget")
+    parser.add_argument("--ram", default="96K", help="RAM budget")
+    args = parser.parse_args()
+
+    failures = budget_report(args.elf, args.map, args.build_dir, args.main,
+                             args.objdump, parse_size(args.flash),
+                             parse_size(args.ram))
+    sys.exit(1 if failures else 0)
+
+
+def platformio_setup(env):
+    """Run the report after every link of a PlatformIO environment."""
+    build_dir = env.subst("$BUILD_DIR")
+
+    def report_action(target, source, env):
+        objdump = env.subst("$OBJCOPY").replace("objcopy", "objdump")
+        os.environ["PATH"] = env["ENV"].get("PATH", "") + os.pathsep + os.environ.get("PATH", "")
+        failures = budget_report(
+            str(target[0]), os.path.join(build_dir, "firmware.map"), build_dir,
+            os.path.join(env.subst("$PROJECT_SRC_DIR"), "main.cpp"), objdump,
+            parse_size(env.GetProjectOption("custom_budget_flash", "1016K")),
+            parse_size(env.GetProjectOption("custom_budget_ram", "96K")))
+        return 1 if failures else 0
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report_action)
+
+
+# PlatformIO runs this under SCons, which provides Import(); otherwise it was
+# run by hand
+try:
+    Import("env")                       # noqa: F821
+except NameError:
+    main()
+else:
+    platformio_setup(env)               # noqa: F821
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""Decode the Scroomba's binary telemetry stream.
+
+The robot sends COBS framed records out of pin D6 at 1 Mbaud; see
+src/telemetry.h for the record layouts. This reads the stream from a serial
+port or from a file saved by the simulator (robot_sim -T), checks each frame,
+and prints one comma separated line per record. With --plot it draws the
+target bearing, motor commands and mastermind state against time instead.
+
+    telemetry_decode.py /dev/ttyUSB0
+    telemetry_decode.py standing-ahead.tlm --plot
+"""
+
+import argparse
+import struct
+import sys
+
+# Record type: (name, struct layout after the type and sequence, field names)
+RECORDS = {
+    1: ("frame", "<IHfBBBHB", ("ms", "frame", "peak_delta", "peak_index", "calibrated",
+                               "skipped", "age_ms", "examined")),
+    2: ("target", "<IfffH", ("ms", "bearing", "rate", "heat", "range_mm")),
+    3: ("motor", "<IBHH", ("ms", "direction", "speed_mmps", "distance_mm")),
+    4: ("state", "<IB", ("ms", "state")),
+    5: ("share", "<IBBBBIII", ("ms", "index", "kind", "fill", "max_full", "puts", "gets",
+                               "blocks")),
+    6: ("range", "<IHBf", ("ms", "range_mm", "valid", "closing")),
+    7: ("drive", "<Ihhhhhhi", ("ms", "left_mmps", "right_mmps", "left_target", "right_target",
+                              "left_duty", "right_duty", "travel_mm")),
+    8: ("lost", "<II", ("ms", "dropped")),
+}
+
+
+def cobs_decode(frame):
+    """Undo the byte stuffing of one frame, without its ending zero."""
+    out = bytearray()
+    at = 0
+    while at < len(frame):
+        code = frame[at]
+        if code == 0 or at + code > len(frame) + 1:
+            raise ValueError("bad COBS code")
+        out += frame[at + 1:at + code]
+        at += code
+        if code < 0xFF and at < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+def frames(stream):
+    """Yield the frames in a byte stream, split at each zero."""
+    pending = bytearray()
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            return
+        pending += chunk
+        while True:
+            end = pending.find(0)
+            if end < 0:
+                break
+            yield bytes(pending[:end])
+            del pending[:end + 1]
+
+
+def records(stream, errors):
+    """Yield (name, sequence, fields) for each good record in a stream.
+
+    Frames which don't decode, fail their checksum or have an unknown type
+    are counted in errors["bad"]; gaps in the sequence numbers, which are
+    records the robot dropped or the link lost, are counted in errors["lost"].
+    """
+    last = None
+    for frame in frames(stream):
+        try:
+            raw = cobs_decode(frame)
+        except ValueError:
+            errors["bad"] += 1
+            continue
+        if len(raw) < 3 or sum(raw) & 0xFF or raw[0] not in RECORDS:
+            errors["bad"] += 1
+            continue
+        name, layout, names = RECORDS[raw[0]]
+        body = raw[2:-1]
+        if len(body) != struct.calcsize(layout):
+            errors["bad"] += 1
+            continue
+        sequence = raw[1]
+        if last is not None:
+            errors["lost"] += (sequence - last - 1) & 0xFF
+        last = sequence
+        yield name, sequence, dict(zip(names, struct.unpack(layout, body)))
+
+
+def open_stream(source, baud):
+    """Open a saved file, or a serial port if that's what the source is."""
+    if source == "-":
+        return sys.stdin.buffer
+    if source.startswith("/dev/") or source.upper().startswith("COM"):
+        import serial                   # pyserial, only needed for live data
+        return serial.Serial(source, baud, timeout=1)
+    return open(source, "rb")
+
+
+def plot(rows):
+    """Draw bearing, motor command and state against time."""
+    import matplotlib.pyplot as plt
+
+    fig, axes = plt.subplots(3, 1, sharex=True)
+    target = [r for n, r in rows if n == "target"]
+    motor = [r for n, r in rows if n == "motor"]
+    state = [r for n, r in rows if n == "state"]
+    axes[0].plot([r["ms"] / 1000 for r in target], [r["bearing"] for r in target], ".")
+    axes[0].set_ylabel("bearing, deg")
+    axes[1].step([r["ms"] / 1000 for r in motor], [r["speed_mmps"] for r in motor], where="post")
+    axes[1].set_ylabel("motor speed, mm/s")
+    axes[2].step([r["ms"] / 1000 for r in state], [r["state"] for r in state], where="post")
+    axes[2].set_ylabel("state")
+    axes[2].set_xlabel("time, s")
+    plt.show()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source", help="serial port, .tlm file, or - for stdin")
+    parser.add_argument("--baud", type=int, default=1000000)
+    parser.add_argument("--plot", action="store_true", help="plot instead of printing")
+    args = parser.parse_args()
+
+    errors = {"bad": 0, "lost": 0}
+    rows = []
+    try:
+        for name, sequence, fields in records(open_stream(args.source, args.baud), errors):
+            if args.plot:
+                rows.append((name, fields))
+            else:
+                print(name + "," + str(sequence) + ","
+                      + ",".join("%s=%.6g" % item for item in fields.items()), flush=True)
+    except KeyboardInterrupt:
+        pass
+
+    print("bad frames %d, lost records %d" % (errors["bad"], errors["lost"]), file=sys.stderr)
+    if args.plot:
+        plot(rows)
+
+
+if __name__ == "__main__":
+    main()